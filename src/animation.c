@@ -0,0 +1,327 @@
+// SPDX-License-Identifier: MPL-2.0
+#include <assert.h>
+#include <math.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+#include <test.h>
+
+#include "animation.h"
+#include "compiler.h"
+#include "utils.h"
+
+unsigned animation_clock_tick(struct animation_clock *c, uint64_t now_ns) {
+	if (!c->last_ns || now_ns < c->last_ns) {
+		c->last_ns = now_ns;
+		c->remainder_ns = 0;
+		return 0;
+	}
+
+	uint64_t elapsed = now_ns - c->last_ns + c->remainder_ns;
+	c->last_ns = now_ns;
+	if (elapsed >= ANIMATION_STEP_NS * ANIMATION_MAX_STEPS) {
+		c->remainder_ns = 0;
+		return ANIMATION_MAX_STEPS;
+	}
+	c->remainder_ns = elapsed % ANIMATION_STEP_NS;
+	return (unsigned)(elapsed / ANIMATION_STEP_NS);
+}
+
+static double animation_distance(const struct animation_state *a) {
+	double x_dist = a->dest_center_x - a->center_x;
+	double y_dist = a->dest_center_y - a->center_y;
+	double w_dist = a->dest_w - a->w;
+	double h_dist = a->dest_h - a->h;
+	return sqrt(x_dist * x_dist + y_dist * y_dist + w_dist * w_dist + h_dist * h_dist);
+}
+
+void animation_start(struct animation_state *a) {
+	a->inv_og_distance = 1.0 / animation_distance(a);
+	if (isinf(a->inv_og_distance)) {
+		a->inv_og_distance = 0;
+	}
+	a->progress = 0.0;
+}
+
+void animation_finish(struct animation_state *a) {
+	a->center_x = a->dest_center_x;
+	a->center_y = a->dest_center_y;
+	a->w = a->dest_w;
+	a->h = a->dest_h;
+	a->velocity_x = 0.0;
+	a->velocity_y = 0.0;
+	a->velocity_w = 0.0;
+	a->velocity_h = 0.0;
+	a->progress = 1;
+	a->updated = true;
+}
+
+static const size_t animation_column_offsets[NUM_ANIMATION_COLUMNS] = {
+    [ANIMATION_CENTER_X] = offsetof(struct animation_state, center_x),
+    [ANIMATION_CENTER_Y] = offsetof(struct animation_state, center_y),
+    [ANIMATION_W] = offsetof(struct animation_state, w),
+    [ANIMATION_H] = offsetof(struct animation_state, h),
+    [ANIMATION_DEST_CENTER_X] = offsetof(struct animation_state, dest_center_x),
+    [ANIMATION_DEST_CENTER_Y] = offsetof(struct animation_state, dest_center_y),
+    [ANIMATION_DEST_W] = offsetof(struct animation_state, dest_w),
+    [ANIMATION_DEST_H] = offsetof(struct animation_state, dest_h),
+    [ANIMATION_VELOCITY_X] = offsetof(struct animation_state, velocity_x),
+    [ANIMATION_VELOCITY_Y] = offsetof(struct animation_state, velocity_y),
+    [ANIMATION_VELOCITY_W] = offsetof(struct animation_state, velocity_w),
+    [ANIMATION_VELOCITY_H] = offsetof(struct animation_state, velocity_h),
+    [ANIMATION_PROGRESS] = offsetof(struct animation_state, progress),
+    [ANIMATION_INV_OG_DISTANCE] = offsetof(struct animation_state, inv_og_distance),
+};
+
+static inline double *animation_field(struct animation_state *a, enum animation_column col) {
+	return (double *)((char *)a + animation_column_offsets[col]);
+}
+
+/// Copy a row of the table to `a`
+static void animation_table_load(const struct animation_table *t, unsigned row,
+                                 struct animation_state *a) {
+	for (int i = 0; i < NUM_ANIMATION_COLUMNS; i++) {
+		*animation_field(a, i) = t->columns[i][row];
+	}
+}
+
+void animation_table_init(struct animation_table *t) {
+	*t = (struct animation_table){0};
+}
+
+void animation_table_deinit(struct animation_table *t) {
+	for (unsigned row = 0; row < t->len; row++) {
+		t->owners[row]->table_row = 0;
+	}
+	for (int i = 0; i < NUM_ANIMATION_COLUMNS; i++) {
+		free(t->columns[i]);
+	}
+	free(t->owners);
+	*t = (struct animation_table){0};
+}
+
+void animation_table_add(struct animation_table *t, struct animation_state *a) {
+	assert(!a->table_row);
+	if (t->len == t->capacity) {
+		t->capacity = max2(t->capacity * 2, 16U);
+		for (int i = 0; i < NUM_ANIMATION_COLUMNS; i++) {
+			t->columns[i] = crealloc(t->columns[i], t->capacity);
+		}
+		t->owners = crealloc(t->owners, t->capacity);
+	}
+	for (int i = 0; i < NUM_ANIMATION_COLUMNS; i++) {
+		t->columns[i][t->len] = *animation_field(a, i);
+	}
+	t->owners[t->len] = a;
+	a->table_row = ++t->len;
+}
+
+/// Remove a row by moving the last row in its place
+static void animation_table_remove_row(struct animation_table *t, unsigned row) {
+	unsigned last = --t->len;
+	if (row == last) {
+		return;
+	}
+	for (int i = 0; i < NUM_ANIMATION_COLUMNS; i++) {
+		t->columns[i][row] = t->columns[i][last];
+	}
+	t->owners[row] = t->owners[last];
+	t->owners[row]->table_row = row + 1;
+}
+
+void animation_table_remove(struct animation_table *t, struct animation_state *a) {
+	if (!a->table_row) {
+		return;
+	}
+	unsigned row = a->table_row - 1;
+	assert(t->owners[row] == a);
+	animation_table_load(t, row, a);
+	a->table_row = 0;
+	animation_table_remove_row(t, row);
+}
+
+/// Take `nsteps` semi-implicit Euler steps of one coordinate of `n` animations:
+/// the velocity is updated first, and the position moves with the new velocity,
+/// which keeps the spring stable with a much larger step than explicit Euler.
+static void spring_step_column(const struct animation_spring *s, unsigned nsteps,
+                               unsigned n, double *restrict pos,
+                               double *restrict velocity, const double *restrict dest,
+                               bool non_negative) {
+	const double dt = (double)ANIMATION_STEP_NS / 1e9;
+	// Copied out so the compiler doesn't have to assume the stores below change
+	// them, which would keep it from vectorizing the loop
+	const double stiffness = s->stiffness, dampening = s->dampening, mass = s->mass;
+	const bool clamping = s->clamping;
+	for (unsigned step = 0; step < nsteps; step++) {
+		for (unsigned i = 0; i < n; i++) {
+			double acceleration =
+			    (stiffness * (dest[i] - pos[i]) - dampening * velocity[i]) / mass;
+			double v = velocity[i] + acceleration * dt;
+			double p = pos[i] + v * dt;
+			// Negative new width/height causes segfault and it can happen
+			// when clamping disabled and shading a window
+			if (non_negative) {
+				p = p < 0 ? 0 : p;
+			}
+			if (clamping) {
+				double lo = min2(pos[i], dest[i]), hi = max2(pos[i], dest[i]);
+				p = clamp(p, lo, hi);
+			}
+			velocity[i] = v;
+			pos[i] = p;
+		}
+	}
+}
+
+void animation_table_step(struct animation_table *t, const struct animation_spring *s,
+                          unsigned nsteps) {
+	double **c = t->columns;
+	spring_step_column(s, nsteps, t->len, c[ANIMATION_CENTER_X],
+	                   c[ANIMATION_VELOCITY_X], c[ANIMATION_DEST_CENTER_X], false);
+	spring_step_column(s, nsteps, t->len, c[ANIMATION_CENTER_Y],
+	                   c[ANIMATION_VELOCITY_Y], c[ANIMATION_DEST_CENTER_Y], false);
+	spring_step_column(s, nsteps, t->len, c[ANIMATION_W], c[ANIMATION_VELOCITY_W],
+	                   c[ANIMATION_DEST_W], true);
+	spring_step_column(s, nsteps, t->len, c[ANIMATION_H], c[ANIMATION_VELOCITY_H],
+	                   c[ANIMATION_DEST_H], true);
+
+	for (unsigned i = 0; i < t->len; i++) {
+		double x_dist = c[ANIMATION_DEST_CENTER_X][i] - c[ANIMATION_CENTER_X][i];
+		double y_dist = c[ANIMATION_DEST_CENTER_Y][i] - c[ANIMATION_CENTER_Y][i];
+		double w_dist = c[ANIMATION_DEST_W][i] - c[ANIMATION_W][i];
+		double h_dist = c[ANIMATION_DEST_H][i] - c[ANIMATION_H][i];
+		double progress =
+		    1.0 - c[ANIMATION_INV_OG_DISTANCE][i] *
+		              sqrt(x_dist * x_dist + y_dist * y_dist + w_dist * w_dist +
+		                   h_dist * h_dist);
+		// When clamping disabled we don't want the overlayed image to
+		// fade in again because process is moving to negative value
+		c[ANIMATION_PROGRESS][i] = max2(c[ANIMATION_PROGRESS][i], progress);
+	}
+
+	// Going backwards, so the row moved in place of a removed one has already
+	// been looked at
+	for (unsigned i = t->len; i-- > 0;) {
+		// We can't check for 1 here as sometimes 1 = 0.999999999999999
+		// in case of floating numbers
+		bool finished = c[ANIMATION_PROGRESS][i] >= 0.999999999;
+		if (finished) {
+			c[ANIMATION_PROGRESS][i] = 1;
+			c[ANIMATION_VELOCITY_X][i] = 0.0;
+			c[ANIMATION_VELOCITY_Y][i] = 0.0;
+			c[ANIMATION_VELOCITY_W][i] = 0.0;
+			c[ANIMATION_VELOCITY_H][i] = 0.0;
+		}
+
+		auto a = t->owners[i];
+		double w = c[ANIMATION_W][i], h = c[ANIMATION_H][i];
+		bool changed = finished ||
+		               round(c[ANIMATION_CENTER_X][i] - w * 0.5) !=
+		                   round(a->center_x - a->w * 0.5) ||
+		               round(c[ANIMATION_CENTER_Y][i] - h * 0.5) !=
+		                   round(a->center_y - a->h * 0.5) ||
+		               round(w) != round(a->w) || round(h) != round(a->h);
+		if (changed) {
+			animation_table_load(t, i, a);
+			a->updated = true;
+		}
+		if (finished) {
+			a->table_row = 0;
+			animation_table_remove_row(t, i);
+		}
+	}
+}
+
+TEST_CASE(animation_clock_tick) {
+	struct animation_clock c = {0};
+	TEST_EQUAL(animation_clock_tick(&c, 1000000000), 0);
+	TEST_EQUAL(animation_clock_tick(&c, 1000000000 + ANIMATION_STEP_NS / 2), 0);
+	// The two halves add up to a whole step
+	TEST_EQUAL(animation_clock_tick(&c, 1000000000 + ANIMATION_STEP_NS), 1);
+	TEST_EQUAL(c.remainder_ns, 0);
+	// Long stalls are capped
+	TEST_EQUAL(animation_clock_tick(&c, 100000000000), ANIMATION_MAX_STEPS);
+
+	animation_clock_stop(&c);
+	TEST_EQUAL(animation_clock_tick(&c, 200000000000), 0);
+}
+
+TEST_CASE(animation_table_frame_rate_independent) {
+	const struct animation_spring s = {
+	    .stiffness = 200, .dampening = 25, .mass = 1, .clamping = false};
+	struct animation_state a = {
+	    .center_x = 0, .center_y = 0, .w = 0, .h = 0,
+	    .dest_center_x = 500, .dest_center_y = 300, .dest_w = 800, .dest_h = 600};
+	animation_start(&a);
+	struct animation_state b = a;
+
+	// The same amount of time, painted at 144 and 30 fps
+	struct animation_table ta, tb;
+	animation_table_init(&ta);
+	animation_table_init(&tb);
+	animation_table_add(&ta, &a);
+	animation_table_add(&tb, &b);
+	struct animation_clock ca = {0}, cb = {0};
+	animation_clock_tick(&ca, 1);
+	animation_clock_tick(&cb, 1);
+	for (uint64_t t = 1; t <= 1000000000; t += 1000000000 / 144) {
+		animation_table_step(&ta, &s, animation_clock_tick(&ca, t));
+	}
+	animation_table_step(&ta, &s, animation_clock_tick(&ca, 1000000001));
+	for (uint64_t t = 1; t <= 1000000000; t += 1000000000 / 30) {
+		animation_table_step(&tb, &s, animation_clock_tick(&cb, t));
+	}
+	animation_table_step(&tb, &s, animation_clock_tick(&cb, 1000000001));
+	TEST_TRUE(a.updated);
+
+	animation_table_remove(&ta, &a);
+	animation_table_remove(&tb, &b);
+	TEST_EQUAL(ta.len, 0);
+	TEST_EQUAL(a.table_row, 0);
+	TEST_EQUAL(a.center_x, b.center_x);
+	TEST_EQUAL(a.w, b.w);
+	TEST_EQUAL(a.velocity_h, b.velocity_h);
+	TEST_TRUE(a.progress > 0.9);
+
+	animation_finish(&a);
+	TEST_EQUAL(a.center_x, 500);
+	TEST_EQUAL(a.velocity_x, 0);
+	TEST_EQUAL(a.progress, 1);
+
+	animation_table_deinit(&ta);
+	animation_table_deinit(&tb);
+}
+
+TEST_CASE(animation_table_write_back) {
+	const struct animation_spring s = {
+	    .stiffness = 200, .dampening = 25, .mass = 1, .clamping = true};
+	struct animation_state a[3] = {
+	    {.dest_center_x = 100, .dest_w = 100, .dest_h = 100},
+	    // Already at its destination
+	    {.center_x = 10, .dest_center_x = 10},
+	    {.dest_center_x = 100, .dest_w = 100, .dest_h = 100},
+	};
+	struct animation_table t;
+	animation_table_init(&t);
+	for (int i = 0; i < 3; i++) {
+		animation_start(&a[i]);
+		animation_table_add(&t, &a[i]);
+	}
+
+	// Nothing moved, only the finished one is written back and taken out
+	animation_table_step(&t, &s, 0);
+	TEST_EQUAL(t.len, 2);
+	TEST_TRUE(!a[0].updated);
+	TEST_TRUE(a[1].updated);
+	TEST_EQUAL(a[1].table_row, 0);
+	TEST_EQUAL(a[1].progress, 1);
+	TEST_EQUAL(t.owners[a[2].table_row - 1], &a[2]);
+
+	animation_table_step(&t, &s, 10);
+	TEST_TRUE(a[0].updated);
+	TEST_TRUE(a[2].updated);
+	TEST_TRUE(a[0].center_x > 0 && a[0].center_x <= 100);
+
+	animation_table_deinit(&t);
+	TEST_EQUAL(a[0].table_row, 0);
+}
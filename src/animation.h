@@ -0,0 +1,126 @@
+// SPDX-License-Identifier: MPL-2.0
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+/// Length of one integration step of the window animations, in nanoseconds.
+/// Animations are always advanced by whole steps, so they play out the same no
+/// matter how often frames are painted.
+#define ANIMATION_STEP_NS (1000000000UL / 240)
+/// Most steps taken in one frame. When painting stalls for longer than that, the
+/// animations are slowed down instead of catching up all at once.
+#define ANIMATION_MAX_STEPS 240
+
+/// Parameters of the spring pulling animated windows to their destination
+struct animation_spring {
+	double stiffness;
+	double dampening;
+	double mass;
+	/// Whether the animated geometry is kept between its current value and the
+	/// destination, so it never overshoots
+	bool clamping;
+};
+
+/// Animation state of a window
+struct animation_state {
+	/// Current position and destination, for animation
+	double center_x, center_y;           // animation progress coordinates
+	double dest_center_x, dest_center_y; // current mouse position the animation straves to
+	double w, h;
+	double dest_w, dest_h;
+	/// Spring animation velocity
+	double velocity_x, velocity_y;
+	double velocity_w, velocity_h;
+	/// Track animation progress; goes from 0 to 1
+	double progress;
+	/// Inverse of the window distance at the start of animation, for
+	/// tracking animation progress
+	double inv_og_distance;
+
+	/// Row of this animation in the animation table plus one, 0 if it's not in
+	/// the table. While it is, the table has the up-to-date values, and they
+	/// are only copied back here when the rounded geometry changes.
+	unsigned table_row;
+	/// Whether the table has copied new values here since this was last cleared
+	bool updated;
+};
+
+enum animation_column {
+	ANIMATION_CENTER_X,
+	ANIMATION_CENTER_Y,
+	ANIMATION_W,
+	ANIMATION_H,
+	ANIMATION_DEST_CENTER_X,
+	ANIMATION_DEST_CENTER_Y,
+	ANIMATION_DEST_W,
+	ANIMATION_DEST_H,
+	ANIMATION_VELOCITY_X,
+	ANIMATION_VELOCITY_Y,
+	ANIMATION_VELOCITY_W,
+	ANIMATION_VELOCITY_H,
+	ANIMATION_PROGRESS,
+	ANIMATION_INV_OG_DISTANCE,
+	NUM_ANIMATION_COLUMNS,
+};
+
+/// The running animations, stored column by column so all of them are stepped
+/// together in tight loops over contiguous arrays, instead of one window at a
+/// time.
+struct animation_table {
+	double *columns[NUM_ANIMATION_COLUMNS];
+	/// The animation state each row belongs to
+	struct animation_state **owners;
+	unsigned len, capacity;
+};
+
+/// Turns wall clock time into integration steps
+struct animation_clock {
+	/// Time of the last tick, 0 if the clock is stopped
+	uint64_t last_ns;
+	/// Time elapsed since the last tick that isn't a whole step yet
+	uint64_t remainder_ns;
+};
+
+/// Get the current time of the monotonic clock, in nanoseconds.
+static inline uint64_t animation_now_ns(void) {
+	struct timespec tm = {0, 0};
+	clock_gettime(CLOCK_MONOTONIC, &tm);
+	return (uint64_t)tm.tv_sec * 1000000000UL + (uint64_t)tm.tv_nsec;
+}
+
+/// Advance the clock to `now_ns`, and return how many steps the animations should
+/// take. The first tick after the clock is started or stopped takes no step.
+unsigned animation_clock_tick(struct animation_clock *, uint64_t now_ns);
+
+/// Stop the clock, for when nothing is animating.
+static inline void animation_clock_stop(struct animation_clock *c) {
+	*c = (struct animation_clock){0};
+}
+
+/// Start a new animation from the current geometry to the destination. The
+/// animation must not be in a table.
+void animation_start(struct animation_state *);
+
+/// Move the animation to its destination right away, and mark it updated. The
+/// animation must not be in a table.
+void animation_finish(struct animation_state *);
+
+void animation_table_init(struct animation_table *);
+void animation_table_deinit(struct animation_table *);
+
+/// Add an animation to the table, so it's stepped by `animation_table_step`. The
+/// animation state must stay at the same address while it's in the table.
+void animation_table_add(struct animation_table *, struct animation_state *);
+
+/// Copy the up-to-date values back to the animation, and take it out of the table.
+/// Does nothing if the animation isn't in the table. Must be done before the
+/// animation is modified or freed.
+void animation_table_remove(struct animation_table *, struct animation_state *);
+
+/// Take `nsteps` integration steps for all animations in the table, and update
+/// their progress, which never goes down. The animations whose rounded geometry
+/// changed, or that reached their destination, are copied back and marked updated.
+/// Finished animations have their velocity reset, and are taken out of the table.
+void animation_table_step(struct animation_table *, const struct animation_spring *,
+                          unsigned nsteps);
@@ -1,3 +1,4 @@
+#include <stdio.h>
 #include <string.h>
 #include <xcb/xcb.h>
 
@@ -6,8 +7,31 @@
 #include "log.h"
 #include "utils.h"
 
+/// Longest key of an atom in the name cache, an atom in decimal
+#define ATOM_KEY_LEN 11
+
+static inline void atom_key(xcb_atom_t atom, char key[ATOM_KEY_LEN]) {
+	snprintf(key, ATOM_KEY_LEN, "%u", atom);
+}
+
+/**
+ * Remember that `name` is the name of `atom`, in whichever direction it's not
+ * known yet.
+ */
+static void atom_cache_add(struct atom *a, const char *name, xcb_atom_t atom) {
+	char key[ATOM_KEY_LEN];
+	atom_key(atom, key);
+	if (!cache_peek(a->c, name)) {
+		cache_set(a->c, name, (void *)(intptr_t)atom);
+	}
+	if (!cache_peek(a->names, key)) {
+		cache_set(a->names, key, strdup(name));
+	}
+}
+
 static inline void *atom_getter(void *ud, const char *atom_name, int *err) {
-	xcb_connection_t *c = ud;
+	struct atom *a = ud;
+	xcb_connection_t *c = a->conn;
 	xcb_intern_atom_reply_t *reply = xcb_intern_atom_reply(
 	    c, xcb_intern_atom(c, 0, to_u16_checked(strlen(atom_name)), atom_name), NULL);
 
@@ -16,6 +40,12 @@ static inline void *atom_getter(void *ud, const char *atom_name, int *err) {
 		log_debug("Atom %s is %d", atom_name, reply->atom);
 		atom = reply->atom;
 		free(reply);
+
+		char key[ATOM_KEY_LEN];
+		atom_key(atom, key);
+		if (!cache_peek(a->names, key)) {
+			cache_set(a->names, key, strdup(atom_name));
+		}
 	} else {
 		log_error("Failed to intern atoms");
 		*err = 1;
@@ -23,12 +53,112 @@ static inline void *atom_getter(void *ud, const char *atom_name, int *err) {
 	return (void *)(intptr_t)atom;
 }
 
+/**
+ * Copy the name out of a GetAtomName reply.
+ */
+static inline char *atom_name_from_reply(const xcb_get_atom_name_reply_t *reply) {
+	return strndup(xcb_get_atom_name_name(reply),
+	               (size_t)xcb_get_atom_name_name_length(reply));
+}
+
+static inline void *atom_name_getter(void *ud, const char *key, int *err) {
+	struct atom *a = ud;
+	auto atom = (xcb_atom_t)strtoul(key, NULL, 10);
+	xcb_get_atom_name_reply_t *reply =
+	    xcb_get_atom_name_reply(a->conn, xcb_get_atom_name(a->conn, atom), NULL);
+	if (!reply) {
+		log_debug("Atom %u doesn't exist", atom);
+		*err = 1;
+		return NULL;
+	}
+
+	char *name = atom_name_from_reply(reply);
+	free(reply);
+	if (!cache_peek(a->c, name)) {
+		cache_set(a->c, name, (void *)(intptr_t)atom);
+	}
+	return name;
+}
+
+static inline void atom_name_free(void *ud attr_unused, void *name) {
+	free(name);
+}
+
+const char *get_atom_name(struct atom *a, xcb_atom_t atom) {
+	char key[ATOM_KEY_LEN];
+	atom_key(atom, key);
+	return cache_get(a->names, key, NULL);
+}
+
+const char *peek_atom_name(struct atom *a, xcb_atom_t atom) {
+	char key[ATOM_KEY_LEN];
+	atom_key(atom, key);
+	return cache_peek(a->names, key);
+}
+
+void prefetch_atom_names(struct atom *a, const xcb_atom_t *atoms, size_t n) {
+	auto pending = ccalloc(n ?: 1, xcb_atom_t);
+	auto cookies = ccalloc(n ?: 1, xcb_get_atom_name_cookie_t);
+	size_t npending = 0;
+	for (size_t i = 0; i < n; i++) {
+		char key[ATOM_KEY_LEN];
+		atom_key(atoms[i], key);
+		if (atoms[i] == XCB_NONE || cache_peek(a->names, key)) {
+			continue;
+		}
+		bool requested = false;
+		for (size_t j = 0; j < npending && !requested; j++) {
+			requested = pending[j] == atoms[i];
+		}
+		if (!requested) {
+			pending[npending] = atoms[i];
+			cookies[npending++] = xcb_get_atom_name(a->conn, atoms[i]);
+		}
+	}
+
+	for (size_t i = 0; i < npending; i++) {
+		xcb_get_atom_name_reply_t *reply =
+		    xcb_get_atom_name_reply(a->conn, cookies[i], NULL);
+		if (reply) {
+			char *name = atom_name_from_reply(reply);
+			atom_cache_add(a, name, pending[i]);
+			free(name);
+			free(reply);
+		}
+	}
+	free(pending);
+	free(cookies);
+}
+
 /**
  * Create a new atom structure and fetch all predefined atoms
  */
 struct atom *init_atoms(xcb_connection_t *c) {
 	auto atoms = ccalloc(1, struct atom);
-	atoms->c = new_cache((void *)c, atom_getter, NULL);
+	atoms->conn = c;
+	atoms->c = new_cache(atoms, atom_getter, NULL);
+	atoms->names = new_cache(atoms, atom_name_getter, atom_name_free);
+
+	// Intern the predefined atoms with a single round trip
+#define ATOM_NAME(x) #x
+	static const char *const names[] = {
+	    LIST_APPLY(ATOM_NAME, SEP_COMMA, ATOM_LIST1),
+	    LIST_APPLY(ATOM_NAME, SEP_COMMA, ATOM_LIST2),
+	};
+#undef ATOM_NAME
+	xcb_intern_atom_cookie_t cookies[ARR_SIZE(names)];
+	for (size_t i = 0; i < ARR_SIZE(names); i++) {
+		cookies[i] = xcb_intern_atom(c, 0, to_u16_checked(strlen(names[i])), names[i]);
+	}
+	for (size_t i = 0; i < ARR_SIZE(names); i++) {
+		xcb_intern_atom_reply_t *reply = xcb_intern_atom_reply(c, cookies[i], NULL);
+		if (reply) {
+			atom_cache_add(atoms, names[i], reply->atom);
+			free(reply);
+		}
+	}
+
+	// Atoms that failed to be interned above are tried again one by one
 #define ATOM_GET(x) atoms->a##x = (xcb_atom_t)(intptr_t)cache_get(atoms->c, #x, NULL)
 	LIST_APPLY(ATOM_GET, SEP_COLON, ATOM_LIST1);
 	LIST_APPLY(ATOM_GET, SEP_COLON, ATOM_LIST2);
@@ -66,8 +66,14 @@
 
 #define ATOM_DEF(x) xcb_atom_t a##x
 
+/// Atoms by name, and names by atom. Atoms and their names never change while the X
+/// server runs, so each of them is only asked for once, and whatever is learned in
+/// one direction is remembered in the other one too.
 struct atom {
+	xcb_connection_t *conn;
 	struct cache *c;
+	/// Names of atoms, keyed by the atom in decimal
+	struct cache *names;
 	LIST_APPLY(ATOM_DEF, SEP_COLON, ATOM_LIST1);
 	LIST_APPLY(ATOM_DEF, SEP_COLON, ATOM_LIST2);
 };
@@ -78,7 +84,20 @@ static inline xcb_atom_t get_atom(struct atom *a, const char *key) {
 	return (xcb_atom_t)(intptr_t)cache_get(a->c, key, NULL);
 }
 
+/// Get the name of an atom, asking the X server if it's not known yet. Returns NULL
+/// if the atom doesn't exist. The name stays valid until the atoms are destroyed.
+const char *get_atom_name(struct atom *a, xcb_atom_t atom);
+
+/// Get the name of an atom if it's known already, without a round trip. Returns NULL
+/// otherwise.
+const char *peek_atom_name(struct atom *a, xcb_atom_t atom);
+
+/// Ask the X server for the names of all of `atoms` that are not known yet, with a
+/// single round trip. Atoms that are XCB_NONE are skipped.
+void prefetch_atom_names(struct atom *a, const xcb_atom_t *atoms, size_t n);
+
 static inline void destroy_atoms(struct atom *a) {
 	cache_free(a->c);
+	cache_free(a->names);
 	free(a);
 }
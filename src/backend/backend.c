@@ -12,6 +12,7 @@
 #include "types.h"
 #include "win.h"
 #include "x.h"
+#include "renderer/damage.h"
 #include "renderer/layout.h"
 
 extern struct backend_operations xrender_ops, dummy_ops;
@@ -51,6 +52,11 @@ region_t get_damage(session_t *ps, bool all_damage) {
 			dump_region(&ps->damage_ring[curr]);
 			pixman_region32_union(&region, &region, &ps->damage_ring[curr]);
 		}
+		// Window content, geometry and opacity changes are not in the damage
+		// ring, they are derived from the layouts.
+		if (!layout_manager_damage(ps->layout_manager, (unsigned)buffer_age, &region)) {
+			pixman_region32_copy(&region, &ps->screen_reg);
+		}
 		pixman_region32_intersect(&region, &region, &ps->screen_reg);
 	}
 	return region;
@@ -81,14 +87,84 @@ void handle_device_reset(session_t *ps) {
 	ev_break(ps->loop, EVBREAK_ALL);
 }
 
+/// Whether the background of `w` will be blurred when it's painted
+static bool win_blurs_background(session_t *ps, const struct managed_win *w) {
+	return (w->blur_background || w->blur_context) &&
+	       (ps->o.force_win_blend || w->mode == WMODE_TRANS ||
+	        (ps->o.blur_background_frame && w->mode == WMODE_FRAME_TRANS));
+}
+
+/// Get the blur size of the layer, returns false if the layer doesn't blur its
+/// background.
+static bool
+layer_blur_size(session_t *ps, const struct layer *layer, int *width, int *height) {
+	if (!win_blurs_background(ps, layer->win)) {
+		return false;
+	}
+	void *blur_context = layer->win->blur_context ?: ps->backend_blur_context;
+	if (!blur_context) {
+		return false;
+	}
+	ps->backend_data->ops->get_blur_size(blur_context, width, height);
+	return true;
+}
+
+/// Expand `reg_damage` and `reg_paint` by blur, according to the layers in the current
+/// layout that blur their background.
+///
+/// A blurring layer turns damage up to a blur size around it into damage on the layer,
+/// up to a blur size further out. Going up the stack, damage spread by a lower layer can
+/// be spread again by a higher one. Then, each blurring layer reads the screen up to
+/// a blur size around its part of the damage, so all of that has to be painted, and
+/// going down the stack, painting more of a lower blurring layer needs even more to
+/// be painted.
+static void expand_damage_for_blur(session_t *ps, region_t *reg_damage, region_t *reg_paint) {
+	auto layout = layout_manager_layout(ps->layout_manager, 0);
+	region_t tmp;
+	pixman_region32_init(&tmp);
+	for (unsigned i = 0; i < layout->len; i++) {
+		auto layer = &layout->layers[i];
+		int blur_width, blur_height;
+		if (!layer_blur_size(ps, layer, &blur_width, &blur_height)) {
+			continue;
+		}
+		// Damage outside of the layer still changes the blur of the layer within
+		// a blur size of it
+		pixman_region32_copy(&tmp, reg_damage);
+		resize_region_in_place(&tmp, blur_width, blur_height);
+		pixman_region32_intersect_rect(&tmp, &tmp, layer->origin.x, layer->origin.y,
+		                               (unsigned)layer->size.width,
+		                               (unsigned)layer->size.height);
+		pixman_region32_union(reg_damage, reg_damage, &tmp);
+	}
+
+	pixman_region32_copy(reg_paint, reg_damage);
+	for (unsigned i = layout->len; i-- > 0;) {
+		auto layer = &layout->layers[i];
+		int blur_width, blur_height;
+		if (!layer_blur_size(ps, layer, &blur_width, &blur_height)) {
+			continue;
+		}
+		// Only the part of the layer being painted reads the screen, and it reads
+		// up to a blur size out of the layer
+		pixman_region32_intersect_rect(&tmp, reg_paint, layer->origin.x,
+		                               layer->origin.y, (unsigned)layer->size.width,
+		                               (unsigned)layer->size.height);
+		if (!pixman_region32_not_empty(&tmp)) {
+			continue;
+		}
+		resize_region_in_place(&tmp, blur_width, blur_height);
+		pixman_region32_union(reg_paint, reg_paint, &tmp);
+	}
+	pixman_region32_fini(&tmp);
+}
+
 static void 
-try_blur_target(session_t *ps, struct managed_win *w, coord_t window_coord,
-				region_t *reg_paint, region_t *reg_paint_in_bound, 
+try_blur_target(session_t *ps, struct managed_win *w, const struct layer *layer,
+				coord_t window_coord, region_t *reg_paint, region_t *reg_paint_in_bound, 
 				region_t *reg_visible) {
 	auto real_win_mode = w->mode;
-	if ((w->blur_background || w->blur_context) 
-	&& (ps->o.force_win_blend || real_win_mode == WMODE_TRANS 
-	|| (ps->o.blur_background_frame && real_win_mode == WMODE_FRAME_TRANS))) {
+	if (win_blurs_background(ps, w)) {
 		// Minimize the region we try to blur, if the window
 		// itself is not opaque, only the frame is.
 		double blur_opacity = 1;
@@ -124,13 +200,15 @@ try_blur_target(session_t *ps, struct managed_win *w, coord_t window_coord,
 		assert(blur_opacity >= 0 && blur_opacity <= 1);
 		
 		void *blur_context = w->blur_context ? w->blur_context : ps->backend_blur_context;
+		// The mask keeps the size of the X window, it doesn't fit a scaled layer
+		void *mask = layer->scaled ? NULL : w->mask_image;
 		
 		if (real_win_mode == WMODE_TRANS || ps->o.force_win_blend) 
 		{
 			// We need to blur the bounding shape of the window
 			// (reg_paint_in_bound = reg_bound \cap reg_paint)
 			ps->backend_data->ops->blur(ps->backend_data, blur_opacity,
-			    						blur_context, w->mask_image, window_coord,
+			    						blur_context, mask, window_coord,
 			    						reg_paint_in_bound, reg_visible);
 		} 
 		else 
@@ -151,7 +229,7 @@ try_blur_target(session_t *ps, struct managed_win *w, coord_t window_coord,
 			}
 
 			ps->backend_data->ops->blur(ps->backend_data, blur_opacity, blur_context,
-			    						w->mask_image, window_coord, &reg_blur, reg_visible);
+			    						mask, window_coord, &reg_blur, reg_visible);
 
 			pixman_region32_fini(&reg_blur);
 		}
@@ -159,8 +237,8 @@ try_blur_target(session_t *ps, struct managed_win *w, coord_t window_coord,
 }
 
 static void 
-try_shadow_target(session_t *ps, struct managed_win *w, coord_t window_coord, 
-				 region_t *reg_paint, region_t *reg_visible, region_t *reg_shadow_clip, 
+try_shadow_target(session_t *ps, struct managed_win *w, const struct layer *layer,
+				 coord_t window_coord, region_t *reg_paint, region_t *reg_visible, region_t *reg_shadow_clip, 
 				 region_t *reg_bound_no_corner) {
 	// Draw shadow on target
 	if (w->shadow) 
@@ -205,7 +283,7 @@ try_shadow_target(session_t *ps, struct managed_win *w, coord_t window_coord,
 		if (!ps->o.wintype_option[w->window_type].full_shadow) 
 		{
 			pixman_region32_subtract(&reg_shadow, &reg_shadow, reg_bound_no_corner);
-			if (w->mask_image) 
+			if (w->mask_image && !layer->scaled) 
 			{
 				inverted_mask = w->mask_image;
 				ps->backend_data->ops->set_image_property(ps->backend_data, IMAGE_PROPERTY_INVERTED,
@@ -214,7 +292,8 @@ try_shadow_target(session_t *ps, struct managed_win *w, coord_t window_coord,
 		}
 
 		ps->backend_data->ops->compose(ps->backend_data, w->shadow_image, shadow_coord, inverted_mask, 
-									   window_coord, &reg_shadow, reg_visible, false);
+									   window_coord, &reg_shadow, reg_visible,
+									   layer->scaled ? &layer->shadow_size : NULL);
 
 		if (inverted_mask) 
 		{
@@ -273,12 +352,13 @@ update_img_props(session_t *ps, struct managed_win *w)
 }
 
 static void 
-draw_win_to_back_buffer(session_t *ps, struct managed_win *w, coord_t window_coord, coord_t dest_coord,
-						region_t *reg_paint, region_t *reg_visible, region_t *reg_paint_in_bound, region_t *reg_bound) {
-	bool is_animating = 0 < w->animation_progress && w->animation_progress < 1.0;
-	if (w->frame_opacity == 1 && !is_animating) {
+draw_win_to_back_buffer(session_t *ps, struct managed_win *w, const struct layer *layer,
+						coord_t window_coord, region_t *reg_paint, region_t *reg_visible,
+						region_t *reg_paint_in_bound, region_t *reg_bound) {
+	auto dst_size = layer->scaled ? &layer->size : NULL;
+	if (w->frame_opacity == 1) {
 		ps->backend_data->ops->compose(ps->backend_data, w->win_image, window_coord, NULL,
-		    						   dest_coord, reg_paint_in_bound, reg_visible, true);
+		    						   window_coord, reg_paint_in_bound, reg_visible, dst_size);
 	} 
 	else 
 	{
@@ -314,7 +394,7 @@ draw_win_to_back_buffer(session_t *ps, struct managed_win *w, coord_t window_coo
 		pixman_region32_fini(&reg_frame);
 
 		ps->backend_data->ops->compose(ps->backend_data, w->win_image, window_coord, NULL,
-		    						   dest_coord, reg_paint_in_bound, reg_visible, true);
+		    						   window_coord, reg_paint_in_bound, reg_visible, dst_size);
 
 		ps->backend_data->ops->release_image(ps->backend_data, new_img);
 		pixman_region32_fini(&reg_visible_local);
@@ -381,31 +461,14 @@ void paint_all_new(session_t *ps, bool ignore_damage)
 	/// The adjusted damaged regions
 	region_t reg_paint;
 	assert(ps->o.blur_method != BLUR_METHOD_INVALID);
-	if (ps->o.blur_method != BLUR_METHOD_NONE && ps->backend_data->ops->get_blur_size) 
+	if (ps->backend_data->ops->get_blur_size) 
 	{
-		int blur_width, blur_height;
-		ps->backend_data->ops->get_blur_size(ps->backend_blur_context, &blur_width, &blur_height);
-
 		// The region of screen a given window influences will be smeared
-		// out by blur. With more windows on top of the given window, the
-		// influences region will be smeared out more.
-		//
-		// Also, blurring requires data slightly outside the area that needs
-		// to be blurred. The more semi-transparent windows are stacked on top
-		// of each other, the larger the area will be.
-		//
-		// Instead of accurately calculate how much bigger the damage
-		// region will be because of blur, we assume the worst case here.
-		// That is, the damaged window is at the bottom of the stack, and
-		// all other windows have semi-transparent background
-		int resize_factor = 1;
-		if (bottom) {
-			resize_factor = bottom->stacking_rank;
-		}
-		resize_region_in_place(&reg_damage, blur_width * resize_factor,
-		                       blur_height * resize_factor);
-		reg_paint = resize_region(&reg_damage, blur_width * resize_factor,
-		                          blur_height * resize_factor);
+		// out by blur, and blurring requires data slightly outside the area
+		// that needs to be blurred. Only the layers that actually blur their
+		// background contribute to that, see expand_damage_for_blur.
+		pixman_region32_init(&reg_paint);
+		expand_damage_for_blur(ps, &reg_damage, &reg_paint);
 		pixman_region32_intersect(&reg_paint, &reg_paint, &ps->screen_reg);
 		pixman_region32_intersect(&reg_damage, &reg_damage, &ps->screen_reg);
 	} 
@@ -433,6 +496,9 @@ void paint_all_new(session_t *ps, bool ignore_damage)
 	region_t reg_shadow_clip;
 	pixman_region32_init(&reg_shadow_clip);
 
+	// Time spent on each stage, summed over all windows
+	uint64_t blur_us = 0, shadow_us = 0, compose_us = 0;
+
 	now = get_time_timespec();
 	auto after_damage_us = (uint64_t)now.tv_sec * 1000000UL + (uint64_t)now.tv_nsec / 1000;
 	log_trace("Getting damage took %" PRIu64 " us", after_damage_us - after_sync_fence_us);
@@ -444,8 +510,8 @@ void paint_all_new(session_t *ps, bool ignore_damage)
 	// Either draw the root image in back_buffer or just fill it with color
 	if (ps->root_image) {
 		ps->backend_data->ops->compose(ps->backend_data, ps->root_image, (coord_t){0}, NULL,
-		    						  (coord_t){.x = ps->root_width, .y = ps->root_height}, 
-									  &reg_paint, &reg_visible, true);
+		    						  (coord_t){0}, &reg_paint, &reg_visible,
+		    						  &(geometry_t){.width = ps->root_width, .height = ps->root_height});
 	} else {
 		ps->backend_data->ops->fill(ps->backend_data, (struct color){0, 0, 0, 1}, &reg_paint);
 	}
@@ -461,9 +527,9 @@ void paint_all_new(session_t *ps, bool ignore_damage)
 	}
 	for(unsigned int i = 0; i < layout_manager_layout(ps->layout_manager, 0)->len; i++)
 	{
-		auto curr_layer = layout_manager_layout(ps->layout_manager, 0)->layers[i];
-		struct managed_win *w = curr_layer.win;
-		if(!curr_layer.to_paint) { continue; }
+		auto curr_layer = &layout_manager_layout(ps->layout_manager, 0)->layers[i];
+		struct managed_win *w = curr_layer->win;
+		if(!curr_layer->to_paint) { continue; }
 
 		pixman_region32_subtract(&reg_visible, &ps->screen_reg, w->reg_ignore);
 		assert(!(w->flags & WIN_FLAGS_IMAGE_ERROR));
@@ -477,8 +543,6 @@ void paint_all_new(session_t *ps, bool ignore_damage)
 
 		if (!w->mask_image && (w->bounding_shaped || w->corner_radius != 0)) 
 		{
-			if(!w->widthb)  { ++w->widthb;  };
-			if(!w->heightb) { ++w->heightb; };
 			win_bind_mask(ps->backend_data, w);
 		}
 
@@ -499,17 +563,21 @@ void paint_all_new(session_t *ps, bool ignore_damage)
 		}
 
 		coord_t window_coord = {.x = w->g.x, .y = w->g.y};
-		coord_t dest_coord   = {.x = w->g.x + w->widthb, .y = w->g.y + w->heightb};
 
 		// Blur window background
-		try_blur_target(ps, w, window_coord, 
+		auto stage_start_us = frame_stats_now_us();
+		try_blur_target(ps, w, curr_layer, window_coord, 
 					   &reg_paint, &reg_paint_in_bound, 
 					   &reg_visible);
 
 		// Put shadow on window
-		try_shadow_target(ps, w, window_coord, 
+		auto stage_end_us = frame_stats_now_us();
+		blur_us += stage_end_us - stage_start_us;
+		stage_start_us = stage_end_us;
+		try_shadow_target(ps, w, curr_layer, window_coord, 
 						 &reg_paint, &reg_visible, 
 						 &reg_shadow_clip, &reg_bound_no_corner);
+		shadow_us += frame_stats_now_us() - stage_start_us;
 
 		// Update image properties
 		update_img_props(ps, w);
@@ -528,9 +596,11 @@ void paint_all_new(session_t *ps, bool ignore_damage)
 		}
 
 		// Draw window on target
-		draw_win_to_back_buffer(ps, w, window_coord, dest_coord, 
+		stage_start_us = frame_stats_now_us();
+		draw_win_to_back_buffer(ps, w, curr_layer, window_coord, 
 							   &reg_paint, &reg_visible, &reg_paint_in_bound, 
 							   &reg_bound);
+		compose_us += frame_stats_now_us() - stage_start_us;
 
 	skip:
 		pixman_region32_fini(&reg_bound);
@@ -541,6 +611,10 @@ void paint_all_new(session_t *ps, bool ignore_damage)
 	pixman_region32_fini(&reg_paint);
 	pixman_region32_fini(&reg_shadow_clip);
 
+	frame_stats_record(&ps->frame_stats, FRAME_STAGE_BLUR, blur_us);
+	frame_stats_record(&ps->frame_stats, FRAME_STAGE_SHADOW, shadow_us);
+	frame_stats_record(&ps->frame_stats, FRAME_STAGE_COMPOSE, compose_us);
+
 	if (ps->o.monitor_repaint) {
 		const struct color DEBUG_COLOR = {0.5, 0, 0, 0.5};
 		auto reg_damage_debug = get_damage(ps, false);
@@ -549,6 +623,7 @@ void paint_all_new(session_t *ps, bool ignore_damage)
 	}
 
 	// Move the head of the damage ring
+	layout_manager_layout(ps->layout_manager, 0)->presented = true;
 	ps->damage = ps->damage - 1;
 	if (ps->damage < ps->damage_ring) {
 		ps->damage = ps->damage_ring + ps->ndamage - 1;
@@ -558,7 +633,9 @@ void paint_all_new(session_t *ps, bool ignore_damage)
 	if (ps->backend_data->ops->present) {
 		// Present the rendered scene
 		// Vsync is done here
+		auto present_start_us = frame_stats_now_us();
 		ps->backend_data->ops->present(ps->backend_data, &reg_damage);
+		frame_stats_record_since(&ps->frame_stats, FRAME_STAGE_PRESENT, present_start_us);
 	}
 
 	pixman_region32_fini(&reg_damage);
@@ -30,8 +30,15 @@ typedef struct backend_base {
 	xcb_window_t root;
 	struct ev_loop *loop;
 
-	/// Whether the backend can accept new render request at the moment
+	/// Whether the backend can accept new render request at the moment. The core
+	/// doesn't paint while it's set, and checks it again after `handle_events`.
 	bool busy;
+
+	/// Number of operations performed on a region, and the total number of
+	/// rectangles in those regions. Only counted by the dummy backend, for the
+	/// benchmark mode.
+	uint64_t region_ops;
+	uint64_t region_rects;
 	// ...
 } backend_t;
 
@@ -240,10 +247,12 @@ struct backend_operations {
 	 *                     the top left of the image
 	 * @param reg_paint    the clip region, in target coordinates
 	 * @param reg_visible  the visible region, in target coordinates
+	 * @param dst_size     size the image is stretched to in the target, NULL to
+	 *                     paint it at its own size. The mask is never stretched.
 	 */
 	void (*compose)(backend_t *backend_data, void *image_data, coord_t image_dst,
 	                void *mask, coord_t mask_dst, const region_t *reg_paint,
-	                const region_t *reg_visible, bool lerp);
+	                const region_t *reg_visible, const geometry_t *dst_size);
 
 	/// Fill rectangle of the rendering buffer, mostly for debug purposes, optional.
 	void (*fill)(backend_t *backend_data, struct color, const region_t *clip);
@@ -411,8 +420,11 @@ struct backend_operations {
 	/// Let the backend hook into the event handling queue
 	/// Not implemented yet
 	void (*set_ready_callback)(backend_t *, backend_ready_callback_t cb);
-	/// Called right after the core has handled its events.
-	/// Not implemented yet
+	/// Called right after the core has handled its events, before it goes to
+	/// sleep. Backends use this to process their own events, e.g. completion of
+	/// a frame in flight.
+	///
+	/// Optional
 	void (*handle_events)(backend_t *);
 	// ===========         Misc         ============
 	/// Return the driver that is been used by the backend
@@ -57,8 +57,10 @@ xcb_render_picture_t solid_picture(xcb_connection_t *c, xcb_drawable_t d, bool a
 	return picture;
 }
 
-xcb_image_t *
-make_shadow(xcb_connection_t *c, const conv *kernel, double opacity, int width, int height) {
+/// Fill `data` with the shadow of a `width` x `height` window body, `sstride` bytes
+/// per row.
+static void make_shadow_fill(unsigned char *data, long long sstride, const conv *kernel,
+                             double opacity, int width, int height) {
 	/*
 	 * We classify shadows into 4 kinds of regions
 	 *    r = shadow radius
@@ -72,7 +74,6 @@ make_shadow(xcb_connection_t *c, const conv *kernel, double opacity, int width,
 	 *          |  1  |    2    |  1  |
 	 * height+r +-----+---------+-----+
 	 */
-	xcb_image_t *ximage;
 	const double *shadow_sum = kernel->rsum;
 	assert(shadow_sum);
 	// We only support square kernels for shadow
@@ -84,16 +85,6 @@ make_shadow(xcb_connection_t *c, const conv *kernel, double opacity, int width,
 	assert(d % 2 == 1);
 	assert(d > 0);
 
-	ximage = xcb_image_create_native(c, to_u16_checked(swidth), to_u16_checked(sheight),
-	                                 XCB_IMAGE_FORMAT_Z_PIXMAP, 8, 0, 0, NULL);
-	if (!ximage) {
-		log_error("failed to create an X image");
-		return 0;
-	}
-
-	unsigned char *data = ximage->data;
-	long long sstride = ximage->stride;
-
 	// If the window body is smaller than the kernel, we do convolution directly
 	if (width < r * 2 && height < r * 2) {
 		for (int y = 0; y < sheight; y++) {
@@ -103,7 +94,7 @@ make_shadow(xcb_connection_t *c, const conv *kernel, double opacity, int width,
 				data[y * sstride + x] = (uint8_t)(sum * 255.0 * opacity);
 			}
 		}
-		return ximage;
+		return;
 	}
 
 	if (height < r * 2) {
@@ -129,7 +120,7 @@ make_shadow(xcb_connection_t *c, const conv *kernel, double opacity, int width,
 			memset(&data[y * sstride + r * 2], (uint8_t)sum,
 			       (size_t)(width - 2 * r));
 		}
-		return ximage;
+		return;
 	}
 	if (width < r * 2) {
 		// Similarly, for width smaller than kernel
@@ -149,44 +140,59 @@ make_shadow(xcb_connection_t *c, const conv *kernel, double opacity, int width,
 				data[y * sstride + x] = (uint8_t)sum;
 			}
 		}
-		return ximage;
+		return;
 	}
 
 	// Implies: width >= r * 2 && height >= r * 2
+	//
+	// Every row is written once, front to back, so all the filling is done by
+	// memset/memcpy instead of byte by byte, and columns are never walked.
 
-	// Fill part 3
-	for (int y = r; y < height + r; y++) {
-		memset(data + sstride * y + r, (uint8_t)(255 * opacity), (size_t)width);
-	}
-
-	// Part 1
+	// Part 1 and part 2 top/bottom. Each row is mirrored to the bottom.
 	for (int y = 0; y < r * 2; y++) {
+		uint8_t *row = data + y * sstride;
 		for (int x = 0; x < r * 2; x++) {
 			double tmpsum = shadow_sum[y * d + x] * opacity * 255.0;
-			data[y * sstride + x] = (uint8_t)tmpsum;
-			data[(sheight - y - 1) * sstride + x] = (uint8_t)tmpsum;
-			data[(sheight - y - 1) * sstride + (swidth - x - 1)] = (uint8_t)tmpsum;
-			data[y * sstride + (swidth - x - 1)] = (uint8_t)tmpsum;
+			row[x] = (uint8_t)tmpsum;
+			row[swidth - x - 1] = (uint8_t)tmpsum;
 		}
+		double tmpsum = shadow_sum[d * y + d - 1] * opacity * 255.0;
+		memset(&row[r * 2], (uint8_t)tmpsum, (size_t)(width - r * 2));
+		memcpy(data + (sheight - y - 1) * sstride, row, (size_t)swidth);
 	}
 
-	// Part 2, top/bottom
-	for (int y = 0; y < r * 2; y++) {
-		double tmpsum = shadow_sum[d * y + d - 1] * opacity * 255.0;
-		memset(&data[y * sstride + r * 2], (uint8_t)tmpsum, (size_t)(width - r * 2));
-		memset(&data[(sheight - y - 1) * sstride + r * 2], (uint8_t)tmpsum,
-		       (size_t)(width - r * 2));
+	if (height == r * 2) {
+		return;
 	}
 
-	// Part 2, left/right
+	// Part 2 left/right and part 3. These rows are all the same, so build the
+	// first one and copy it to the rest.
+	uint8_t *first_row = data + r * 2 * sstride;
 	for (int x = 0; x < r * 2; x++) {
 		double tmpsum = shadow_sum[d * (d - 1) + x] * opacity * 255.0;
-		for (int y = r * 2; y < height; y++) {
-			data[y * sstride + x] = (uint8_t)tmpsum;
-			data[y * sstride + (swidth - x - 1)] = (uint8_t)tmpsum;
-		}
+		first_row[x] = (uint8_t)tmpsum;
+		first_row[swidth - x - 1] = (uint8_t)tmpsum;
+	}
+	memset(&first_row[r * 2], (uint8_t)(255 * opacity), (size_t)(width - r * 2));
+	for (int y = r * 2 + 1; y < height; y++) {
+		memcpy(data + y * sstride, first_row, (size_t)swidth);
 	}
+}
 
+xcb_image_t *
+make_shadow(xcb_connection_t *c, const conv *kernel, double opacity, int width, int height) {
+	xcb_image_t *ximage;
+	int r = kernel->w / 2;
+	int swidth = width + r * 2, sheight = height + r * 2;
+
+	ximage = xcb_image_create_native(c, to_u16_checked(swidth), to_u16_checked(sheight),
+	                                 XCB_IMAGE_FORMAT_Z_PIXMAP, 8, 0, 0, NULL);
+	if (!ximage) {
+		log_error("failed to create an X image");
+		return 0;
+	}
+
+	make_shadow_fill(ximage->data, ximage->stride, kernel, opacity, width, height);
 	return ximage;
 }
 
@@ -291,28 +297,211 @@ shadow_picture_err:
 	return false;
 }
 
+/// Shadow of a fixed kernel and color, pre-rendered once and cut into nine slices.
+/// Every shadow whose body is at least as large as the kernel is made of the same
+/// four corners, four edge strips that are constant along their length, and a
+/// solid center, so it can be assembled on the X server at any size without
+/// running `make_shadow` and uploading the image again.
+struct shadow_slices {
+	struct color color;
+	/// Shadow of a (2r+1)x(2r+1) body, the four corners are taken from here
+	xcb_render_picture_t corners;
+	/// Repeating strips of the top, bottom, left and right edges
+	xcb_render_picture_t edges[4];
+	/// Repeating 1x1 picture of the shadow body
+	xcb_render_picture_t center;
+	struct shadow_slices *next;
+};
+
+/// The shadow context used by the default shadow implementation
+struct default_shadow_context {
+	conv *kernel;
+	/// Nine-slice shadows rendered with this kernel, one for each color seen
+	struct shadow_slices *slices;
+};
+
+enum { SHADOW_EDGE_TOP, SHADOW_EDGE_BOTTOM, SHADOW_EDGE_LEFT, SHADOW_EDGE_RIGHT };
+
+static void shadow_slices_free(xcb_connection_t *c, struct shadow_slices *s) {
+	if (s->corners) {
+		xcb_render_free_picture(c, s->corners);
+	}
+	for (int i = 0; i < 4; i++) {
+		if (s->edges[i]) {
+			xcb_render_free_picture(c, s->edges[i]);
+		}
+	}
+	if (s->center) {
+		xcb_render_free_picture(c, s->center);
+	}
+	free(s);
+}
+
+static inline bool color_eq(struct color a, struct color b) {
+	return a.red == b.red && a.green == b.green && a.blue == b.blue &&
+	       a.alpha == b.alpha;
+}
+
+/// Find the nine-slice shadow for `color`, render it if it doesn't exist yet.
+static struct shadow_slices *
+shadow_slices_get(backend_t *base, struct default_shadow_context *sctx, struct color color) {
+	for (auto s = sctx->slices; s; s = s->next) {
+		if (color_eq(s->color, color)) {
+			return s;
+		}
+	}
+
+	const int r = sctx->kernel->w / 2;
+	assert(r > 0);
+	xcb_render_picture_t shadow_pixel =
+	    solid_picture(base->c, base->root, true, 1, color.red, color.green, color.blue);
+	xcb_pixmap_t pixmap = XCB_NONE;
+	auto s = ccalloc(1, struct shadow_slices);
+	s->color = color;
+	bool success = build_shadow(base->c, base->root, color.alpha, r * 2 + 1,
+	                            r * 2 + 1, sctx->kernel, shadow_pixel, &pixmap, &s->corners);
+	xcb_render_free_picture(base->c, shadow_pixel);
+	if (!success) {
+		free(s);
+		return NULL;
+	}
+	// The picture keeps the pixmap alive
+	xcb_free_pixmap(base->c, pixmap);
+
+	// Position and size of each slice inside the (4r+1)x(4r+1) shadow
+	const struct {
+		int16_t x, y;
+		int w, h;
+	} slice_geometry[] = {
+	    [SHADOW_EDGE_TOP] = {to_i16_checked(r * 2), 0, 1, r * 2},
+	    [SHADOW_EDGE_BOTTOM] = {to_i16_checked(r * 2), to_i16_checked(r * 2 + 1), 1, r * 2},
+	    [SHADOW_EDGE_LEFT] = {0, to_i16_checked(r * 2), r * 2, 1},
+	    [SHADOW_EDGE_RIGHT] = {to_i16_checked(r * 2 + 1), to_i16_checked(r * 2), r * 2, 1},
+	};
+	const xcb_render_create_picture_value_list_t pa = {.repeat = 1};
+	for (int i = 0; i < 4; i++) {
+		s->edges[i] = x_create_picture_with_standard(
+		    base->c, base->root, slice_geometry[i].w, slice_geometry[i].h,
+		    XCB_PICT_STANDARD_ARGB_32, XCB_RENDER_CP_REPEAT, &pa);
+		if (!s->edges[i]) {
+			goto err;
+		}
+		xcb_render_composite(base->c, XCB_RENDER_PICT_OP_SRC, s->corners, XCB_NONE,
+		                     s->edges[i], slice_geometry[i].x, slice_geometry[i].y,
+		                     0, 0, 0, 0, to_u16_checked(slice_geometry[i].w),
+		                     to_u16_checked(slice_geometry[i].h));
+	}
+	s->center = x_create_picture_with_standard(base->c, base->root, 1, 1,
+	                                           XCB_PICT_STANDARD_ARGB_32,
+	                                           XCB_RENDER_CP_REPEAT, &pa);
+	if (!s->center) {
+		goto err;
+	}
+	xcb_render_composite(base->c, XCB_RENDER_PICT_OP_SRC, s->corners, XCB_NONE,
+	                     s->center, to_i16_checked(r * 2), to_i16_checked(r * 2), 0,
+	                     0, 0, 0, 1, 1);
+
+	log_debug("Rendered nine-slice shadow for radius %d, color %f %f %f %f", r,
+	          color.red, color.green, color.blue, color.alpha);
+	s->next = sctx->slices;
+	sctx->slices = s;
+	return s;
+
+err:
+	log_error("Failed to create nine-slice shadow pictures");
+	shadow_slices_free(base->c, s);
+	return NULL;
+}
+
+/// Assemble a shadow for a `width`x`height` body out of its nine slices. The body
+/// must be at least as large as the kernel in both dimensions.
+static bool shadow_slices_compose(xcb_connection_t *c, xcb_drawable_t d,
+                                  const struct shadow_slices *s, int r, int width,
+                                  int height, xcb_pixmap_t *pixmap) {
+	assert(width >= r * 2 && height >= r * 2);
+	const int swidth = width + r * 2, sheight = height + r * 2;
+	const auto r2 = to_u16_checked(r * 2);
+	const auto right = to_i16_checked(swidth - r * 2);
+	const auto bottom = to_i16_checked(sheight - r * 2);
+	const auto mid_w = to_u16_checked(width - r * 2);
+	const auto mid_h = to_u16_checked(height - r * 2);
+
+	*pixmap = x_create_pixmap(c, 32, d, swidth, sheight);
+	if (!*pixmap) {
+		return false;
+	}
+	auto pict = x_create_picture_with_standard_and_pixmap(c, XCB_PICT_STANDARD_ARGB_32,
+	                                                      *pixmap, 0, NULL);
+	if (!pict) {
+		xcb_free_pixmap(c, *pixmap);
+		*pixmap = XCB_NONE;
+		return false;
+	}
+
+	const uint8_t op = XCB_RENDER_PICT_OP_SRC;
+	const auto far = to_i16_checked(r * 2 + 1);
+	// Corners
+	xcb_render_composite(c, op, s->corners, XCB_NONE, pict, 0, 0, 0, 0, 0, 0, r2, r2);
+	xcb_render_composite(c, op, s->corners, XCB_NONE, pict, far, 0, 0, 0, right, 0,
+	                     r2, r2);
+	xcb_render_composite(c, op, s->corners, XCB_NONE, pict, 0, far, 0, 0, 0, bottom,
+	                     r2, r2);
+	xcb_render_composite(c, op, s->corners, XCB_NONE, pict, far, far, 0, 0, right,
+	                     bottom, r2, r2);
+	if (mid_w > 0) {
+		xcb_render_composite(c, op, s->edges[SHADOW_EDGE_TOP], XCB_NONE, pict, 0, 0,
+		                     0, 0, (int16_t)r2, 0, mid_w, r2);
+		xcb_render_composite(c, op, s->edges[SHADOW_EDGE_BOTTOM], XCB_NONE, pict,
+		                     0, 0, 0, 0, (int16_t)r2, bottom, mid_w, r2);
+	}
+	if (mid_h > 0) {
+		xcb_render_composite(c, op, s->edges[SHADOW_EDGE_LEFT], XCB_NONE, pict, 0,
+		                     0, 0, 0, 0, (int16_t)r2, r2, mid_h);
+		xcb_render_composite(c, op, s->edges[SHADOW_EDGE_RIGHT], XCB_NONE, pict, 0,
+		                     0, 0, 0, right, (int16_t)r2, r2, mid_h);
+	}
+	if (mid_w > 0 && mid_h > 0) {
+		xcb_render_composite(c, op, s->center, XCB_NONE, pict, 0, 0, 0, 0,
+		                     (int16_t)r2, (int16_t)r2, mid_w, mid_h);
+	}
+	xcb_render_free_picture(c, pict);
+	return true;
+}
+
 void *default_backend_render_shadow(backend_t *backend_data, int width, int height,
                                     struct backend_shadow_context *sctx, struct color color) {
-	const conv *kernel = (void *)sctx;
-	
-	xcb_render_picture_t shadow_pixel = solid_picture(
-		backend_data->c, backend_data->root, true, 1, color.red, color.green, color.blue);
- 	xcb_pixmap_t shadow = XCB_NONE;
-
-	xcb_render_picture_t pict = XCB_NONE;
+	auto ctx = (struct default_shadow_context *)sctx;
+	const conv *kernel = ctx->kernel;
+	const int r = kernel->w / 2;
+	xcb_pixmap_t shadow = XCB_NONE;
+
+	// Windows at least as large as the kernel get their shadow assembled from
+	// the cached slices. This is what keeps resizing animations cheap.
+	if (r > 0 && width >= r * 2 && height >= r * 2) {
+		auto slices = shadow_slices_get(backend_data, ctx, color);
+		if (slices && !shadow_slices_compose(backend_data->c, backend_data->root,
+		                                     slices, r, width, height, &shadow)) {
+			shadow = XCB_NONE;
+		}
+	}
 
-	if (!build_shadow(backend_data->c, backend_data->root, color.alpha, width, height,
-	                  kernel, shadow_pixel, &shadow, &pict)) {
+	if (!shadow) {
+		xcb_render_picture_t shadow_pixel =
+		    solid_picture(backend_data->c, backend_data->root, true, 1, color.red,
+		                  color.green, color.blue);
+		xcb_render_picture_t pict = XCB_NONE;
+		if (!build_shadow(backend_data->c, backend_data->root, color.alpha, width,
+		                  height, kernel, shadow_pixel, &shadow, &pict)) {
+			xcb_render_free_picture(backend_data->c, shadow_pixel);
+			return NULL;
+		}
+		xcb_render_free_picture(backend_data->c, pict);
 		xcb_render_free_picture(backend_data->c, shadow_pixel);
-		return NULL;
 	}
 
 	auto visual = x_get_visual_for_standard(backend_data->c, XCB_PICT_STANDARD_ARGB_32);
-	void *ret = backend_data->ops->bind_pixmap(
+	return backend_data->ops->bind_pixmap(
 	    backend_data, shadow, x_get_visual_info(backend_data->c, visual), true);
-	xcb_render_free_picture(backend_data->c, pict);
-	xcb_render_free_picture(backend_data->c, shadow_pixel);
-	return ret;
 }
 
 /// Implement render_shadow with shadow_from_mask
@@ -332,15 +521,22 @@ backend_render_shadow_from_mask(backend_t *backend_data, int width, int height,
 
 struct backend_shadow_context *
 default_create_shadow_context(backend_t *backend_data attr_unused, double radius) {
-	auto ret =
-	    (struct backend_shadow_context *)gaussian_kernel_autodetect_deviation(radius);
-	sum_kernel_preprocess((conv *)ret);
-	return ret;
+	auto ret = ccalloc(1, struct default_shadow_context);
+	ret->kernel = gaussian_kernel_autodetect_deviation(radius);
+	sum_kernel_preprocess(ret->kernel);
+	return (struct backend_shadow_context *)ret;
 }
 
-void default_destroy_shadow_context(backend_t *backend_data attr_unused,
+void default_destroy_shadow_context(backend_t *backend_data,
                                     struct backend_shadow_context *sctx) {
-	free_conv((conv *)sctx);
+	auto ctx = (struct default_shadow_context *)sctx;
+	while (ctx->slices) {
+		auto next = ctx->slices->next;
+		shadow_slices_free(backend_data->c, ctx->slices);
+		ctx->slices = next;
+	}
+	free_conv(ctx->kernel);
+	free(ctx);
 }
 
 static struct conv **generate_box_blur_kernel(struct box_blur_args *args, int *kernel_count) {
@@ -516,3 +712,50 @@ void init_backend_base(struct backend_base *base, session_t *ps) {
 	base->dpy = ps->dpy;
 	base->scr = ps->scr;
 }
+
+/// Fill the shadow of a `width` x `height` body with a kernel of `radius`, into rows
+/// padded by 2 bytes, and compare it with `expected`
+static void test_make_shadow_fill(double radius, double opacity, int width, int height,
+                                  const unsigned char *expected) {
+	auto kernel = gaussian_kernel_autodetect_deviation(radius);
+	sum_kernel_preprocess(kernel);
+	int d = kernel->w;
+	int swidth = width + d - 1, sheight = height + d - 1;
+	long long sstride = swidth + 2;
+	size_t size = (size_t)(sstride * sheight);
+	auto got = ccalloc(size, unsigned char);
+	make_shadow_fill(got, sstride, kernel, opacity, width, height);
+	TEST_EQUAL(memcmp(expected, got, size), 0);
+	free(got);
+	free_conv(kernel);
+}
+
+TEST_CASE(make_shadow_fill) {
+	// Two rows of part 3
+	static const unsigned char expected_6x6[] = {
+	    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	    0, 6, 33, 40, 40, 40, 40, 33, 6, 0, 0, 0,
+	    0, 33, 180, 214, 214, 214, 214, 180, 33, 0, 0, 0,
+	    0, 40, 214, 254, 254, 254, 254, 214, 40, 0, 0, 0,
+	    0, 40, 214, 254, 255, 255, 254, 214, 40, 0, 0, 0,
+	    0, 40, 214, 254, 255, 255, 254, 214, 40, 0, 0, 0,
+	    0, 40, 214, 254, 254, 254, 254, 214, 40, 0, 0, 0,
+	    0, 33, 180, 214, 214, 214, 214, 180, 33, 0, 0, 0,
+	    0, 6, 33, 40, 40, 40, 40, 33, 6, 0, 0, 0,
+	    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	};
+	test_make_shadow_fill(2, 1, 6, 6, expected_6x6);
+
+	// Body only 2 * radius tall, no rows of part 3
+	static const unsigned char expected_5x4[] = {
+	    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	    0, 4, 25, 30, 30, 30, 25, 4, 0, 0, 0,
+	    0, 25, 135, 160, 161, 160, 135, 25, 0, 0, 0,
+	    0, 30, 160, 190, 190, 190, 160, 30, 0, 0, 0,
+	    0, 30, 160, 190, 190, 190, 160, 30, 0, 0, 0,
+	    0, 25, 135, 160, 161, 160, 135, 25, 0, 0, 0,
+	    0, 4, 25, 30, 30, 30, 25, 4, 0, 0, 0,
+	    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	};
+	test_make_shadow_fill(2, 0.75, 5, 4, expected_5x4);
+}
@@ -47,6 +47,16 @@ void dummy_deinit(struct backend_base *data) {
 	free(dummy);
 }
 
+/// Account for an operation on `reg` in the benchmark counters.
+static void dummy_count_region_op(struct backend_base *base, const region_t *reg) {
+	base->region_ops++;
+	if (reg) {
+		int nrects;
+		pixman_region32_rectangles((region_t *)reg, &nrects);
+		base->region_rects += (uint64_t)nrects;
+	}
+}
+
 static void dummy_check_image(struct backend_base *base, const struct dummy_image *img) {
 	auto dummy = (struct dummy_data *)base;
 	if (img == (struct dummy_image *)&dummy->mask) {
@@ -63,21 +73,25 @@ static void dummy_check_image(struct backend_base *base, const struct dummy_imag
 
 void dummy_compose(struct backend_base *base, void *image, coord_t dst attr_unused,
                    void *mask attr_unused, coord_t mask_dst attr_unused,
-                   const region_t *reg_paint attr_unused,
-                   const region_t *reg_visible attr_unused, bool lerp attr_unused) {
+                   const region_t *reg_paint,
+                   const region_t *reg_visible attr_unused,
+                   const geometry_t *dst_size attr_unused) {
 	auto dummy attr_unused = (struct dummy_data *)base;
 	dummy_check_image(base, image);
 	assert(mask == NULL || mask == &dummy->mask);
+	dummy_count_region_op(base, reg_paint);
 }
 
-void dummy_fill(struct backend_base *backend_data attr_unused, struct color c attr_unused,
-                const region_t *clip attr_unused) {
+void dummy_fill(struct backend_base *backend_data, struct color c attr_unused,
+                const region_t *clip) {
+	dummy_count_region_op(backend_data, clip);
 }
 
-bool dummy_blur(struct backend_base *backend_data attr_unused, double opacity attr_unused,
+bool dummy_blur(struct backend_base *backend_data, double opacity attr_unused,
                 void *blur_ctx attr_unused, void *mask attr_unused,
-                coord_t mask_dst attr_unused, const region_t *reg_blur attr_unused,
+                coord_t mask_dst attr_unused, const region_t *reg_blur,
                 const region_t *reg_visible attr_unused) {
+	dummy_count_region_op(backend_data, reg_blur);
 	return true;
 }
 
@@ -127,9 +141,10 @@ int dummy_buffer_age(struct backend_base *base attr_unused) {
 }
 
 bool dummy_image_op(struct backend_base *base, enum image_operations op attr_unused,
-                    void *image, const region_t *reg_op attr_unused,
+                    void *image, const region_t *reg_op,
                     const region_t *reg_visible attr_unused, void *args attr_unused) {
 	dummy_check_image(base, image);
+	dummy_count_region_op(base, reg_op);
 	return true;
 }
 
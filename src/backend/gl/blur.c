@@ -6,26 +6,44 @@
 
 #include "gl_common.h"
 
+/// Temporary textures and fbos used for blurring. Blurs never run concurrently, so
+/// all the blur contexts that blur the back buffer with the same kind of method share
+/// one set, grown to the number of textures the most demanding context needs.
+struct gl_blur_textures {
+	GLuint *textures;
+	GLuint *fbos;
+	int count;
+
+	/// Whether each texture is a quarter of the previous one, as dual-kawase wants,
+	/// instead of all of them being the size of the source.
+	bool pyramid;
+
+	/// Cached dimensions of each texture. They are the same size as the source, so
+	/// they are always big enough without resizing.
+	/// Turns out calling glTexImage to resize is expensive, so we avoid that.
+	struct texture_size {
+		int width;
+		int height;
+	} *sizes;
+	/// The source size the textures were allocated for, 0 if they have to be
+	/// (re)allocated.
+	int width, height;
+
+	int refcount;
+};
+
 struct gl_blur_context {
 	enum blur_method method;
 	gl_blur_shader_t *blur_shader;
 
-	/// Temporary textures used for blurring
-	GLuint *blur_textures;
+	/// Temporary textures and fbos, shared with other contexts unless created by
+	/// `gl_create_private_blur_context`
+	struct gl_blur_textures *textures;
+	/// Number of the temporary textures and fbos this context uses
 	int blur_texture_count;
-	/// Temporary fbos used for blurring
-	GLuint *blur_fbos;
 	int blur_fbo_count;
 
-	/// Cached dimensions of each blur_texture. They are the same size as the target,
-	/// so they are always big enough without resizing.
-	/// Turns out calling glTexImage to resize is expensive, so we avoid that.
-	struct texture_size {
-		int width;
-		int height;
-	} *texture_sizes;
-
-	/// Cached dimensions of the offscreen framebuffer. It's the same size as the
+	/// Dimensions of the offscreen framebuffer. It's the same size as the
 	/// target but is expanded in either direction by resize_width / resize_height.
 	int fb_width, fb_height;
 
@@ -35,6 +53,97 @@ struct gl_blur_context {
 	int npasses;
 };
 
+/// (Re)allocate the textures if the source size changed, e.g. because the root
+/// size changed, or they are shared with a context blurring something else.
+static bool gl_blur_textures_resize(struct gl_blur_textures *t, geometry_t source_size) {
+	if (source_size.width == t->width && source_size.height == t->height) {
+		return true;
+	}
+	t->width = source_size.width;
+	t->height = source_size.height;
+
+	for (int i = 0; i < t->count; ++i) {
+		auto tex_size = t->sizes + i;
+		if (t->pyramid) {
+			// Use smaller textures for each iteration (quarter of the
+			// previous texture)
+			tex_size->width = 1 + ((t->width - 1) >> (i + 1));
+			tex_size->height = 1 + ((t->height - 1) >> (i + 1));
+		} else {
+			tex_size->width = t->width;
+			tex_size->height = t->height;
+		}
+
+		glBindTexture(GL_TEXTURE_2D, t->textures[i]);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, tex_size->width,
+		             tex_size->height, 0, GL_BGRA, GL_UNSIGNED_BYTE, NULL);
+
+		if (t->pyramid) {
+			// Attach texture to FBO target
+			glBindFramebuffer(GL_DRAW_FRAMEBUFFER, t->fbos[i]);
+			glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+			                       GL_TEXTURE_2D, t->textures[i], 0);
+			if (!gl_check_fb_complete(GL_FRAMEBUFFER)) {
+				glBindFramebuffer(GL_FRAMEBUFFER, 0);
+				t->width = t->height = 0;
+				return false;
+			}
+		}
+	}
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+	return true;
+}
+
+/// Make sure `t` has at least `count` textures and fbos.
+static bool gl_blur_textures_reserve(struct gl_blur_textures *t, int count) {
+	if (count <= t->count) {
+		return true;
+	}
+
+	t->textures = crealloc(t->textures, count);
+	t->fbos = crealloc(t->fbos, count);
+	t->sizes = crealloc(t->sizes, count);
+	int added = count - t->count;
+	glGenTextures(added, t->textures + t->count);
+	glGenFramebuffers(added, t->fbos + t->count);
+
+	for (int i = t->count; i < count; ++i) {
+		glBindTexture(GL_TEXTURE_2D, t->textures[i]);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	}
+	t->count = count;
+	// Texture size will be defined by gl_blur
+	t->width = t->height = 0;
+
+	for (int i = 0; i < t->count; ++i) {
+		if (!t->fbos[i]) {
+			log_error("Failed to generate framebuffer objects for blur");
+			return false;
+		}
+	}
+	return true;
+}
+
+static void gl_blur_textures_unref(struct gl_data *gd, struct gl_blur_textures *t) {
+	if (--t->refcount > 0) {
+		return;
+	}
+	if (gd->blur_textures[t->pyramid] == t) {
+		gd->blur_textures[t->pyramid] = NULL;
+	}
+	if (t->count) {
+		glDeleteTextures(t->count, t->textures);
+		glDeleteFramebuffers(t->count, t->fbos);
+	}
+	free(t->textures);
+	free(t->fbos);
+	free(t->sizes);
+	free(t);
+}
+
 /**
  * Blur contents in a particular region.
  */
@@ -49,7 +158,7 @@ bool gl_kernel_blur(double opacity, struct gl_blur_context *bctx, const rect_t *
 		const gl_blur_shader_t *p = &bctx->blur_shader[i];
 		assert(p->prog);
 
-		assert(bctx->blur_textures[curr]);
+		assert(bctx->textures->textures[curr]);
 
 		// The origin to use when sampling from the source texture
 		GLint texorig_x = extent->x1, texorig_y = dst_y_fb_coord;
@@ -61,8 +170,8 @@ bool gl_kernel_blur(double opacity, struct gl_blur_context *bctx, const rect_t *
 			tex_width = source_size.width;
 			tex_height = source_size.height;
 		} else {
-			src_texture = bctx->blur_textures[curr];
-			auto src_size = bctx->texture_sizes[curr];
+			src_texture = bctx->textures->textures[curr];
+			auto src_size = bctx->textures->sizes[curr];
 			tex_width = src_size.width;
 			tex_height = src_size.height;
 		}
@@ -85,16 +194,16 @@ bool gl_kernel_blur(double opacity, struct gl_blur_context *bctx, const rect_t *
 		GLsizei nelems;
 
 		if (i < bctx->npasses - 1) {
-			assert(bctx->blur_fbos[0]);
-			assert(bctx->blur_textures[!curr]);
+			assert(bctx->textures->fbos[0]);
+			assert(bctx->textures->textures[!curr]);
 
 			// not last pass, draw into framebuffer, with resized regions
 			glBindVertexArray(vao[1]);
 			nelems = vao_nelems[1];
-			glBindFramebuffer(GL_DRAW_FRAMEBUFFER, bctx->blur_fbos[0]);
+			glBindFramebuffer(GL_DRAW_FRAMEBUFFER, bctx->textures->fbos[0]);
 
 			glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
-			                       GL_TEXTURE_2D, bctx->blur_textures[!curr], 0);
+			                       GL_TEXTURE_2D, bctx->textures->textures[!curr], 0);
 			glDrawBuffer(GL_COLOR_ATTACHMENT0);
 			if (!gl_check_fb_complete(GL_FRAMEBUFFER)) {
 				return false;
@@ -167,17 +276,17 @@ bool gl_dual_kawase_blur(double opacity, struct gl_blur_context *bctx, const rec
 			tex_height = source_size.height;
 		} else {
 			// copy from previous pass
-			src_texture = bctx->blur_textures[i - 1];
-			auto src_size = bctx->texture_sizes[i - 1];
+			src_texture = bctx->textures->textures[i - 1];
+			auto src_size = bctx->textures->sizes[i - 1];
 			tex_width = src_size.width;
 			tex_height = src_size.height;
 		}
 
 		assert(src_texture);
-		assert(bctx->blur_fbos[i]);
+		assert(bctx->textures->fbos[i]);
 
 		glBindTexture(GL_TEXTURE_2D, src_texture);
-		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, bctx->blur_fbos[i]);
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, bctx->textures->fbos[i]);
 		glDrawBuffer(GL_COLOR_ATTACHMENT0);
 
 		glUniform1f(down_pass->scale_loc, (GLfloat)scale_factor);
@@ -208,19 +317,19 @@ bool gl_dual_kawase_blur(double opacity, struct gl_blur_context *bctx, const rec
 		// Scale output width / height back by two in each iteration
 		scale_factor >>= 1;
 
-		const GLuint src_texture = bctx->blur_textures[i];
+		const GLuint src_texture = bctx->textures->textures[i];
 		assert(src_texture);
 
 		// Calculate normalized half-width/-height of a src pixel
-		auto src_size = bctx->texture_sizes[i];
+		auto src_size = bctx->textures->sizes[i];
 		int tex_width = src_size.width;
 		int tex_height = src_size.height;
 
 		if (i > 0) {
-			assert(bctx->blur_fbos[i - 1]);
+			assert(bctx->textures->fbos[i - 1]);
 
 			// not last pass, draw into next framebuffer
-			glBindFramebuffer(GL_DRAW_FRAMEBUFFER, bctx->blur_fbos[i - 1]);
+			glBindFramebuffer(GL_DRAW_FRAMEBUFFER, bctx->textures->fbos[i - 1]);
 			glDrawBuffer(GL_COLOR_ATTACHMENT0);
 		} else {
 			// last pass, draw directly into the back buffer
@@ -259,41 +368,10 @@ bool gl_blur_inner(double opacity, struct gl_blur_context *bctx, void *mask,
                   geometry_t source_size, GLuint target_fbo, GLuint default_mask) {
 	bool ret = false;
 
-	if (source_size.width != bctx->fb_width || source_size.height != bctx->fb_height) {
-		// Resize the temporary textures used for blur in case the root
-		// size changed
-		bctx->fb_width = source_size.width;
-		bctx->fb_height = source_size.height;
-
-		for (int i = 0; i < bctx->blur_texture_count; ++i) {
-			auto tex_size = bctx->texture_sizes + i;
-			if (bctx->method == BLUR_METHOD_DUAL_KAWASE) {
-				// Use smaller textures for each iteration (quarter of the
-				// previous texture)
-				tex_size->width = 1 + ((bctx->fb_width - 1) >> (i + 1));
-				tex_size->height = 1 + ((bctx->fb_height - 1) >> (i + 1));
-			} else {
-				tex_size->width = bctx->fb_width;
-				tex_size->height = bctx->fb_height;
-			}
-
-			glBindTexture(GL_TEXTURE_2D, bctx->blur_textures[i]);
-			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, tex_size->width,
-			             tex_size->height, 0, GL_BGRA, GL_UNSIGNED_BYTE, NULL);
-
-			if (bctx->method == BLUR_METHOD_DUAL_KAWASE) {
-				// Attach texture to FBO target
-				glBindFramebuffer(GL_DRAW_FRAMEBUFFER, bctx->blur_fbos[i]);
-				glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER,
-				                       GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
-				                       bctx->blur_textures[i], 0);
-				if (!gl_check_fb_complete(GL_FRAMEBUFFER)) {
-					glBindFramebuffer(GL_FRAMEBUFFER, 0);
-					return false;
-				}
-			}
-		}
-		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+	bctx->fb_width = source_size.width;
+	bctx->fb_height = source_size.height;
+	if (!gl_blur_textures_resize(bctx->textures, source_size)) {
+		return false;
 	}
 
 	// Remainder: regions are in Xorg coordinates
@@ -411,7 +489,7 @@ static inline void gl_free_blur_shader(gl_blur_shader_t *shader) {
 	shader->prog = 0;
 }
 
-void gl_destroy_blur_context(backend_t *base attr_unused, void *ctx) {
+void gl_destroy_blur_context(backend_t *base, void *ctx) {
 	auto bctx = (struct gl_blur_context *)ctx;
 	// Free GLSL shaders/programs
 	for (int i = 0; i < bctx->npasses; ++i) {
@@ -419,16 +497,9 @@ void gl_destroy_blur_context(backend_t *base attr_unused, void *ctx) {
 	}
 	free(bctx->blur_shader);
 
-	if (bctx->blur_texture_count && bctx->blur_textures) {
-		glDeleteTextures(bctx->blur_texture_count, bctx->blur_textures);
-		free(bctx->blur_textures);
-	}
-	if (bctx->blur_texture_count && bctx->texture_sizes) {
-		free(bctx->texture_sizes);
-	}
-	if (bctx->blur_fbo_count && bctx->blur_fbos) {
-		glDeleteFramebuffers(bctx->blur_fbo_count, bctx->blur_fbos);
-		free(bctx->blur_fbos);
+	if (bctx->textures) {
+		gl_blur_textures_unref((struct gl_data *)base, bctx->textures);
+		bctx->textures = NULL;
 	}
 
 	bctx->blur_texture_count = 0;
@@ -820,7 +891,8 @@ out:
 	return success;
 }
 
-void *gl_create_blur_context(backend_t *base, enum blur_method method, void *args) {
+static void *gl_create_blur_context_with(backend_t *base, enum blur_method method,
+                                         void *args, bool shared) {
 	bool success;
 	auto gd = (struct gl_data *)base;
 
@@ -852,30 +924,20 @@ void *gl_create_blur_context(backend_t *base, enum blur_method method, void *arg
 		goto out;
 	}
 
-	// Texture size will be defined by gl_blur
-	ctx->blur_textures = ccalloc(ctx->blur_texture_count, GLuint);
-	ctx->texture_sizes = ccalloc(ctx->blur_texture_count, struct texture_size);
-	glGenTextures(ctx->blur_texture_count, ctx->blur_textures);
-
-	for (int i = 0; i < ctx->blur_texture_count; ++i) {
-		glBindTexture(GL_TEXTURE_2D, ctx->blur_textures[i]);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	}
-
-	// Generate FBO and textures when needed
-	ctx->blur_fbos = ccalloc(ctx->blur_fbo_count, GLuint);
-	glGenFramebuffers(ctx->blur_fbo_count, ctx->blur_fbos);
-
-	for (int i = 0; i < ctx->blur_fbo_count; ++i) {
-		if (!ctx->blur_fbos[i]) {
-			log_error("Failed to generate framebuffer objects for blur");
-			success = false;
-			goto out;
+	bool pyramid = ctx->method == BLUR_METHOD_DUAL_KAWASE;
+	if (shared && gd->blur_textures[pyramid]) {
+		ctx->textures = gd->blur_textures[pyramid];
+	} else {
+		ctx->textures = ccalloc(1, struct gl_blur_textures);
+		ctx->textures->pyramid = pyramid;
+		if (shared) {
+			gd->blur_textures[pyramid] = ctx->textures;
 		}
 	}
+	ctx->textures->refcount++;
+
+	success = gl_blur_textures_reserve(
+	    ctx->textures, max2(ctx->blur_texture_count, ctx->blur_fbo_count));
 
 out:
 	if (!success) {
@@ -887,6 +949,14 @@ out:
 	return ctx;
 }
 
+void *gl_create_blur_context(backend_t *base, enum blur_method method, void *args) {
+	return gl_create_blur_context_with(base, method, args, true);
+}
+
+void *gl_create_private_blur_context(backend_t *base, enum blur_method method, void *args) {
+	return gl_create_blur_context_with(base, method, args, false);
+}
+
 void gl_get_blur_size(void *blur_context, int *width, int *height) {
 	auto ctx = (struct gl_blur_context *)blur_context;
 	*width = ctx->resize_width;
@@ -537,12 +537,18 @@ void x_rect_to_coords(int nrects, const rect_t *rects, coord_t image_dst,
 // TODO(yshui) make use of reg_visible
 void gl_compose(backend_t *base, void *image_data, coord_t image_dst, void *mask_data,
                 coord_t mask_dst, const region_t *reg_tgt,
-                const region_t *reg_visible attr_unused, bool lerp) {
+                const region_t *reg_visible attr_unused, const geometry_t *dst_size) {
 	auto gd    = (struct gl_data *)base;
 	auto img   = (struct backend_image *) image_data;
 	auto mask  = (struct backend_image *)mask_data;
 	auto inner = (struct gl_texture *)img->inner;
 
+	bool stretched = dst_size && (dst_size->width != inner->width ||
+	                              dst_size->height != inner->height);
+	if (stretched && (dst_size->width <= 0 || dst_size->height <= 0)) {
+		return;
+	}
+
 	// Painting
 	int nrects;
 	const rect_t *rects;
@@ -563,15 +569,16 @@ void gl_compose(backend_t *base, void *image_data, coord_t image_dst, void *mask
 	auto indices = ccalloc(nrects * 6, GLuint);
 	coord_t mask_offset = {.x = mask_dst.x - image_dst.x,
 	                       .y = mask_dst.y - image_dst.y};
-								
-	x_rect_to_coords(nrects, rects, image_dst, inner->height, inner->height,
-	                 gd->height, inner->y_inverted, coord, indices);
 
-	// Kirill
-	if (lerp) {
-		for (unsigned int i = 2; i < 16; i+=4) {
-			coord[i+0] = lerp_range(0, mask_offset.x, 0, inner->width, coord[i+0]);
-			coord[i+1] = lerp_range(0, mask_offset.y, 0, inner->height, coord[i+1]);
+	// A stretched image is laid out as if it had the destination size, then its
+	// texture coordinates are scaled back to the texture
+	int extent_height = stretched ? dst_size->height : inner->height;
+	x_rect_to_coords(nrects, rects, image_dst, extent_height, extent_height,
+	                 gd->height, inner->y_inverted, coord, indices);
+	if (stretched) {
+		for (int i = 0; i < nrects * 4; i++) {
+			coord[i * 4 + 2] = coord[i * 4 + 2] * inner->width / dst_size->width;
+			coord[i * 4 + 3] = coord[i * 4 + 3] * inner->height / dst_size->height;
 		}
 	}
 
@@ -1222,7 +1229,8 @@ struct backend_shadow_context *gl_create_shadow_context(backend_t *base, double
 		    .size = (int)radius,
 		    .deviation = gaussian_kernel_std_for_size(radius, 0.5 / 256.0),
 		};
-		ctx->blur_context = gl_create_blur_context(base, BLUR_METHOD_GAUSSIAN, &args);
+		ctx->blur_context =
+		    gl_create_private_blur_context(base, BLUR_METHOD_GAUSSIAN, &args);
 		if (!ctx->blur_context) {
 			log_error("Failed to create shadow context");
 			free(ctx);
@@ -13,6 +13,7 @@
 #define CASESTRRET(s)                                                                    \
 	case s: return #s
 struct gl_blur_context;
+struct gl_blur_textures;
 
 static inline GLint glGetUniformLocationChecked(GLuint p, const char *name) {
 	auto ret = glGetUniformLocation(p, name);
@@ -112,6 +113,10 @@ struct gl_data {
 
 	GLuint default_mask_texture;
 
+	/// Temporary textures shared by the blur contexts, indexed by whether they are
+	/// for dual-kawase
+	struct gl_blur_textures *blur_textures[2];
+
 	/// Called when an gl_texture is decoupled from the texture it refers. Returns
 	/// the decoupled user_data
 	void *(*decouple_texture_user_data)(backend_t *base, void *user_data);
@@ -143,7 +148,8 @@ uint64_t gl_get_shader_attributes(backend_t *backend_data, void *shader);
  * @brief Render a region with texture data.
  */
 void gl_compose(backend_t *, void *image_data, coord_t image_dst, void *mask,
-                coord_t mask_dst, const region_t *reg_tgt, const region_t *reg_visible, bool lerp);
+                coord_t mask_dst, const region_t *reg_tgt, const region_t *reg_visible,
+                const geometry_t *dst_size);
 
 void gl_resize(struct gl_data *, int width, int height);
 
@@ -167,6 +173,9 @@ bool gl_blur_inner(double opacity, struct gl_blur_context *bctx, void *mask,
                   const region_t *reg_visible attr_unused, GLuint source_texture,
                   geometry_t source_size, GLuint target_fbo, GLuint default_mask);
 void *gl_create_blur_context(backend_t *base, enum blur_method, void *args);
+/// Like `gl_create_blur_context`, but the context gets temporary textures of its own,
+/// for blurring sources that aren't the size of the back buffer.
+void *gl_create_private_blur_context(backend_t *base, enum blur_method, void *args);
 void gl_destroy_blur_context(backend_t *base, void *ctx);
 struct backend_shadow_context *gl_create_shadow_context(backend_t *base, double radius);
 void gl_destroy_shadow_context(backend_t *base attr_unused, struct backend_shadow_context *ctx);
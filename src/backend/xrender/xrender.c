@@ -10,6 +10,9 @@
 #include <xcb/render.h>
 #include <xcb/sync.h>
 #include <xcb/xcb.h>
+#include <xcb/xcbext.h>
+
+#include <test.h>
 
 #include "backend/backend.h"
 #include "backend/backend_common.h"
@@ -57,6 +60,11 @@ typedef struct _xrender_data {
 	int target_width, target_height;
 
 	xcb_special_event_t *present_event;
+	/// PresentPixmap request of the frame in flight, valid while `base.busy` is
+	/// set. The frame is in flight until its PresentCompleteNotify arrives.
+	xcb_void_cookie_t present_cookie;
+	/// Whether `present_cookie` has been checked for errors already
+	bool present_checked;
 } xrender_data;
 
 struct _xrender_blur_context {
@@ -213,25 +221,54 @@ static xcb_render_picture_t process_mask(struct _xrender_data *xd, struct xrende
 	return ret;
 }
 
+/// Make `pict` scale from `width`x`height` to `dst_size` when used as a source, or
+/// undo that if `dst_size` is NULL.
+static void set_picture_scale(xcb_connection_t *c, xcb_render_picture_t pict, int width,
+                              int height, const geometry_t *dst_size) {
+	static const char *filter0 = "Nearest";
+	static const char *filter = "Bilinear";
+	xcb_render_transform_t transform = {
+	    .matrix11 = DOUBLE_TO_XFIXED(1),
+	    .matrix22 = DOUBLE_TO_XFIXED(1),
+	    .matrix33 = DOUBLE_TO_XFIXED(1),
+	};
+	if (dst_size) {
+		transform.matrix11 = DOUBLE_TO_XFIXED((double)width / dst_size->width);
+		transform.matrix22 = DOUBLE_TO_XFIXED((double)height / dst_size->height);
+	}
+	xcb_render_set_picture_transform(c, pict, transform);
+	auto f = dst_size ? filter : filter0;
+	xcb_render_set_picture_filter(c, pict, to_u16_checked(strlen(f)), f, 0, NULL);
+}
+
 static void
 compose_inner(struct _xrender_data *xd, struct xrender_image *xrimg, coord_t dst,
              struct xrender_image *mask, coord_t mask_dst, const region_t *reg_paint,
-             const region_t *reg_visible, xcb_render_picture_t result) {
+             const region_t *reg_visible, const geometry_t *dst_size,
+             xcb_render_picture_t result) {
 	const struct backend_image *img = &xrimg->base;
+	auto inner = (struct _xrender_image_data_inner *)img->inner;
+	if (dst_size && dst_size->width == inner->width && dst_size->height == inner->height) {
+		dst_size = NULL;
+	}
+	if (dst_size && (dst_size->width <= 0 || dst_size->height <= 0)) {
+		return;
+	}
+
 	bool mask_allocated = false;
 	auto mask_pict = xd->alpha_pict[(int)(img->opacity * MAX_ALPHA)];
 	if (mask != NULL) {
 		mask_pict = process_mask(
 		    xd, mask, img->opacity < 1.0 ? mask_pict : XCB_NONE, &mask_allocated);
 	}
-	auto inner = (struct _xrender_image_data_inner *)img->inner;
 	region_t reg;
 
 	bool has_alpha = inner->has_alpha || img->opacity != 1;
 	const auto tmpw = to_u16_checked(inner->width);
 	const auto tmph = to_u16_checked(inner->height);
-	const auto tmpew = to_u16_checked(img->ewidth);
-	const auto tmpeh = to_u16_checked(img->eheight);
+	// A stretched image covers its destination size instead of its effective size
+	const auto tmpew = to_u16_checked(dst_size ? dst_size->width : img->ewidth);
+	const auto tmpeh = to_u16_checked(dst_size ? dst_size->height : img->eheight);
 	// Remember: the mask has a 1-pixel border
 	const auto mask_dst_x = to_i16_checked(dst.x - mask_dst.x + 1);
 	const auto mask_dst_y = to_i16_checked(dst.y - mask_dst.y + 1);
@@ -313,6 +350,9 @@ compose_inner(struct _xrender_data *xd, struct xrender_image *xrimg, coord_t dst
 			                           tmp_pict, dim_color, 1, &rect);
 		}
 
+		if (dst_size) {
+			set_picture_scale(xd->base.c, tmp_pict, tmpw, tmph, dst_size);
+		}
 		xcb_render_composite(xd->base.c, XCB_RENDER_PICT_OP_OVER, tmp_pict,
 		                     mask_pict, result, 0, 0, mask_dst_x, mask_dst_y,
 		                     to_i16_checked(dst.x), to_i16_checked(dst.y), tmpew,
@@ -321,9 +361,15 @@ compose_inner(struct _xrender_data *xd, struct xrender_image *xrimg, coord_t dst
 	} else {
 		uint8_t op = (has_alpha ? XCB_RENDER_PICT_OP_OVER : XCB_RENDER_PICT_OP_SRC);
 
+		if (dst_size) {
+			set_picture_scale(xd->base.c, inner->pict, tmpw, tmph, dst_size);
+		}
 		xcb_render_composite(xd->base.c, op, inner->pict, mask_pict, result, 0, 0,
 		                     mask_dst_x, mask_dst_y, to_i16_checked(dst.x),
 		                     to_i16_checked(dst.y), tmpew, tmpeh);
+		if (dst_size) {
+			set_picture_scale(xd->base.c, inner->pict, tmpw, tmph, NULL);
+		}
 		if (img->dim != 0 || img->color_inverted) {
 			// Apply properties, if we reach here, then has_alpha == false
 			assert(!has_alpha);
@@ -355,10 +401,11 @@ compose_inner(struct _xrender_data *xd, struct xrender_image *xrimg, coord_t dst
 }
 
 static void compose(backend_t *base, void *img_data, coord_t dst, void *mask, coord_t mask_dst,
-                    const region_t *reg_paint, const region_t *reg_visible, bool lerp attr_unused) {
+                    const region_t *reg_paint, const region_t *reg_visible,
+                    const geometry_t *dst_size) {
 	struct _xrender_data *xd = (void *)base;
 	return compose_inner(xd, img_data, dst, mask, mask_dst, reg_paint, reg_visible,
-	                    xd->back[2]);
+	                     dst_size, xd->back[2]);
 }
 
 static void fill(backend_t *base, struct color c, const region_t *clip) {
@@ -594,6 +641,9 @@ static void deinit(backend_t *backend_data) {
 			xcb_free_pixmap(xd->base.c, xd->back_pixmap[i]);
 		}
 	}
+	if (xd->base.busy && !xd->present_checked) {
+		xcb_discard_reply(xd->base.c, xd->present_cookie.sequence);
+	}
 	if (xd->present_event) {
 		xcb_unregister_for_special_event(xd->base.c, xd->present_event);
 	}
@@ -602,6 +652,81 @@ static void deinit(backend_t *backend_data) {
 	free(xd);
 }
 
+/// Handle the completion of the frame in flight
+static void present_complete(struct _xrender_data *xd,
+                             const xcb_present_complete_notify_event_t *pcev) {
+	// log_trace("Present complete: %d %ld", pcev->mode, pcev->msc);
+	xd->buffer_age[xd->curr_back] = 1;
+
+	// buffer_age < 0 means that back buffer is empty
+	if (xd->buffer_age[1 - xd->curr_back] > 0) {
+		xd->buffer_age[1 - xd->curr_back]++;
+	}
+	if (pcev->mode == XCB_PRESENT_COMPLETE_MODE_FLIP) {
+		// We cannot use the pixmap we used anymore
+		xd->curr_back = 1 - xd->curr_back;
+	}
+	if (!xd->present_checked) {
+		xcb_discard_reply(xd->base.c, xd->present_cookie.sequence);
+	}
+	xd->base.busy = false;
+}
+
+/// Process the present events that have arrived. If `block` is true, wait until the
+/// frame in flight, if any, has completed.
+static void handle_present_events(struct _xrender_data *xd, bool block) {
+	if (xd->base.busy && !xd->present_checked) {
+		// If PresentPixmap failed, no completion is going to come
+		xcb_generic_error_t *e = NULL;
+		if (block) {
+			// Make sure we got reply from PresentPixmap before waiting for
+			// events, to avoid deadlock
+			e = xcb_request_check(xd->base.c, xd->present_cookie);
+			xd->present_checked = true;
+		} else {
+			void *reply = NULL;
+			if (xcb_poll_for_reply(xd->base.c, xd->present_cookie.sequence,
+			                       &reply, &e)) {
+				xd->present_checked = true;
+				free(reply);
+			}
+		}
+		if (e) {
+			log_error("Failed to present pixmap");
+			free(e);
+			xd->base.busy = false;
+			return;
+		}
+	}
+
+	while (xd->base.busy) {
+		xcb_present_generic_event_t *pev =
+		    block ? (void *)xcb_wait_for_special_event(xd->base.c, xd->present_event)
+		          : (void *)xcb_poll_for_special_event(xd->base.c, xd->present_event);
+		if (!pev) {
+			if (block) {
+				// We don't know what happened, maybe X died
+				// But reset buffer age, so in case we do recover, we
+				// will render correctly.
+				xd->buffer_age[0] = xd->buffer_age[1] = -1;
+				xd->base.busy = false;
+			}
+			return;
+		}
+		// The frame scheduler's NotifyMSC events are sent to us too
+		if (pev->evtype == XCB_PRESENT_COMPLETE_NOTIFY &&
+		    ((xcb_present_complete_notify_event_t *)pev)->kind ==
+		        XCB_PRESENT_COMPLETE_KIND_PIXMAP) {
+			present_complete(xd, (void *)pev);
+		}
+		free(pev);
+	}
+}
+
+static void handle_events(backend_t *base) {
+	handle_present_events((void *)base, false);
+}
+
 static void present(backend_t *base, const region_t *region) {
 	struct _xrender_data *xd = (void *)base;
 	const rect_t *extent = pixman_region32_extents((region_t *)region);
@@ -616,47 +741,22 @@ static void present(backend_t *base, const region_t *region) {
 	x_set_picture_clip_region(base->c, xd->back[2], 0, 0, region);
 
 	if (xd->vsync) {
+		// The back buffer might still be in use by the last frame. The core
+		// normally doesn't paint while we are busy, so this rarely blocks.
+		handle_present_events(xd, true);
+
 		// Update the back buffer first, then present
 		xcb_render_composite(base->c, XCB_RENDER_PICT_OP_SRC, xd->back[2],
 		                     XCB_NONE, xd->back[xd->curr_back], orig_x, orig_y, 0,
 		                     0, orig_x, orig_y, region_width, region_height);
 
-		// Make sure we got reply from PresentPixmap before waiting for events,
-		// to avoid deadlock
-		auto e = xcb_request_check(
-		    base->c, xcb_present_pixmap_checked(
-		                 xd->base.c, xd->target_win,
-		                 xd->back_pixmap[xd->curr_back], 0, XCB_NONE, XCB_NONE, 0,
-		                 0, XCB_NONE, XCB_NONE, XCB_NONE, 0, 0, 0, 0, 0, NULL));
-		if (e) {
-			log_error("Failed to present pixmap");
-			free(e);
-			return;
-		}
-		// TODO(yshui) don't block wait for present completion
-		xcb_present_generic_event_t *pev =
-		    (void *)xcb_wait_for_special_event(base->c, xd->present_event);
-		if (!pev) {
-			// We don't know what happened, maybe X died
-			// But reset buffer age, so in case we do recover, we will
-			// render correctly.
-			xd->buffer_age[0] = xd->buffer_age[1] = -1;
-			return;
-		}
-		assert(pev->evtype == XCB_PRESENT_COMPLETE_NOTIFY);
-		xcb_present_complete_notify_event_t *pcev = (void *)pev;
-		// log_trace("Present complete: %d %ld", pcev->mode, pcev->msc);
-		xd->buffer_age[xd->curr_back] = 1;
-
-		// buffer_age < 0 means that back buffer is empty
-		if (xd->buffer_age[1 - xd->curr_back] > 0) {
-			xd->buffer_age[1 - xd->curr_back]++;
-		}
-		if (pcev->mode == XCB_PRESENT_COMPLETE_MODE_FLIP) {
-			// We cannot use the pixmap we used anymore
-			xd->curr_back = 1 - xd->curr_back;
-		}
-		free(pev);
+		// Don't wait for the flip, the completion is picked up by
+		// handle_events while the core goes on handling X events.
+		xd->present_cookie = xcb_present_pixmap_checked(
+		    xd->base.c, xd->target_win, xd->back_pixmap[xd->curr_back], 0,
+		    XCB_NONE, XCB_NONE, 0, 0, XCB_NONE, XCB_NONE, XCB_NONE, 0, 0, 0, 0, 0, NULL);
+		xd->present_checked = false;
+		base->busy = true;
 	} else {
 		// No vsync needed, draw into the target picture directly
 		xcb_render_composite(base->c, XCB_RENDER_PICT_OP_SRC, xd->back[2],
@@ -672,6 +772,12 @@ static int buffer_age(backend_t *backend_data) {
 		// content is always up to date. So buffer age is always 1.
 		return 1;
 	}
+	// Don't wait for the frame in flight, handle_events picks up its completion.
+	// Until then, we don't know which back buffer present() will use, nor its
+	// age, so repaint everything.
+	if (xd->base.busy) {
+		return -1;
+	}
 	return xd->buffer_age[xd->curr_back];
 }
 
@@ -992,6 +1098,42 @@ struct backend_operations xrender_ops = {
     .create_blur_context = create_blur_context,
     .destroy_blur_context = destroy_blur_context,
     .get_blur_size = get_blur_size,
+    .handle_events = handle_events,
 };
 
-// vim: set noet sw=8 ts=8:
\ No newline at end of file
+TEST_CASE(xrender_buffer_age_with_frame_in_flight) {
+	// No X connection: getting the buffer age must not wait for the completion
+	// of the frame in flight. The PresentPixmap request is taken as checked, so
+	// the completion doesn't touch the connection.
+	xrender_data xd = {.base = {.c = NULL}, .vsync = true, .present_checked = true};
+	xd.buffer_age[0] = xd.buffer_age[1] = -1;
+	xcb_present_complete_notify_event_t pcev = {
+	    .kind = XCB_PRESENT_COMPLETE_KIND_PIXMAP,
+	    .mode = XCB_PRESENT_COMPLETE_MODE_COPY,
+	};
+
+	// A frame is copied from back buffer 0
+	xd.base.busy = true;
+	TEST_EQUAL(buffer_age(&xd.base), -1);
+	present_complete(&xd, &pcev);
+	TEST_TRUE(!xd.base.busy);
+	TEST_EQUAL(xd.curr_back, 0);
+	TEST_EQUAL(buffer_age(&xd.base), 1);
+
+	// The next one is flipped, the other back buffer is still empty
+	pcev.mode = XCB_PRESENT_COMPLETE_MODE_FLIP;
+	xd.base.busy = true;
+	TEST_EQUAL(buffer_age(&xd.base), -1);
+	present_complete(&xd, &pcev);
+	TEST_EQUAL(xd.curr_back, 1);
+	TEST_EQUAL(buffer_age(&xd.base), -1);
+
+	// Flipping back, back buffer 0 was shown two frames ago
+	xd.base.busy = true;
+	present_complete(&xd, &pcev);
+	TEST_EQUAL(xd.curr_back, 0);
+	TEST_EQUAL(buffer_age(&xd.base), 2);
+	TEST_EQUAL(xd.buffer_age[1], 1);
+}
+
+// vim: set noet sw=8 ts=8:
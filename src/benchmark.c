@@ -0,0 +1,144 @@
+// SPDX-License-Identifier: MPL-2.0
+#include <inttypes.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <test.h>
+
+#include "backend/backend.h"
+#include "benchmark.h"
+#include "compiler.h"
+#include "utils.h"
+
+static uint64_t benchmark_clock_us(clockid_t clock) {
+	struct timespec tm = {0, 0};
+	clock_gettime(clock, &tm);
+	return (uint64_t)tm.tv_sec * 1000000UL + (uint64_t)tm.tv_nsec / 1000;
+}
+
+void benchmark_init(struct benchmark *b, int nframes) {
+	*b = (struct benchmark){0};
+	b->capacity = nframes;
+	b->frames = ccalloc(nframes, struct benchmark_frame);
+}
+
+void benchmark_deinit(struct benchmark *b) {
+	free(b->frames);
+	*b = (struct benchmark){0};
+}
+
+void benchmark_begin_frame(struct benchmark *b, const struct backend_base *backend) {
+	b->wall_start_us = benchmark_clock_us(CLOCK_MONOTONIC);
+	b->cpu_start_us = benchmark_clock_us(CLOCK_PROCESS_CPUTIME_ID);
+	b->allocations_start = allocchk_count;
+	b->region_ops_start = backend ? backend->region_ops : 0;
+	b->region_rects_start = backend ? backend->region_rects : 0;
+}
+
+void benchmark_end_frame(struct benchmark *b, const struct backend_base *backend) {
+	if (b->nframes >= b->capacity) {
+		return;
+	}
+	b->frames[b->nframes++] = (struct benchmark_frame){
+	    .wall_us = benchmark_clock_us(CLOCK_MONOTONIC) - b->wall_start_us,
+	    .cpu_us = benchmark_clock_us(CLOCK_PROCESS_CPUTIME_ID) - b->cpu_start_us,
+	    .allocations = allocchk_count - b->allocations_start,
+	    .region_ops = backend ? backend->region_ops - b->region_ops_start : 0,
+	    .region_rects = backend ? backend->region_rects - b->region_rects_start : 0,
+	};
+}
+
+static int cmp_uint64(const void *a, const void *b) {
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+	return (x > y) - (x < y);
+}
+
+/// Summary of one metric over all recorded frames
+struct benchmark_summary {
+	uint64_t total, min, p50, p99, max;
+};
+
+/// Summarize the metric found at `offset` inside each frame.
+static struct benchmark_summary
+benchmark_summarize(const struct benchmark *b, size_t offset) {
+	struct benchmark_summary ret = {0};
+	if (b->nframes == 0) {
+		return ret;
+	}
+	auto values = ccalloc(b->nframes, uint64_t);
+	for (int i = 0; i < b->nframes; i++) {
+		memcpy(&values[i], (const char *)&b->frames[i] + offset, sizeof(uint64_t));
+		ret.total += values[i];
+	}
+	qsort(values, (size_t)b->nframes, sizeof(uint64_t), cmp_uint64);
+	// Nearest-rank percentiles
+	ret.min = values[0];
+	ret.p50 = values[(b->nframes * 50 + 99) / 100 - 1];
+	ret.p99 = values[(b->nframes * 99 + 99) / 100 - 1];
+	ret.max = values[b->nframes - 1];
+	free(values);
+	return ret;
+}
+
+static const struct {
+	const char *name;
+	size_t offset;
+} benchmark_metrics[] = {
+    {"wall_us", offsetof(struct benchmark_frame, wall_us)},
+    {"cpu_us", offsetof(struct benchmark_frame, cpu_us)},
+    {"allocations", offsetof(struct benchmark_frame, allocations)},
+    {"region_ops", offsetof(struct benchmark_frame, region_ops)},
+    {"region_rects", offsetof(struct benchmark_frame, region_rects)},
+};
+
+bool benchmark_write_report(const struct benchmark *b, const char *backend_name,
+                            int nwindows, FILE *f) {
+	fprintf(f, "{\n  \"backend\": \"%s\",\n  \"windows\": %d,\n  \"frames\": %d,\n",
+	        backend_name, nwindows, b->nframes);
+
+	fprintf(f, "  \"summary\": {\n");
+	for (size_t i = 0; i < ARR_SIZE(benchmark_metrics); i++) {
+		auto s = benchmark_summarize(b, benchmark_metrics[i].offset);
+		fprintf(f,
+		        "    \"%s\": {\"total\": %" PRIu64 ", \"min\": %" PRIu64
+		        ", \"p50\": %" PRIu64 ", \"p99\": %" PRIu64 ", \"max\": %" PRIu64 "}%s\n",
+		        benchmark_metrics[i].name, s.total, s.min, s.p50, s.p99, s.max,
+		        i + 1 < ARR_SIZE(benchmark_metrics) ? "," : "");
+	}
+	fprintf(f, "  },\n");
+
+	fprintf(f, "  \"per_frame\": [\n");
+	for (int i = 0; i < b->nframes; i++) {
+		auto fr = &b->frames[i];
+		fprintf(f,
+		        "    {\"wall_us\": %" PRIu64 ", \"cpu_us\": %" PRIu64
+		        ", \"allocations\": %" PRIu64 ", \"region_ops\": %" PRIu64
+		        ", \"region_rects\": %" PRIu64 "}%s\n",
+		        fr->wall_us, fr->cpu_us, fr->allocations, fr->region_ops,
+		        fr->region_rects, i + 1 < b->nframes ? "," : "");
+	}
+	fprintf(f, "  ]\n}\n");
+	return !ferror(f);
+}
+
+TEST_CASE(benchmark_summarize) {
+	struct benchmark b;
+	benchmark_init(&b, 100);
+	for (int i = 0; i < 100; i++) {
+		// Insert in reverse so the summary has to sort
+		b.frames[b.nframes++].cpu_us = (uint64_t)(100 - i);
+	}
+	auto s = benchmark_summarize(&b, offsetof(struct benchmark_frame, cpu_us));
+	TEST_EQUAL(s.total, 5050);
+	TEST_EQUAL(s.min, 1);
+	TEST_EQUAL(s.p50, 50);
+	TEST_EQUAL(s.p99, 99);
+	TEST_EQUAL(s.max, 100);
+
+	// Frames beyond the capacity are dropped
+	benchmark_end_frame(&b, NULL);
+	TEST_EQUAL(b.nframes, 100);
+	benchmark_deinit(&b);
+}
@@ -0,0 +1,51 @@
+// SPDX-License-Identifier: MPL-2.0
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+struct backend_base;
+
+/// Measurements of a single frame painted in benchmark mode
+struct benchmark_frame {
+	/// Wall clock time spent in the draw callback
+	uint64_t wall_us;
+	/// CPU time used by the process during the draw callback
+	uint64_t cpu_us;
+	/// Number of allocations made through the c*alloc wrappers
+	uint64_t allocations;
+	/// Number of backend operations that took a region
+	uint64_t region_ops;
+	/// Number of rectangles in the regions of those operations
+	uint64_t region_rects;
+};
+
+/// Per-frame measurements collected by `--benchmark`, written out as JSON when
+/// the session ends.
+struct benchmark {
+	struct benchmark_frame *frames;
+	int nframes;
+	int capacity;
+
+	// Counter values at the start of the current frame
+	uint64_t wall_start_us;
+	uint64_t cpu_start_us;
+	uint64_t allocations_start;
+	uint64_t region_ops_start;
+	uint64_t region_rects_start;
+};
+
+/// Prepare to record up to `nframes` frames.
+void benchmark_init(struct benchmark *, int nframes);
+void benchmark_deinit(struct benchmark *);
+
+/// Start measuring a frame. `backend` may be NULL when the legacy backends are used,
+/// in which case no region operations are counted.
+void benchmark_begin_frame(struct benchmark *, const struct backend_base *backend);
+/// Finish measuring the frame started by the last `benchmark_begin_frame`.
+void benchmark_end_frame(struct benchmark *, const struct backend_base *backend);
+
+/// Write the collected measurements to `f` as a JSON object. `backend_name` and
+/// `nwindows` describe the scene that was benchmarked.
+bool benchmark_write_report(const struct benchmark *, const char *backend_name,
+                            int nwindows, FILE *f);
@@ -30,8 +30,11 @@
 #endif
 
 #include <X11/Xlib.h>
+#include <uthash.h>
 #include <xcb/xcb.h>
 
+#include <test.h>
+
 #include "atom.h"
 #include "common.h"
 #include "compiler.h"
@@ -148,6 +151,13 @@ struct _c2_l {
 	} ptntype;
 	char *ptnstr;
 	long ptnint;
+	/// Index of the target in the tracked properties of `c2_state`, if it's
+	/// not a predefined one
+	unsigned prop;
+	/// String matcher of the target the leaf is in, and index of the leaf in it
+	/// plus one, 0 if it's not in one
+	struct c2_string_matcher *string_matcher;
+	unsigned string_leaf;
 #ifdef CONFIG_REGEX_PCRE
 	pcre *regex_pcre;
 	pcre_extra *regex_pcre_extra;
@@ -165,16 +175,264 @@ struct _c2_l {
 
 static const c2_l_t leaf_def = C2_L_INIT;
 
+/// Instructions of a compiled condition. A program computes its result in a single
+/// boolean accumulator, with jumps for the short-circuiting operators, so it runs
+/// in one pass over a flat array instead of recursing down the condition tree.
+enum c2_opcode {
+	/// Set the accumulator to the result of a leaf
+	C2_OP_LEAF,
+	/// Skip `offset` instructions forward if the accumulator is false
+	C2_OP_JUMP_IF_FALSE,
+	/// Skip `offset` instructions forward if the accumulator is true
+	C2_OP_JUMP_IF_TRUE,
+	/// Push the accumulator on the stack
+	C2_OP_PUSH,
+	/// Pop a value off the stack, and set the accumulator to whether they differ
+	C2_OP_XOR,
+	/// Negate the accumulator
+	C2_OP_NOT,
+};
+
+struct c2_instr {
+	enum c2_opcode op;
+	union {
+		const c2_l_t *leaf;
+		unsigned offset;
+	};
+};
+
+/// Most values a compiled condition can have on its stack at once. The stack is
+/// the bits of an integer.
+#define C2_MAX_STACK 64
+
+/// Number of predefined targets
+#define C2_NPREDEFS (C2_L_PROLE + 1)
+/// Number of predefined string targets
+#define C2_NSTRING_PREDEFS 5
+/// Tracked properties are told apart by their index modulo this in the
+/// dependencies of a condition. Those sharing a bit are taken as one.
+#define C2_PROP_BITS 64
+
+/// What the result of conditions depends on
+struct c2_deps {
+	/// Predefined targets read, one bit per target
+	uint32_t predefs;
+	/// Tracked properties read, one bit per index modulo C2_PROP_BITS
+	uint64_t props;
+};
+
+/// Lists with fewer conditions that have a key than this are not indexed
+#define C2_INDEX_MIN_KEYED 8
+/// Kinds of keys a condition can be indexed by: the predefined string target its
+/// leading test compares, and whether it ignores case
+#define C2_INDEX_NKINDS (C2_NSTRING_PREDEFS * 2)
+
+/// Conditions whose leading test compares a predefined string target with the
+/// same string
+struct c2_index_bucket {
+	/// The string, folded to lower case for the kinds that ignore case
+	char *key;
+	/// Positions of the conditions in the list, in order
+	unsigned *conds;
+	unsigned nconds, capacity;
+	UT_hash_handle hh;
+};
+
+/// Index of a condition list. A condition that only matches if a predefined
+/// string target equals a given string is only tried for windows whose target is
+/// that string, so matching a window doesn't have to go through all conditions.
+struct c2_index {
+	/// All conditions of the list, in order
+	const struct _c2_lptr **conds;
+	unsigned nconds;
+	/// Conditions with a key, by kind
+	struct c2_index_bucket *buckets[C2_INDEX_NKINDS];
+	/// Positions of the conditions without a key, in order
+	unsigned *unkeyed;
+	unsigned nunkeyed;
+};
+
 /// Linked list type of conditions.
 struct _c2_lptr {
 	c2_ptr_t ptr;
 	void *data;
 	struct _c2_lptr *next;
+	/// `ptr` compiled by c2_list_postprocess, NULL until then
+	struct c2_instr *code;
+	unsigned ncode;
+	/// What this condition and all the ones before it in the list read. If it's
+	/// the first one to match, the result of the list only changes when one
+	/// of those does.
+	struct c2_deps deps;
+	/// Index of the list in `c2_state` plus one, on the first condition of a
+	/// postprocessed list only, otherwise 0
+	unsigned list;
+	/// Index of the list, on the first condition of a postprocessed list that
+	/// has enough conditions with a key, otherwise NULL
+	struct c2_index *index;
 };
 
 /// Initializer for c2_lptr_t.
 #define C2_LPTR_INIT                                                                     \
-	{ .ptr = C2_PTR_INIT, .data = NULL, .next = NULL, }
+	{ .ptr = C2_PTR_INIT, .data = NULL, .next = NULL, .code = NULL, .ncode = 0,      \
+	  .deps = {0}, .list = 0, .index = NULL, }
+
+/// A window property read by the conditions, and how it's read
+struct c2_tracked_property {
+	xcb_atom_t atom;
+	/// Whether it's read from the client window rather than the frame
+	bool onframe;
+	enum c2_l_type type;
+	int format;
+	/// Whether it's read as strings, rather than as numbers
+	bool as_string;
+	/// How much of the property is read, in 32-bit units. Text properties are
+	/// always read in full.
+	int length;
+};
+
+/// Node of an Aho-Corasick automaton
+struct c2_ac_node {
+	/// Children of the node, by the byte leading to them
+	struct c2_ac_edge {
+		unsigned char byte;
+		unsigned node;
+	} *edges;
+	unsigned nedges;
+	/// Node of the longest proper suffix of this one that's in the automaton
+	unsigned fail;
+	/// Nearest node down the failure links that ends a pattern, 0 if none
+	unsigned dict;
+	/// Index of the pattern ending at this node plus one, 0 if none
+	unsigned pattern;
+};
+
+/// Aho-Corasick automaton, which finds all occurrences of a set of patterns in a
+/// single pass over a string. Node 0 is the root.
+struct c2_ac {
+	struct c2_ac_node *nodes;
+	unsigned nnodes, capacity;
+	/// Transitions out of the root, which are taken the most
+	unsigned root[256];
+};
+
+/// A literal string the leaves of a string matcher compare their target with
+struct c2_string_pattern {
+	/// Folded to lower case for leaves that ignore case
+	char *str;
+	size_t len;
+	bool folded;
+};
+
+/// Occurrences of a pattern found in a string
+enum {
+	C2_HIT_ANY = 1,
+	C2_HIT_PREFIX = 2,
+	C2_HIT_EXACT = 4,
+};
+
+/// Matches all leaves of the conditions that test a predefined string target in one
+/// pass over the string. Literal patterns, whether matched exactly, at the start,
+/// or anywhere, are found with an Aho-Corasick automaton. The regular expressions
+/// are first tried all at once, joined into one, so none of them has to be tried
+/// on its own unless that one matches.
+struct c2_string_matcher {
+	struct c2_string_pattern *patterns;
+	unsigned npatterns, patterns_capacity;
+	struct c2_string_leaf {
+		c2_l_t *leaf;
+		/// Index of the pattern, for leaves that don't match a regex
+		unsigned pattern;
+		/// Whether the regex of the leaf is part of the joined one
+		bool joined;
+	} *leaves;
+	unsigned nleaves, leaves_capacity;
+
+	/// Whether the automata and the joined regex are up to date with the
+	/// patterns. `version` changes every time they are built.
+	bool built;
+	unsigned version;
+	/// Automata for the patterns that keep their case, and for the folded ones
+	struct c2_ac ac[2];
+#ifdef CONFIG_REGEX_PCRE
+	pcre *regex_pcre;
+	pcre_extra *regex_pcre_extra;
+#endif
+	/// What was found of each pattern in the string being matched
+	uint8_t *hits;
+};
+
+struct c2_state {
+	struct c2_string_matcher strings[C2_NSTRING_PREDEFS];
+	struct c2_tracked_property *props;
+	unsigned nprops, capacity;
+	/// What each postprocessed condition list reads, by their index
+	struct c2_deps *lists;
+	unsigned nlists;
+};
+
+/// Value of a tracked property of a window
+struct c2_property_value {
+	/// Number of values, 0 if the window doesn't have the property, or it has the
+	/// wrong type
+	unsigned n;
+	union {
+		long long *numbers;
+		/// Strings of a text property share one allocation with the array,
+		/// names of atoms are borrowed from the atom cache of the session.
+		/// Names of atoms that couldn't be resolved are NULL.
+		char **strings;
+		const char **names;
+	};
+};
+
+/// Last seen value of a predefined target of a window
+struct c2_predef_value {
+	union {
+		long long number;
+		/// Copy of the string, for name, class_g, class_i and role
+		char *string;
+	};
+	/// Generation of the window when the value last changed
+	uint64_t generation;
+};
+
+/// Result of a condition list for a window
+struct c2_memo {
+	/// Generation of the window when the list was matched, 0 if it never was
+	uint64_t generation;
+	/// The condition that matched, NULL if none did
+	const c2_lptr_t *result;
+};
+
+/// Results of the leaves of a string matcher for a window
+struct c2_string_results {
+	/// Whether there are results, for which generation of the target, and
+	/// which version of the matcher
+	bool valid;
+	uint64_t generation;
+	unsigned version;
+	/// One bit per leaf
+	uint64_t *bits;
+	unsigned nwords;
+};
+
+struct c2_window_props {
+	/// Counts the changes of the values the conditions read. Every change
+	/// gets its own generation.
+	uint64_t generation;
+	struct c2_predef_value predefs[C2_NPREDEFS];
+	struct c2_string_results strings[C2_NSTRING_PREDEFS];
+	/// Generation when a tracked property last changed, by index modulo
+	/// C2_PROP_BITS
+	uint64_t prop_generations[C2_PROP_BITS];
+	/// Last result of each postprocessed condition list, by their index
+	struct c2_memo *memos;
+	unsigned nmemos;
+
+	unsigned n;
+	struct c2_property_value values[];
+};
 
 /// Structure representing a predefined target.
 typedef struct {
@@ -211,6 +469,24 @@ static const c2_predef_t C2_PREDEFS[] = {
     [C2_L_PROLE] = {"role", C2_L_TSTRING, 0},
 };
 
+// Predefined string targets
+static const int C2_STRING_PREDEFS[C2_NSTRING_PREDEFS] = {
+    C2_L_PNAME, C2_L_PCLASSG, C2_L_PCLASSI, C2_L_PROLE, C2_L_PWINDOWTYPE,
+};
+
+/**
+ * Get the index of a predefined target in C2_STRING_PREDEFS, or -1 if it's not
+ * a string target.
+ */
+static inline int c2_string_predef_index(int predef) {
+	for (int i = 0; i < C2_NSTRING_PREDEFS; i++) {
+		if (C2_STRING_PREDEFS[i] == predef) {
+			return i;
+		}
+	}
+	return -1;
+}
+
 /**
  * Get the numeric property value from a win_prop_t.
  */
@@ -331,9 +607,7 @@ static const char *c2h_dump_str_type(const c2_l_t *pleaf);
 
 static void attr_unused c2_dump(c2_ptr_t p);
 
-static xcb_atom_t c2_get_atom_type(const c2_l_t *pleaf);
-
-static bool c2_match_once(session_t *ps, const struct managed_win *w, const c2_ptr_t cond);
+static xcb_atom_t c2_get_atom_type(enum c2_l_type type);
 
 /**
  * Parse a condition string.
@@ -1010,6 +1284,419 @@ fail:
 
 #undef c2_error
 
+/**
+ * Register the property read by a leaf in the tracked properties, and return its
+ * index there.
+ */
+static unsigned c2_state_track(struct c2_state *state, const c2_l_t *pleaf) {
+	// All of the property for [*], otherwise just enough to reach the indexed item
+	int length = INT_MAX;
+	if (pleaf->index >= 0) {
+		long long bits = ((long long)pleaf->index + 1) * (pleaf->format ?: 32);
+		length = (int)min2((bits + 31) / 32, INT_MAX);
+	}
+	bool as_string = C2_L_PTSTRING == pleaf->ptntype;
+
+	for (unsigned i = 0; i < state->nprops; i++) {
+		auto p = &state->props[i];
+		if (p->atom == pleaf->tgtatom && p->onframe == pleaf->tgt_onframe &&
+		    p->type == pleaf->type && p->format == pleaf->format &&
+		    p->as_string == as_string) {
+			p->length = max2(p->length, length);
+			return i;
+		}
+	}
+
+	if (state->nprops == state->capacity) {
+		state->capacity = max2(state->capacity * 2, 8U);
+		state->props = crealloc(state->props, state->capacity);
+	}
+	state->props[state->nprops] = (struct c2_tracked_property){
+	    .atom = pleaf->tgtatom,
+	    .onframe = pleaf->tgt_onframe,
+	    .type = pleaf->type,
+	    .format = pleaf->format,
+	    .as_string = as_string,
+	    .length = length,
+	};
+	return state->nprops++;
+}
+
+/**
+ * Find the child of an automaton node reached with `byte`, 0 if there is none.
+ */
+static inline unsigned c2_ac_child(const struct c2_ac_node *node, unsigned char byte) {
+	for (unsigned i = 0; i < node->nedges; i++) {
+		if (node->edges[i].byte == byte) {
+			return node->edges[i].node;
+		}
+	}
+	return 0;
+}
+
+/**
+ * Get the node an automaton goes to from `state` when it reads `byte`.
+ */
+static inline unsigned c2_ac_next(const struct c2_ac *ac, unsigned state, unsigned char byte) {
+	while (state) {
+		unsigned next = c2_ac_child(&ac->nodes[state], byte);
+		if (next) {
+			return next;
+		}
+		state = ac->nodes[state].fail;
+	}
+	return ac->root[byte];
+}
+
+static void c2_ac_deinit(struct c2_ac *ac) {
+	for (unsigned i = 0; i < ac->nnodes; i++) {
+		free(ac->nodes[i].edges);
+	}
+	free(ac->nodes);
+	*ac = (struct c2_ac){0};
+}
+
+static unsigned c2_ac_add_node(struct c2_ac *ac) {
+	if (ac->nnodes == ac->capacity) {
+		ac->capacity = max2(ac->capacity * 2, 16U);
+		ac->nodes = crealloc(ac->nodes, ac->capacity);
+	}
+	ac->nodes[ac->nnodes] = (struct c2_ac_node){0};
+	return ac->nnodes++;
+}
+
+/**
+ * Build an automaton finding the non-empty patterns that are `folded`, or not.
+ */
+static void c2_ac_build(struct c2_ac *ac, const struct c2_string_pattern *patterns,
+                        unsigned npatterns, bool folded) {
+	c2_ac_deinit(ac);
+	c2_ac_add_node(ac);
+	for (unsigned i = 0; i < npatterns; i++) {
+		if (patterns[i].folded != folded || !patterns[i].len) {
+			continue;
+		}
+		unsigned node = 0;
+		for (size_t j = 0; j < patterns[i].len; j++) {
+			auto byte = (unsigned char)patterns[i].str[j];
+			unsigned next = c2_ac_child(&ac->nodes[node], byte);
+			if (!next) {
+				next = c2_ac_add_node(ac);
+				auto n = &ac->nodes[node];
+				n->edges = crealloc(n->edges, n->nedges + 1);
+				n->edges[n->nedges++] = (struct c2_ac_edge){.byte = byte, .node = next};
+			}
+			node = next;
+		}
+		ac->nodes[node].pattern = i + 1;
+	}
+
+	// Failure links point to the root from the first level, and are found from
+	// the ones of the level above for the others
+	auto queue = ccalloc(ac->nnodes, unsigned);
+	unsigned head = 0, tail = 0;
+	for (unsigned i = 0; i < ac->nodes[0].nedges; i++) {
+		ac->root[ac->nodes[0].edges[i].byte] = ac->nodes[0].edges[i].node;
+		queue[tail++] = ac->nodes[0].edges[i].node;
+	}
+	while (head < tail) {
+		unsigned parent = queue[head++];
+		for (unsigned i = 0; i < ac->nodes[parent].nedges; i++) {
+			auto edge = ac->nodes[parent].edges[i];
+			unsigned fail = c2_ac_next(ac, ac->nodes[parent].fail, edge.byte);
+			ac->nodes[edge.node].fail = fail;
+			ac->nodes[edge.node].dict =
+			    ac->nodes[fail].pattern ? fail : ac->nodes[fail].dict;
+			queue[tail++] = edge.node;
+		}
+	}
+	free(queue);
+}
+
+/**
+ * Record in `hits` what an automaton finds of its patterns in `str`.
+ */
+static void c2_ac_run(const struct c2_ac *ac, const struct c2_string_pattern *patterns,
+                      const char *str, size_t len, bool fold, uint8_t *hits) {
+	if (ac->nnodes <= 1) {
+		return;
+	}
+	unsigned state = 0;
+	for (size_t i = 0; i < len; i++) {
+		auto byte = (unsigned char)str[i];
+		state = c2_ac_next(ac, state, fold ? (unsigned char)tolower(byte) : byte);
+		unsigned node = ac->nodes[state].pattern ? state : ac->nodes[state].dict;
+		for (; node; node = ac->nodes[node].dict) {
+			unsigned p = ac->nodes[node].pattern - 1;
+			hits[p] |= C2_HIT_ANY;
+			if (i + 1 == patterns[p].len) {
+				hits[p] |= C2_HIT_PREFIX | (i + 1 == len ? C2_HIT_EXACT : 0);
+			}
+		}
+	}
+}
+
+/**
+ * Add a pattern to a string matcher, unless it's already there, and return its
+ * index.
+ */
+static unsigned
+c2_string_matcher_add_pattern(struct c2_string_matcher *m, const char *str, bool folded) {
+	char *pattern = strdup(str);
+	if (folded) {
+		for (char *pc = pattern; *pc; pc++) {
+			*pc = (char)tolower((unsigned char)*pc);
+		}
+	}
+	for (unsigned i = 0; i < m->npatterns; i++) {
+		if (m->patterns[i].folded == folded && !strcmp(m->patterns[i].str, pattern)) {
+			free(pattern);
+			return i;
+		}
+	}
+
+	if (m->npatterns == m->patterns_capacity) {
+		m->patterns_capacity = max2(m->patterns_capacity * 2, 8U);
+		m->patterns = crealloc(m->patterns, m->patterns_capacity);
+	}
+	m->patterns[m->npatterns] = (struct c2_string_pattern){
+	    .str = pattern,
+	    .len = strlen(pattern),
+	    .folded = folded,
+	};
+	return m->npatterns++;
+}
+
+/**
+ * Add a leaf to the string matcher of its target, if it can be matched by one.
+ * Must be done after the regex of the leaf is compiled.
+ */
+static void c2_string_matcher_add(struct c2_state *state, c2_l_t *pleaf) {
+	int target = c2_string_predef_index(pleaf->predef);
+	if (target < 0 || C2_L_OEQ != pleaf->op || C2_L_PTSTRING != pleaf->ptntype ||
+	    C2_L_MWILDCARD == pleaf->match) {
+		return;
+	}
+
+	auto m = &state->strings[target];
+	if (m->nleaves == m->leaves_capacity) {
+		m->leaves_capacity = max2(m->leaves_capacity * 2, 8U);
+		m->leaves = crealloc(m->leaves, m->leaves_capacity);
+	}
+	m->leaves[m->nleaves] = (struct c2_string_leaf){.leaf = pleaf};
+	if (C2_L_MPCRE != pleaf->match) {
+		m->leaves[m->nleaves].pattern = c2_string_matcher_add_pattern(
+		    m, pleaf->ptnstr, pleaf->match_ignorecase);
+	}
+	pleaf->string_matcher = m;
+	pleaf->string_leaf = ++m->nleaves;
+	m->built = false;
+}
+
+/**
+ * Take a leaf that's being freed out of its string matcher. Its slot is left
+ * empty, and never matches.
+ */
+static void c2_string_matcher_remove(c2_l_t *pleaf) {
+	auto m = pleaf->string_matcher;
+	m->leaves[pleaf->string_leaf - 1].leaf = NULL;
+	// Rejoin the regexes without this one
+	m->built = false;
+	pleaf->string_matcher = NULL;
+	pleaf->string_leaf = 0;
+}
+
+#ifdef CONFIG_REGEX_PCRE
+/**
+ * Whether a regex still means the same once joined with others. Back references
+ * would refer to other groups, and quoting, comments or options could spill over
+ * the other regexes.
+ */
+static bool c2_regex_joinable(const char *ptn) {
+	for (const char *pc = ptn; *pc; pc++) {
+		if ('(' == pc[0] && ('?' == pc[1] || '*' == pc[1])) {
+			return false;
+		}
+		if ('\\' == pc[0]) {
+			if (!pc[1] || isdigit((unsigned char)pc[1]) || strchr("Qgk", pc[1])) {
+				return false;
+			}
+			pc++;
+		}
+	}
+	return true;
+}
+
+/**
+ * Join the regexes of a string matcher that can be, into one matching whenever
+ * any of them does.
+ */
+static void c2_string_matcher_join_regex(struct c2_string_matcher *m) {
+	pcre_free(m->regex_pcre);
+	if (m->regex_pcre_extra) {
+		LPCRE_FREE_STUDY(m->regex_pcre_extra);
+	}
+	m->regex_pcre = NULL;
+	m->regex_pcre_extra = NULL;
+
+	size_t len = 1;
+	unsigned njoined = 0;
+	for (unsigned i = 0; i < m->nleaves; i++) {
+		auto l = &m->leaves[i];
+		l->joined = l->leaf && C2_L_MPCRE == l->leaf->match &&
+		            c2_regex_joinable(l->leaf->ptnstr);
+		if (l->joined) {
+			len += strlen(l->leaf->ptnstr) + sizeof("|(?i:)");
+			njoined++;
+		}
+	}
+	// Nothing to gain from a single regex
+	if (njoined < 2) {
+		for (unsigned i = 0; i < m->nleaves; i++) {
+			m->leaves[i].joined = false;
+		}
+		return;
+	}
+
+	auto joined = ccalloc(len, char);
+	for (unsigned i = 0; i < m->nleaves; i++) {
+		auto pleaf = m->leaves[i].leaf;
+		if (m->leaves[i].joined) {
+			if (*joined) {
+				strcat(joined, "|");
+			}
+			strcat(joined, pleaf->match_ignorecase ? "(?i:" : "(?:");
+			strcat(joined, pleaf->ptnstr);
+			strcat(joined, ")");
+		}
+	}
+
+	const char *error = NULL;
+	int erroffset = 0;
+	m->regex_pcre = pcre_compile(joined, 0, &error, &erroffset, NULL);
+	if (!m->regex_pcre) {
+		log_debug("Failed to join regular expressions \"%s\", they will be "
+		          "matched one by one: %s",
+		          joined, error);
+		for (unsigned i = 0; i < m->nleaves; i++) {
+			m->leaves[i].joined = false;
+		}
+	}
+#ifdef CONFIG_REGEX_PCRE_JIT
+	else {
+		m->regex_pcre_extra =
+		    pcre_study(m->regex_pcre, PCRE_STUDY_JIT_COMPILE, &error);
+	}
+#endif
+	free(joined);
+}
+#endif
+
+/**
+ * Build the automata and the joined regex of a string matcher.
+ */
+static void c2_string_matcher_build(struct c2_string_matcher *m) {
+	for (int folded = 0; folded < 2; folded++) {
+		c2_ac_build(&m->ac[folded], m->patterns, m->npatterns, folded);
+	}
+	m->hits = crealloc(m->hits, m->npatterns ?: 1);
+#ifdef CONFIG_REGEX_PCRE
+	c2_string_matcher_join_regex(m);
+#endif
+	m->built = true;
+	m->version++;
+}
+
+static void c2_string_matcher_deinit(struct c2_string_matcher *m) {
+	// Leaves that outlive the matcher
+	for (unsigned i = 0; i < m->nleaves; i++) {
+		if (m->leaves[i].leaf) {
+			m->leaves[i].leaf->string_matcher = NULL;
+			m->leaves[i].leaf->string_leaf = 0;
+		}
+	}
+	for (unsigned i = 0; i < m->npatterns; i++) {
+		free(m->patterns[i].str);
+	}
+	free(m->patterns);
+	free(m->leaves);
+	for (int folded = 0; folded < 2; folded++) {
+		c2_ac_deinit(&m->ac[folded]);
+	}
+#ifdef CONFIG_REGEX_PCRE
+	pcre_free(m->regex_pcre);
+	if (m->regex_pcre_extra) {
+		LPCRE_FREE_STUDY(m->regex_pcre_extra);
+	}
+#endif
+	free(m->hits);
+	*m = (struct c2_string_matcher){0};
+}
+
+/**
+ * Match all leaves of a string matcher against `str`, and set the bits of the ones
+ * that matched in `bits`, without their negation applied.
+ */
+static void c2_string_matcher_run(struct c2_string_matcher *m, const char *str,
+                                  uint64_t *bits, unsigned nwords) {
+	memset(bits, 0, nwords * sizeof(*bits));
+	// A missing target never matches
+	if (!str) {
+		return;
+	}
+	if (!m->built) {
+		c2_string_matcher_build(m);
+	}
+
+	size_t len = strlen(str);
+	memset(m->hits, 0, m->npatterns);
+	for (int folded = 0; folded < 2; folded++) {
+		c2_ac_run(&m->ac[folded], m->patterns, str, len, folded, m->hits);
+	}
+	for (unsigned i = 0; i < m->npatterns; i++) {
+		if (!m->patterns[i].len) {
+			m->hits[i] = C2_HIT_ANY | C2_HIT_PREFIX | (len ? 0 : C2_HIT_EXACT);
+		}
+	}
+
+#ifdef CONFIG_REGEX_PCRE
+	// The regexes that are joined don't match unless the joined one does
+	assert(len <= INT_MAX);
+	bool try_joined = true;
+	if (m->regex_pcre) {
+		try_joined = pcre_exec(m->regex_pcre, m->regex_pcre_extra, str, (int)len,
+		                       0, 0, NULL, 0) != PCRE_ERROR_NOMATCH;
+	}
+#endif
+
+	for (unsigned i = 0; i < m->nleaves; i++) {
+		auto l = &m->leaves[i];
+		if (!l->leaf) {
+			continue;
+		}
+		bool res = false;
+		switch (l->leaf->match) {
+		case C2_L_MEXACT: res = m->hits[l->pattern] & C2_HIT_EXACT; break;
+		case C2_L_MSTART: res = m->hits[l->pattern] & C2_HIT_PREFIX; break;
+		case C2_L_MCONTAINS: res = m->hits[l->pattern] & C2_HIT_ANY; break;
+		case C2_L_MPCRE:
+#ifdef CONFIG_REGEX_PCRE
+			if (try_joined || !l->joined) {
+				res = pcre_exec(l->leaf->regex_pcre, l->leaf->regex_pcre_extra,
+				                str, (int)len, 0, 0, NULL, 0) >= 0;
+			}
+#else
+			assert(0);
+#endif
+			break;
+		default: assert(0); break;
+		}
+		if (res) {
+			bits[i / 64] |= 1ULL << (i % 64);
+		}
+	}
+}
+
 /**
  * Do postprocessing on a condition leaf.
  */
@@ -1026,6 +1713,7 @@ static bool c2_l_postprocess(session_t *ps, c2_l_t *pleaf) {
 			log_error("Failed to get atom for target \"%s\".", pleaf->tgt);
 			return false;
 		}
+		pleaf->prop = c2_state_track(ps->c2_state, pleaf);
 	}
 
 	// Insert target Atom into atom track list
@@ -1095,6 +1783,7 @@ static bool c2_l_postprocess(session_t *ps, c2_l_t *pleaf) {
 #endif
 	}
 
+	c2_string_matcher_add(ps->c2_state, pleaf);
 	return true;
 }
 
@@ -1107,61 +1796,288 @@ static bool c2_tree_postprocess(session_t *ps, c2_ptr_t node) {
 	return c2_tree_postprocess(ps, node.b->opr2);
 }
 
-bool c2_list_postprocess(session_t *ps, c2_lptr_t *list) {
-	c2_lptr_t *head = list;
-	while (head) {
-		if (!c2_tree_postprocess(ps, head->ptr))
-			return false;
-		head = head->next;
+/**
+ * Get the number of instructions a condition tree compiles to.
+ */
+static unsigned c2_code_size(c2_ptr_t node) {
+	if (!node.isbranch || !node.b) {
+		return 1;
 	}
-	return true;
+	return c2_code_size(node.b->opr1) + c2_code_size(node.b->opr2) +
+	       (C2_B_OXOR == node.b->op ? 2 : 1) + node.b->neg;
 }
+
 /**
- * Free a condition tree.
+ * Write the instructions of a condition tree to `code`, starting at `pos`.
+ *
+ * @param depth stack depth when the instructions start
+ * @param max_depth updated with the deepest the stack gets
+ * @return position after the last instruction written
  */
-static void c2_free(c2_ptr_t p) {
-	// For a branch element
-	if (p.isbranch) {
-		c2_b_t *const pbranch = p.b;
-
-		if (!pbranch)
-			return;
-
-		c2_free(pbranch->opr1);
-		c2_free(pbranch->opr2);
-		free(pbranch);
+static unsigned c2_compile_node(struct c2_instr *code, unsigned pos, c2_ptr_t node,
+                                unsigned depth, unsigned *max_depth) {
+	// A missing tree never matches
+	if (!node.isbranch || !node.b) {
+		code[pos].op = C2_OP_LEAF;
+		code[pos].leaf = node.isbranch ? NULL : node.l;
+		return pos + 1;
 	}
-	// For a leaf element
-	else {
-		c2_l_t *const pleaf = p.l;
-
-		if (!pleaf)
-			return;
 
-		free(pleaf->tgt);
-		free(pleaf->ptnstr);
-#ifdef CONFIG_REGEX_PCRE
-		pcre_free(pleaf->regex_pcre);
-		LPCRE_FREE_STUDY(pleaf->regex_pcre_extra);
-#endif
-		free(pleaf);
+	const c2_b_t *pb = node.b;
+	pos = c2_compile_node(code, pos, pb->opr1, depth, max_depth);
+	switch (pb->op) {
+	case C2_B_OAND:
+	case C2_B_OOR: {
+		// Skip the second operand if the first one decides the result
+		unsigned jump = pos;
+		code[jump].op = C2_B_OAND == pb->op ? C2_OP_JUMP_IF_FALSE : C2_OP_JUMP_IF_TRUE;
+		pos = c2_compile_node(code, jump + 1, pb->opr2, depth, max_depth);
+		code[jump].offset = pos - jump;
+	} break;
+	case C2_B_OXOR:
+		code[pos++].op = C2_OP_PUSH;
+		*max_depth = max2(*max_depth, depth + 1);
+		pos = c2_compile_node(code, pos, pb->opr2, depth + 1, max_depth);
+		code[pos++].op = C2_OP_XOR;
+		break;
+	default: assert(0); break;
 	}
+	if (pb->neg) {
+		code[pos++].op = C2_OP_NOT;
+	}
+	return pos;
 }
 
 /**
- * Free a condition tree in c2_lptr_t.
+ * Compile the condition tree of a list element.
  */
-c2_lptr_t *c2_free_lptr(c2_lptr_t *lp, c2_userdata_free f) {
-	if (!lp) {
-		return NULL;
+static bool c2_compile(c2_lptr_t *lp) {
+	unsigned size = c2_code_size(lp->ptr);
+	unsigned max_depth = 0;
+	auto code = ccalloc(size, struct c2_instr);
+	unsigned ncode = c2_compile_node(code, 0, lp->ptr, 0, &max_depth);
+	assert(ncode <= size);
+	if (max_depth > C2_MAX_STACK) {
+		log_error("Condition has too many nested XOR operators.");
+		free(code);
+		return false;
 	}
 
-	c2_lptr_t *pnext = lp->next;
-	if (f) {
-		f(lp->data);
-	}
+	free(lp->code);
+	lp->code = code;
+	lp->ncode = ncode;
+	return true;
+}
+
+/**
+ * Add what a condition tree reads to `deps`. Must be done after the tree is
+ * postprocessed.
+ */
+static void c2_tree_deps(c2_ptr_t node, struct c2_deps *deps) {
+	if (node.isbranch) {
+		if (node.b) {
+			c2_tree_deps(node.b->opr1, deps);
+			c2_tree_deps(node.b->opr2, deps);
+		}
+		return;
+	}
+	const c2_l_t *pleaf = node.l;
+	if (!pleaf) {
+		return;
+	}
+	// Targets of the client window change with the client window
+	if (pleaf->tgt_onframe) {
+		deps->predefs |= 1U << C2_L_PCLIENT;
+	}
+	if (pleaf->predef == C2_L_PUNDEFINED) {
+		deps->props |= 1ULL << (pleaf->prop % C2_PROP_BITS);
+	} else {
+		deps->predefs |= 1U << pleaf->predef;
+	}
+}
+
+/**
+ * Get the leaf of the test a condition starts with, if that test has to pass for
+ * the condition to match, and only passes if a predefined string target equals a
+ * given string.
+ */
+static const c2_l_t *c2_index_key(c2_ptr_t node) {
+	while (node.isbranch) {
+		if (!node.b || node.b->neg || C2_B_OAND != node.b->op) {
+			return NULL;
+		}
+		node = node.b->opr1;
+	}
+	const c2_l_t *pleaf = node.l;
+	if (!pleaf || pleaf->neg || C2_L_OEQ != pleaf->op || C2_L_MEXACT != pleaf->match ||
+	    C2_L_PTSTRING != pleaf->ptntype) {
+		return NULL;
+	}
+	switch (pleaf->predef) {
+	case C2_L_PNAME:
+	case C2_L_PCLASSG:
+	case C2_L_PCLASSI:
+	case C2_L_PROLE:
+	case C2_L_PWINDOWTYPE: return pleaf;
+	default: return NULL;
+	}
+}
+
+/**
+ * Get the kind of the key of a condition.
+ */
+static int c2_index_kind(const c2_l_t *key) {
+	return c2_string_predef_index(key->predef) * 2 + key->match_ignorecase;
+}
+
+/**
+ * Fold a string to lower case, the way strcasecmp does.
+ */
+static char *c2_index_fold(const char *str) {
+	char *ret = strdup(str);
+	for (char *pc = ret; *pc; pc++) {
+		*pc = (char)tolower((unsigned char)*pc);
+	}
+	return ret;
+}
+
+static void c2_index_free(struct c2_index *index) {
+	if (!index) {
+		return;
+	}
+	for (int i = 0; i < C2_INDEX_NKINDS; i++) {
+		struct c2_index_bucket *b, *tmp;
+		HASH_ITER(hh, index->buckets[i], b, tmp) {
+			HASH_DEL(index->buckets[i], b);
+			free(b->key);
+			free(b->conds);
+			free(b);
+		}
+	}
+	free(index->conds);
+	free(index->unkeyed);
+	free(index);
+}
+
+/**
+ * Build the index of a condition list, or return NULL if it's not worth it.
+ */
+static struct c2_index *c2_index_new(const c2_lptr_t *list) {
+	unsigned nconds = 0, nkeyed = 0;
+	for (auto i = list; i; i = i->next) {
+		nconds++;
+		nkeyed += c2_index_key(i->ptr) != NULL;
+	}
+	if (nkeyed < C2_INDEX_MIN_KEYED) {
+		return NULL;
+	}
+
+	auto index = ccalloc(1, struct c2_index);
+	index->conds = ccalloc(nconds, const c2_lptr_t *);
+	index->unkeyed = ccalloc(nconds - nkeyed ?: 1, unsigned);
+	for (auto i = list; i; i = i->next) {
+		unsigned pos = index->nconds++;
+		index->conds[pos] = i;
+
+		const c2_l_t *key = c2_index_key(i->ptr);
+		if (!key) {
+			index->unkeyed[index->nunkeyed++] = pos;
+			continue;
+		}
+
+		int kind = c2_index_kind(key);
+		char *str = key->match_ignorecase ? c2_index_fold(key->ptnstr)
+		                                  : strdup(key->ptnstr);
+		struct c2_index_bucket *b = NULL;
+		HASH_FIND_STR(index->buckets[kind], str, b);
+		if (b) {
+			free(str);
+		} else {
+			b = ccalloc(1, struct c2_index_bucket);
+			b->key = str;
+			HASH_ADD_STR(index->buckets[kind], key, b);
+		}
+		if (b->nconds == b->capacity) {
+			b->capacity = max2(b->capacity * 2, 4U);
+			b->conds = crealloc(b->conds, b->capacity);
+		}
+		b->conds[b->nconds++] = pos;
+	}
+	return index;
+}
+
+bool c2_list_postprocess(session_t *ps, c2_lptr_t *list) {
+	struct c2_deps deps = {0};
+	c2_lptr_t *head = list;
+	while (head) {
+		if (!c2_tree_postprocess(ps, head->ptr) || !c2_compile(head))
+			return false;
+		c2_tree_deps(head->ptr, &deps);
+		head->deps = deps;
+		head = head->next;
+	}
+
+	// Give the list an index, so windows can remember its result
+	struct c2_state *state = ps->c2_state;
+	if (list && !list->list) {
+		state->lists = crealloc(state->lists, state->nlists + 1);
+		state->lists[state->nlists] = deps;
+		list->list = ++state->nlists;
+		list->index = c2_index_new(list);
+	}
+	return true;
+}
+/**
+ * Free a condition tree.
+ */
+static void c2_free(c2_ptr_t p) {
+	// For a branch element
+	if (p.isbranch) {
+		c2_b_t *const pbranch = p.b;
+
+		if (!pbranch)
+			return;
+
+		c2_free(pbranch->opr1);
+		c2_free(pbranch->opr2);
+		free(pbranch);
+	}
+	// For a leaf element
+	else {
+		c2_l_t *const pleaf = p.l;
+
+		if (!pleaf)
+			return;
+
+		if (pleaf->string_matcher) {
+			c2_string_matcher_remove(pleaf);
+		}
+		free(pleaf->tgt);
+		free(pleaf->ptnstr);
+#ifdef CONFIG_REGEX_PCRE
+		pcre_free(pleaf->regex_pcre);
+		LPCRE_FREE_STUDY(pleaf->regex_pcre_extra);
+#endif
+		free(pleaf);
+	}
+}
+
+/**
+ * Free a condition tree in c2_lptr_t.
+ */
+c2_lptr_t *c2_free_lptr(c2_lptr_t *lp, c2_userdata_free f) {
+	if (!lp) {
+		return NULL;
+	}
+
+	c2_lptr_t *pnext = lp->next;
+	if (f) {
+		f(lp->data);
+	}
 	lp->data = NULL;
 	c2_free(lp->ptr);
+	free(lp->code);
+	c2_index_free(lp->index);
 	free(lp);
 
 	return pnext;
@@ -1297,10 +2213,10 @@ static void c2_dump(c2_ptr_t p) {
 }
 
 /**
- * Get the type atom of a condition.
+ * Get the type atom of a target type.
  */
-static xcb_atom_t c2_get_atom_type(const c2_l_t *pleaf) {
-	switch (pleaf->type) {
+static xcb_atom_t c2_get_atom_type(enum c2_l_type type) {
+	switch (type) {
 	case C2_L_TCARDINAL: return XCB_ATOM_CARDINAL;
 	case C2_L_TWINDOW: return XCB_ATOM_WINDOW;
 	case C2_L_TSTRING: return XCB_ATOM_STRING;
@@ -1311,98 +2227,386 @@ static xcb_atom_t c2_get_atom_type(const c2_l_t *pleaf) {
 	unreachable;
 }
 
+struct c2_state *c2_state_new(void) {
+	return ccalloc(1, struct c2_state);
+}
+
+void c2_state_free(struct c2_state *state) {
+	if (!state) {
+		return;
+	}
+	for (int i = 0; i < C2_NSTRING_PREDEFS; i++) {
+		c2_string_matcher_deinit(&state->strings[i]);
+	}
+	free(state->props);
+	free(state->lists);
+	free(state);
+}
+
+/**
+ * Get the window a tracked property is read from.
+ */
+static inline xcb_window_t
+c2_tracked_property_window(const struct c2_tracked_property *p, const struct managed_win *w) {
+	return p->onframe ? w->client_win : w->base.id;
+}
+
+void c2_window_props_request(session_t *ps, const struct managed_win *w) {
+	const struct c2_state *state = ps->c2_state;
+	for (unsigned i = 0; i < state->nprops; i++) {
+		auto p = &state->props[i];
+		auto wid = c2_tracked_property_window(p, w);
+		if (!wid) {
+			continue;
+		}
+
+		// The same property can be read in different ways, it only needs
+		// to be fetched once
+		bool requested = false;
+		for (unsigned j = 0; j < i && !requested; j++) {
+			requested = state->props[j].atom == p->atom &&
+			            c2_tracked_property_window(&state->props[j], w) == wid;
+		}
+		if (!requested) {
+			x_prop_batch_request(&ps->prop_batch, ps->c, wid, p->atom);
+		}
+	}
+}
+
+static void c2_property_value_free(const struct c2_tracked_property *p attr_unused,
+                                   struct c2_property_value *v) {
+	// Any of the arrays, they are freed the same way
+	free(v->numbers);
+	*v = (struct c2_property_value){0};
+}
+
+/**
+ * Whether two values of the same tracked property are the same.
+ */
+static bool c2_property_value_equal(const struct c2_tracked_property *p,
+                                    const struct c2_property_value *a,
+                                    const struct c2_property_value *b) {
+	if (a->n != b->n) {
+		return false;
+	}
+	if (!p->as_string) {
+		return !a->n || !memcmp(a->numbers, b->numbers, a->n * sizeof(*a->numbers));
+	}
+	for (unsigned i = 0; i < a->n; i++) {
+		if (!a->strings[i] || !b->strings[i]) {
+			if (a->strings[i] != b->strings[i]) {
+				return false;
+			}
+		} else if (strcmp(a->strings[i], b->strings[i])) {
+			return false;
+		}
+	}
+	return true;
+}
+
 /**
- * Match a window against a single leaf window condition.
+ * Whether the last seen value of a predefined target is a string.
+ */
+static inline bool c2_predef_is_string(int predef) {
+	return predef == C2_L_PNAME || predef == C2_L_PCLASSG ||
+	       predef == C2_L_PCLASSI || predef == C2_L_PROLE;
+}
+
+void c2_window_props_free(const struct c2_state *state, struct c2_window_props *props) {
+	if (!props) {
+		return;
+	}
+	assert(props->n == state->nprops);
+	for (unsigned i = 0; i < props->n; i++) {
+		c2_property_value_free(&state->props[i], &props->values[i]);
+	}
+	for (int i = 0; i < C2_NPREDEFS; i++) {
+		if (c2_predef_is_string(i)) {
+			free(props->predefs[i].string);
+		}
+	}
+	for (int i = 0; i < C2_NSTRING_PREDEFS; i++) {
+		free(props->strings[i].bits);
+	}
+	free(props->memos);
+	free(props);
+}
+
+/**
+ * Move tracked property `i` of a window to a new generation, after its value changed.
+ */
+static inline void
+c2_window_props_property_changed(struct c2_window_props *props, unsigned i) {
+	props->prop_generations[i % C2_PROP_BITS] = ++props->generation;
+}
+
+void c2_window_props_update(session_t *ps, struct managed_win *w) {
+	const struct c2_state *state = ps->c2_state;
+	if (!state->nprops && !state->nlists) {
+		return;
+	}
+	if (!w->c2_props) {
+		w->c2_props = allocchk(calloc(1, sizeof(struct c2_window_props)));
+		w->c2_props->generation = 1;
+	}
+	// Properties and lists are only ever added, so the values and results
+	// already there stay in place
+	unsigned old_n = w->c2_props->n;
+	if (old_n < state->nprops) {
+		w->c2_props = allocchk(realloc(
+		    w->c2_props, sizeof(struct c2_window_props) +
+		                     state->nprops * sizeof(struct c2_property_value)));
+		w->c2_props->n = state->nprops;
+		for (unsigned i = old_n; i < state->nprops; i++) {
+			w->c2_props->values[i] = (struct c2_property_value){0};
+		}
+	}
+	auto props = w->c2_props;
+	if (props->nmemos < state->nlists) {
+		props->memos = crealloc(props->memos, state->nlists);
+		for (unsigned i = props->nmemos; i < state->nlists; i++) {
+			props->memos[i] = (struct c2_memo){0};
+		}
+		props->nmemos = state->nlists;
+	}
+	if (!state->nprops) {
+		return;
+	}
+
+	bool own_batch = !ps->prop_batch.collected;
+	if (own_batch) {
+		c2_window_props_request(ps, w);
+		x_prop_batch_collect(&ps->prop_batch, ps->c);
+	}
+
+	// The old values are kept to tell which properties changed
+	auto old = ccalloc(state->nprops, struct c2_property_value);
+
+	// Names of atoms are requested for all properties first, and read after
+	unsigned natoms = 0;
+	for (unsigned i = 0; i < state->nprops; i++) {
+		auto p = &state->props[i];
+		auto v = &props->values[i];
+		old[i] = *v;
+		*v = (struct c2_property_value){0};
+
+		auto wid = c2_tracked_property_window(p, w);
+		if (!wid) {
+			continue;
+		}
+		if (p->as_string && C2_L_TSTRING == p->type) {
+			int nstr = 0;
+			if (wid_get_text_prop(ps, wid, p->atom, &v->strings, &nstr)) {
+				v->n = (unsigned)nstr;
+			}
+			continue;
+		}
+
+		winprop_t prop = wid_get_prop(ps, wid, p->atom, p->length,
+		                              c2_get_atom_type(p->type), p->format);
+		if (prop.nitems) {
+			v->n = (unsigned)prop.nitems;
+			v->numbers = ccalloc(v->n, long long);
+			for (unsigned j = 0; j < v->n; j++) {
+				v->numbers[j] = winprop_get_int(prop, j);
+			}
+		}
+		free_winprop(&prop);
+		if (p->as_string) {
+			natoms += v->n;
+		}
+	}
+
+	if (natoms) {
+		auto atoms = ccalloc(natoms, xcb_atom_t);
+		natoms = 0;
+		for (unsigned i = 0; i < state->nprops; i++) {
+			if (!state->props[i].as_string || C2_L_TATOM != state->props[i].type) {
+				continue;
+			}
+			auto v = &props->values[i];
+			for (unsigned j = 0; j < v->n; j++) {
+				atoms[natoms++] = (xcb_atom_t)v->numbers[j];
+			}
+		}
+		prefetch_atom_names(ps->atoms, atoms, natoms);
+		free(atoms);
+
+		for (unsigned i = 0; i < state->nprops; i++) {
+			if (!state->props[i].as_string || C2_L_TATOM != state->props[i].type) {
+				continue;
+			}
+			auto v = &props->values[i];
+			if (!v->n) {
+				continue;
+			}
+			auto names = ccalloc(v->n, const char *);
+			for (unsigned j = 0; j < v->n; j++) {
+				// Atoms whose names couldn't be prefetched don't exist,
+				// asking again would only cost another round trip
+				if (v->numbers[j]) {
+					names[j] = peek_atom_name(ps->atoms,
+					                          (xcb_atom_t)v->numbers[j]);
+				}
+			}
+			free(v->numbers);
+			v->names = names;
+		}
+	}
+
+	for (unsigned i = 0; i < state->nprops; i++) {
+		if (!c2_property_value_equal(&state->props[i], &old[i], &props->values[i])) {
+			c2_window_props_property_changed(props, i);
+		}
+		c2_property_value_free(&state->props[i], &old[i]);
+	}
+	free(old);
+
+	if (own_batch) {
+		x_prop_batch_clear(&ps->prop_batch);
+	}
+}
+
+/**
+ * Get the value of the tracked property a leaf reads, NULL if there is no snapshot
+ * of the window's properties yet.
+ */
+static inline const struct c2_property_value *
+c2_leaf_value(const struct managed_win *w, const c2_l_t *pleaf) {
+	if (!w->c2_props || pleaf->prop >= w->c2_props->n) {
+		return NULL;
+	}
+	return &w->c2_props->values[pleaf->prop];
+}
+
+/**
+ * Get the value of a predefined target of a window. String targets other than
+ * window_type don't have one, and window_type gives its index in WINTYPES.
+ */
+static long long c2_predef_number(session_t *ps, const struct managed_win *w, int predef) {
+	switch (predef) {
+	case C2_L_PID: return w->base.id;
+	case C2_L_PX: return w->g.x;
+	case C2_L_PY: return w->g.y;
+	case C2_L_PX2: return w->g.x + w->widthb;
+	case C2_L_PY2: return w->g.y + w->heightb;
+	case C2_L_PWIDTH: return w->g.width;
+	case C2_L_PHEIGHT: return w->g.height;
+	case C2_L_PWIDTHB: return w->widthb;
+	case C2_L_PHEIGHTB: return w->heightb;
+	case C2_L_PBDW: return w->g.border_width;
+	case C2_L_PFULLSCREEN: return win_is_fullscreen(ps, w);
+	case C2_L_POVREDIR: return w->a.override_redirect;
+	case C2_L_PARGB: return win_has_alpha(w);
+	case C2_L_PFOCUSED: return win_is_focused_raw(ps, w);
+	case C2_L_PWMWIN: return w->wmwin;
+	case C2_L_PBSHAPED: return w->bounding_shaped;
+	case C2_L_PROUNDED: return w->rounded_corners;
+	case C2_L_PCLIENT: return w->client_win;
+	case C2_L_PWINDOWTYPE: return w->window_type;
+	case C2_L_PLEADER: return w->leader;
+	default: assert(0); return 0;
+	}
+}
+
+/**
+ * Get the value of a predefined string target of a window.
+ */
+static const char *c2_predef_string(const struct managed_win *w, int predef) {
+	switch (predef) {
+	case C2_L_PWINDOWTYPE: return WINTYPES[w->window_type];
+	case C2_L_PNAME: return w->name;
+	case C2_L_PCLASSG: return w->class_general;
+	case C2_L_PCLASSI: return w->class_instance;
+	case C2_L_PROLE: return w->role;
+	default: assert(0); return NULL;
+	}
+}
+
+/**
+ * Get the result of a leaf of a string matcher, without its negation applied. All
+ * leaves of the matcher are matched against the target at once, unless the
+ * window already has results for the current value of the target.
+ */
+static bool c2_string_result(session_t *ps, const struct managed_win *w,
+                             struct c2_window_props *props, const c2_l_t *pleaf) {
+	int target = c2_string_predef_index(pleaf->predef);
+	auto m = &ps->c2_state->strings[target];
+	auto r = &props->strings[target];
+	uint64_t generation = props->predefs[pleaf->predef].generation;
+	if (!m->built || !r->valid || r->generation != generation || r->version != m->version) {
+		unsigned nwords = (m->nleaves + 63) / 64;
+		if (r->nwords < nwords) {
+			r->bits = crealloc(r->bits, nwords);
+			r->nwords = nwords;
+		}
+		c2_string_matcher_run(m, c2_predef_string(w, pleaf->predef), r->bits,
+		                      r->nwords);
+		r->valid = true;
+		r->generation = generation;
+		r->version = m->version;
+	}
+	unsigned i = pleaf->string_leaf - 1;
+	return r->bits[i / 64] >> (i % 64) & 1;
+}
+
+/**
+ * Match a window against a single leaf window condition, with its negation
+ * applied.
  *
  * For internal use.
+ *
+ * @param props the snapshot of the window if the last seen values of the
+ *              predefined targets the leaf reads are up to date in it, otherwise
+ *              NULL
  */
-static inline void c2_match_once_leaf(session_t *ps, const struct managed_win *w,
-                                      const c2_l_t *pleaf, bool *pres, bool *perr) {
-	assert(pleaf);
+static bool c2_match_leaf(session_t *ps, const struct managed_win *w,
+                          struct c2_window_props *props, const c2_l_t *pleaf) {
+	if (!pleaf) {
+		return false;
+	}
+	bool res = false;
+	if (props && pleaf->string_leaf) {
+		res = c2_string_result(ps, w, props, pleaf);
+		goto out;
+	}
 
 	const xcb_window_t wid = (pleaf->tgt_onframe ? w->client_win : w->base.id);
+	const size_t idx = (pleaf->index < 0 ? 0 : (size_t)pleaf->index);
+	const struct c2_property_value *value = c2_leaf_value(w, pleaf);
 
-	// Return if wid is missing
-	if (pleaf->predef == C2_L_PUNDEFINED && !wid) {
-		return;
+	// A missing window or property never matches, but that's still negated
+	if (pleaf->predef == C2_L_PUNDEFINED && (!wid || !value)) {
+		goto out;
 	}
 
-	const int idx = (pleaf->index < 0 ? 0 : pleaf->index);
-
 	switch (pleaf->ptntype) {
 	// Deal with integer patterns
 	case C2_L_PTINT: {
-		long long *targets = NULL;
-		long long *targets_free = NULL;
+		const long long *targets = NULL;
 		size_t ntargets = 0;
 
 		// Get the value
 		// A predefined target
 		long long predef_target = 0;
 		if (pleaf->predef != C2_L_PUNDEFINED) {
-			*perr = false;
-			switch (pleaf->predef) {
-			case C2_L_PID: predef_target = wid; break;
-			case C2_L_PX: predef_target = w->g.x; break;
-			case C2_L_PY: predef_target = w->g.y; break;
-			case C2_L_PX2: predef_target = w->g.x + w->widthb; break;
-			case C2_L_PY2: predef_target = w->g.y + w->heightb; break;
-			case C2_L_PWIDTH: predef_target = w->g.width; break;
-			case C2_L_PHEIGHT: predef_target = w->g.height; break;
-			case C2_L_PWIDTHB: predef_target = w->widthb; break;
-			case C2_L_PHEIGHTB: predef_target = w->heightb; break;
-			case C2_L_PBDW: predef_target = w->g.border_width; break;
-			case C2_L_PFULLSCREEN:
-				predef_target = win_is_fullscreen(ps, w);
-				break;
-			case C2_L_POVREDIR: predef_target = w->a.override_redirect; break;
-			case C2_L_PARGB: predef_target = win_has_alpha(w); break;
-			case C2_L_PFOCUSED:
-				predef_target = win_is_focused_raw(ps, w);
-				break;
-			case C2_L_PWMWIN: predef_target = w->wmwin; break;
-			case C2_L_PBSHAPED: predef_target = w->bounding_shaped; break;
-			case C2_L_PROUNDED: predef_target = w->rounded_corners; break;
-			case C2_L_PCLIENT: predef_target = w->client_win; break;
-			case C2_L_PLEADER: predef_target = w->leader; break;
-			default:
-				*perr = true;
-				assert(0);
-				break;
-			}
+			predef_target = C2_L_PID == pleaf->predef
+			                    ? wid
+			                    : c2_predef_number(ps, w, pleaf->predef);
 			ntargets = 1;
 			targets = &predef_target;
 		}
 		// A raw window property
-		else {
-			int word_count = 1;
-			if (pleaf->index < 0) {
-				// Get length of property in 32-bit multiples
-				auto prop_info = x_get_prop_info(ps->c, wid, pleaf->tgtatom);
-				word_count = to_int_checked((prop_info.length + 4 - 1) / 4);
-			}
-			winprop_t prop = x_get_prop_with_offset(
-			    ps->c, wid, pleaf->tgtatom, idx, word_count,
-			    c2_get_atom_type(pleaf), pleaf->format);
-
-			ntargets = (pleaf->index < 0 ? prop.nitems : min2(prop.nitems, 1));
-			if (ntargets > 0) {
-				targets = targets_free = ccalloc(ntargets, long long);
-				*perr = false;
-				for (size_t i = 0; i < ntargets; ++i) {
-					targets[i] = winprop_get_int(prop, i);
-				}
-			}
-			free_winprop(&prop);
-		}
-
-		if (*perr) {
-			goto fail_int;
+		else if (pleaf->index < 0) {
+			ntargets = value->n;
+			targets = value->numbers;
+		} else if (idx < value->n) {
+			ntargets = 1;
+			targets = value->numbers + idx;
 		}
 
 		// Do comparison
-		bool res = false;
-		for (size_t i = 0; i < ntargets; ++i) {
+		for (size_t i = 0; i < ntargets && !res; ++i) {
 			long long tgt = targets[i];
 			switch (pleaf->op) {
 			case C2_L_OEXISTS:
@@ -1413,105 +2617,46 @@ static inline void c2_match_once_leaf(session_t *ps, const struct managed_win *w
 			case C2_L_OGTEQ: res = (tgt >= pleaf->ptnint); break;
 			case C2_L_OLT: res = (tgt < pleaf->ptnint); break;
 			case C2_L_OLTEQ: res = (tgt <= pleaf->ptnint); break;
-			default: *perr = true; assert(0);
-			}
-			if (res) {
-				break;
+			default: assert(0); goto out;
 			}
 		}
-		*pres = res;
-
-	fail_int:
-		// Free property values after usage, if necessary
-		if (targets_free) {
-			free(targets_free);
-		}
 	} break;
 	// String patterns
 	case C2_L_PTSTRING: {
-		const char **targets = NULL;
-		const char **targets_free = NULL;
-		const char **targets_free_inner = NULL;
+		const char *const *targets = NULL;
 		size_t ntargets = 0;
 
 		// A predefined target
 		const char *predef_target = NULL;
 		if (pleaf->predef != C2_L_PUNDEFINED) {
-			switch (pleaf->predef) {
-			case C2_L_PWINDOWTYPE:
-				predef_target = WINTYPES[w->window_type];
-				break;
-			case C2_L_PNAME: predef_target = w->name; break;
-			case C2_L_PCLASSG: predef_target = w->class_general; break;
-			case C2_L_PCLASSI: predef_target = w->class_instance; break;
-			case C2_L_PROLE: predef_target = w->role; break;
-			default: assert(0); break;
-			}
+			predef_target = c2_predef_string(w, pleaf->predef);
 			ntargets = 1;
 			targets = &predef_target;
 		}
-		// An atom type property, convert it to string
-		else if (pleaf->type == C2_L_TATOM) {
-			int word_count = 1;
-			if (pleaf->index < 0) {
-				// Get length of property in 32-bit multiples
-				auto prop_info = x_get_prop_info(ps->c, wid, pleaf->tgtatom);
-				word_count = to_int_checked((prop_info.length + 4 - 1) / 4);
-			}
-			winprop_t prop = x_get_prop_with_offset(
-			    ps->c, wid, pleaf->tgtatom, idx, word_count,
-			    c2_get_atom_type(pleaf), pleaf->format);
-
-			ntargets = (pleaf->index < 0 ? prop.nitems : min2(prop.nitems, 1));
-			targets = targets_free = (const char **)ccalloc(2 * ntargets, char *);
-			targets_free_inner = targets + ntargets;
-
-			for (size_t i = 0; i < ntargets; ++i) {
-				xcb_atom_t atom = (xcb_atom_t)winprop_get_int(prop, i);
-				if (atom) {
-					xcb_get_atom_name_reply_t *reply = xcb_get_atom_name_reply(
-					    ps->c, xcb_get_atom_name(ps->c, atom), NULL);
-					if (reply) {
-						targets[i] = targets_free_inner[i] = strndup(
-						    xcb_get_atom_name_name(reply),
-						    (size_t)xcb_get_atom_name_name_length(reply));
-						free(reply);
-					}
-				}
-			}
-			free_winprop(&prop);
+		// All names of the atoms
+		else if (pleaf->type == C2_L_TATOM && pleaf->index < 0) {
+			ntargets = value->n;
+			targets = value->names;
 		}
-		// Not an atom type, just fetch the string list
-		else {
-			char **strlst = NULL;
-			int nstr = 0;
-			if (wid_get_text_prop(ps, wid, pleaf->tgtatom, &strlst, &nstr)) {
-				if (pleaf->index < 0 && nstr > 0 && strlen(strlst[0]) > 0) {
-					ntargets = to_u32_checked(nstr);
-					targets = (const char **)strlst;
-				} else if (nstr > idx) {
-					ntargets = 1;
-					targets = (const char **)strlst + idx;
-				}
-			}
-			if (strlst) {
-				targets_free = (const char **)strlst;
-			}
+		// All strings of a text property, unless the first one is empty
+		else if (pleaf->index < 0 && value->n > 0 && strlen(value->strings[0]) > 0) {
+			ntargets = value->n;
+			targets = (const char *const *)value->strings;
 		}
-
-		if (ntargets == 0) {
-			goto fail_str;
+		// Just the indexed one
+		else if (idx < value->n) {
+			ntargets = 1;
+			targets = (const char *const *)value->strings + idx;
 		}
+
 		for (size_t i = 0; i < ntargets; ++i) {
 			if (!targets[i]) {
-				goto fail_str;
+				goto out;
 			}
 		}
-		*perr = false;
 
 		// Actual matching
-		bool res = false;
-		for (size_t i = 0; i < ntargets; ++i) {
+		for (size_t i = 0; i < ntargets && !res; ++i) {
 			const char *tgt = targets[i];
 			switch (pleaf->op) {
 			case C2_L_OEXISTS: res = true; break;
@@ -1559,104 +2704,160 @@ static inline void c2_match_once_leaf(session_t *ps, const struct managed_win *w
 					break;
 				}
 				break;
-			default: *perr = true; assert(0);
-			}
-			if (res) {
-				break;
-			}
-		}
-		*pres = res;
-
-	fail_str:
-		// Free the string after usage, if necessary
-		if (targets_free_inner) {
-			for (size_t i = 0; i < ntargets; ++i) {
-				if (targets_free_inner[i]) {
-					free((void *)targets_free_inner[i]);
-				}
+			default: assert(0); goto out;
 			}
 		}
-		// Free property values after usage, if necessary
-		if (targets_free) {
-			free(targets_free);
-		}
 	} break;
 	default: assert(0); break;
 	}
+
+out:
+#ifdef DEBUG_WINMATCH
+	log_trace("(%#010x): leaf: result = %d, client = %#010x,  pattern = ", w->base.id,
+	          res, w->client_win);
+	c2_dump((c2_ptr_t){.isbranch = false, .l = (c2_l_t *)pleaf});
+	putchar('\n');
+#endif
+	return pleaf->neg ? !res : res;
 }
 
 /**
- * Match a window against a single window condition.
+ * Run the compiled program of a single window condition.
  *
  * @return true if matched, false otherwise.
  */
-static bool c2_match_once(session_t *ps, const struct managed_win *w, const c2_ptr_t cond) {
-	bool result = false;
-	bool error = true;
-
-	// Handle a branch
-	if (cond.isbranch) {
-		const c2_b_t *pb = cond.b;
-
-		if (!pb)
-			return false;
-
-		error = false;
-
-		switch (pb->op) {
-		case C2_B_OAND:
-			result = (c2_match_once(ps, w, pb->opr1) &&
-			          c2_match_once(ps, w, pb->opr2));
+static bool c2_match_once(session_t *ps, const struct managed_win *w,
+                          struct c2_window_props *props, const c2_lptr_t *cond) {
+	bool acc = false;
+	// The stack only ever holds booleans, so it's kept in the bits of an integer
+	uint64_t stack = 0;
+	for (unsigned pc = 0; pc < cond->ncode; pc++) {
+		const struct c2_instr *instr = &cond->code[pc];
+		switch (instr->op) {
+		case C2_OP_LEAF: acc = c2_match_leaf(ps, w, props, instr->leaf); break;
+		case C2_OP_JUMP_IF_FALSE:
+			if (!acc) {
+				pc += instr->offset - 1;
+			}
 			break;
-		case C2_B_OOR:
-			result = (c2_match_once(ps, w, pb->opr1) ||
-			          c2_match_once(ps, w, pb->opr2));
+		case C2_OP_JUMP_IF_TRUE:
+			if (acc) {
+				pc += instr->offset - 1;
+			}
 			break;
-		case C2_B_OXOR:
-			result = (c2_match_once(ps, w, pb->opr1) !=
-			          c2_match_once(ps, w, pb->opr2));
+		case C2_OP_PUSH: stack = stack << 1 | acc; break;
+		case C2_OP_XOR:
+			acc = (bool)(stack & 1) != acc;
+			stack >>= 1;
 			break;
-		default: error = true; assert(0);
+		case C2_OP_NOT: acc = !acc; break;
 		}
-
-#ifdef DEBUG_WINMATCH
-		log_trace("(%#010x): branch: result = %d, pattern = ", w->base.id, result);
-		c2_dump(cond);
-		putchar('\n');
-#endif
 	}
-	// Handle a leaf
-	else {
-		const c2_l_t *pleaf = cond.l;
-
-		if (!pleaf)
-			return false;
-
-		c2_match_once_leaf(ps, w, pleaf, &result, &error);
+	return acc;
+}
 
-		// For EXISTS operator, no errors are fatal
-		if (C2_L_OEXISTS == pleaf->op && error) {
-			result = false;
-			error = false;
+/**
+ * Match a window against an indexed condition list, and return the first
+ * condition that matched.
+ */
+static const c2_lptr_t *c2_match_indexed(session_t *ps, const struct managed_win *w,
+                                         struct c2_window_props *props,
+                                         const struct c2_index *index) {
+	// The conditions that can match are the ones whose key the window has,
+	// and the ones without a key. Each of these runs of positions is in order.
+	struct {
+		const unsigned *pos;
+		unsigned n;
+	} runs[C2_INDEX_NKINDS + 1];
+	unsigned nruns = 0;
+	for (int kind = 0; kind < C2_INDEX_NKINDS; kind++) {
+		if (!index->buckets[kind]) {
+			continue;
+		}
+		const char *target = c2_predef_string(w, C2_STRING_PREDEFS[kind / 2]);
+		if (!target) {
+			continue;
+		}
+		char *folded = kind % 2 ? c2_index_fold(target) : NULL;
+		struct c2_index_bucket *b = NULL;
+		HASH_FIND_STR(index->buckets[kind], folded ?: target, b);
+		free(folded);
+		if (b) {
+			runs[nruns].pos = b->conds;
+			runs[nruns++].n = b->nconds;
 		}
-
-#ifdef DEBUG_WINMATCH
-		log_trace("(%#010x): leaf: result = %d, error = %d, "
-		          "client = %#010x,  pattern = ",
-		          w->base.id, result, error, w->client_win);
-		c2_dump(cond);
-		putchar('\n');
-#endif
 	}
+	runs[nruns].pos = index->unkeyed;
+	runs[nruns++].n = index->nunkeyed;
+
+	// Try them in the order of the list, so the first match is still the
+	// first one
+	while (true) {
+		unsigned next = UINT_MAX, from = 0;
+		for (unsigned i = 0; i < nruns; i++) {
+			if (runs[i].n && runs[i].pos[0] < next) {
+				next = runs[i].pos[0];
+				from = i;
+			}
+		}
+		if (next == UINT_MAX) {
+			return NULL;
+		}
+		runs[from].pos++;
+		runs[from].n--;
+		if (c2_match_once(ps, w, props, index->conds[next])) {
+			return index->conds[next];
+		}
+	}
+}
 
-	// Postprocess the result
-	if (error)
-		result = false;
-
-	if (cond.isbranch ? cond.b->neg : cond.l->neg)
-		result = !result;
+/**
+ * Compare the predefined targets in `predefs` with their last seen values, and
+ * move the ones that changed to a new generation.
+ */
+static void c2_window_props_refresh(session_t *ps, const struct managed_win *w,
+                                    struct c2_window_props *props, uint32_t predefs) {
+	while (predefs) {
+		int i = __builtin_ctz(predefs);
+		predefs &= predefs - 1;
+
+		auto last = &props->predefs[i];
+		if (c2_predef_is_string(i)) {
+			const char *value = c2_predef_string(w, i);
+			if (value == last->string ||
+			    (value && last->string && !strcmp(value, last->string))) {
+				continue;
+			}
+			free(last->string);
+			last->string = value ? strdup(value) : NULL;
+		} else {
+			long long value = c2_predef_number(ps, w, i);
+			if (value == last->number) {
+				continue;
+			}
+			last->number = value;
+		}
+		last->generation = ++props->generation;
+	}
+}
 
-	return result;
+/**
+ * Whether nothing in `deps` changed since `generation`.
+ */
+static bool c2_window_props_unchanged_since(const struct c2_window_props *props,
+                                            const struct c2_deps *deps,
+                                            uint64_t generation) {
+	for (uint32_t predefs = deps->predefs; predefs; predefs &= predefs - 1) {
+		if (props->predefs[__builtin_ctz(predefs)].generation > generation) {
+			return false;
+		}
+	}
+	for (uint64_t bits = deps->props; bits; bits &= bits - 1) {
+		if (props->prop_generations[__builtin_ctzll(bits)] > generation) {
+			return false;
+		}
+	}
+	return true;
 }
 
 /**
@@ -1668,17 +2869,58 @@ static bool c2_match_once(session_t *ps, const struct managed_win *w, const c2_p
  */
 bool c2_match(session_t *ps, const struct managed_win *w, const c2_lptr_t *condlst,
               void **pdata) {
-	assert(ps->server_grabbed);
-	// Then go through the whole linked list
-	for (; condlst; condlst = condlst->next) {
-		if (c2_match_once(ps, w, condlst->ptr)) {
-			if (pdata)
-				*pdata = condlst->data;
-			return true;
+	// Rules are matched against the snapshot of the window's properties taken
+	// by c2_window_props_update. win_on_factor_change takes it right before
+	// matching, and matching from anywhere else is deferred to it, except for
+	// the D-Bus setters, which use the last snapshot. A property changing after
+	// the snapshot gets the window matched again, since its PropertyNotify
+	// sets the factor change flag. A window that was never matched has no
+	// snapshot, and none of its property leaves match.
+
+	// The last result of a postprocessed list stays valid until something
+	// the conditions up to the one that matched read changes. Values of the
+	// predefined targets are read straight from the window, so they are
+	// compared with the last seen ones first.
+	struct c2_window_props *props = w->c2_props;
+	struct c2_memo *memo = NULL;
+	if (condlst && condlst->list && props && condlst->list <= props->nmemos) {
+		memo = &props->memos[condlst->list - 1];
+		c2_window_props_refresh(ps, w, props,
+		                        ps->c2_state->lists[condlst->list - 1].predefs);
+		const struct c2_deps *deps =
+		    memo->result ? &memo->result->deps : &ps->c2_state->lists[condlst->list - 1];
+		if (memo->generation &&
+		    c2_window_props_unchanged_since(props, deps, memo->generation)) {
+			if (memo->result && pdata) {
+				*pdata = memo->result->data;
+			}
+			return memo->result;
 		}
 	}
 
-	return false;
+	// Then go through the index, or the whole linked list. Conditions that
+	// failed to compile never match. String targets are only matched all at
+	// once when their last seen values were just brought up to date.
+	const c2_lptr_t *result = NULL;
+	struct c2_window_props *fresh = memo ? props : NULL;
+	if (condlst && condlst->index) {
+		result = c2_match_indexed(ps, w, fresh, condlst->index);
+	} else {
+		for (; condlst && !result; condlst = condlst->next) {
+			if (c2_match_once(ps, w, fresh, condlst)) {
+				result = condlst;
+			}
+		}
+	}
+
+	if (memo) {
+		memo->generation = props->generation;
+		memo->result = result;
+	}
+	if (result && pdata) {
+		*pdata = result->data;
+	}
+	return result;
 }
 
 /// Iterate over all conditions in a condition linked list. Call the callback for each of
@@ -1698,3 +2940,234 @@ bool c2_list_foreach(const c2_lptr_t *condlist, c2_list_foreach_cb_t cb, void *d
 void *c2_list_get_data(const c2_lptr_t *condlist) {
 	return condlist->data;
 }
+
+TEST_CASE(c2_compile) {
+	c2_lptr_t *cond = NULL;
+	TEST_TRUE(c2_parse(&cond, "name = 'a' && !(class_g = 'b' || role = 'c')", NULL));
+	TEST_TRUE(c2_compile(cond));
+
+	// The jumps skip to right after the operator they short-circuit
+	TEST_EQUAL(cond->ncode, 6);
+	TEST_EQUAL(cond->code[0].op, C2_OP_LEAF);
+	TEST_EQUAL(cond->code[1].op, C2_OP_JUMP_IF_FALSE);
+	TEST_EQUAL(cond->code[1].offset, 5);
+	TEST_EQUAL(cond->code[2].op, C2_OP_LEAF);
+	TEST_EQUAL(cond->code[3].op, C2_OP_JUMP_IF_TRUE);
+	TEST_EQUAL(cond->code[3].offset, 2);
+	TEST_EQUAL(cond->code[4].op, C2_OP_LEAF);
+	TEST_EQUAL(cond->code[5].op, C2_OP_NOT);
+
+	c2_list_free(&cond, NULL);
+}
+
+TEST_CASE(c2_tree_deps) {
+	c2_lptr_t *cond = NULL;
+	TEST_TRUE(c2_parse(&cond, "class_g = 'a' && !(focused || width > 10)", NULL));
+
+	struct c2_deps deps = {0};
+	c2_tree_deps(cond->ptr, &deps);
+	TEST_EQUAL(deps.predefs,
+	           1U << C2_L_PCLASSG | 1U << C2_L_PFOCUSED | 1U << C2_L_PWIDTH);
+	TEST_EQUAL(deps.props, 0);
+
+	c2_list_free(&cond, NULL);
+}
+
+static void *c2_test_atom_getter(void *user_data, const char *key attr_unused,
+                                 int *err attr_unused) {
+	return (void *)(intptr_t)++*(xcb_atom_t *)user_data;
+}
+
+TEST_CASE(c2_match_memo) {
+	xcb_atom_t last_atom = 0;
+	struct atom atoms = {.c = new_cache(&last_atom, c2_test_atom_getter, NULL)};
+	session_t ps = {.c2_state = c2_state_new(), .atoms = &atoms};
+
+	// The property of the first list is tracked at index 0, those of the second
+	// one at 1 to 64
+	c2_lptr_t *cond = NULL, *other = NULL;
+	TEST_TRUE(c2_parse(&cond, "A0:32c = 1 || width > 10", NULL));
+	TEST_TRUE(c2_list_postprocess(&ps, cond));
+	for (int i = 1; i <= C2_PROP_BITS; i++) {
+		char rule[32];
+		snprintf(rule, sizeof(rule), "A%d:32c = 1", i);
+		TEST_TRUE(c2_parse(&other, rule, NULL));
+	}
+	TEST_TRUE(c2_list_postprocess(&ps, other));
+	TEST_EQUAL(ps.c2_state->nprops, C2_PROP_BITS + 1);
+
+	struct c2_window_props *props = allocchk(
+	    calloc(1, sizeof(struct c2_window_props) +
+	                  ps.c2_state->nprops * sizeof(struct c2_property_value)));
+	props->generation = 1;
+	props->n = ps.c2_state->nprops;
+	props->memos = ccalloc(ps.c2_state->nlists, struct c2_memo);
+	props->nmemos = ps.c2_state->nlists;
+	struct managed_win w = {.g = {.width = 20}, .c2_props = props};
+	auto memo = &props->memos[cond->list - 1];
+
+	TEST_TRUE(c2_match(&ps, &w, cond, NULL));
+	TEST_EQUAL(memo->result, cond);
+	uint64_t matched = memo->generation;
+	TEST_TRUE(matched);
+
+	// A predefined target it reads changed
+	w.g.width = 30;
+	TEST_TRUE(c2_match(&ps, &w, cond, NULL));
+	TEST_TRUE(memo->generation > matched);
+	TEST_EQUAL(memo->generation, props->generation);
+	matched = memo->generation;
+
+	// A property sharing the bit of the one it reads changed
+	c2_window_props_property_changed(props, C2_PROP_BITS);
+	TEST_TRUE(c2_match(&ps, &w, cond, NULL));
+	TEST_TRUE(memo->generation > matched);
+	TEST_EQUAL(memo->generation, props->generation);
+	matched = memo->generation;
+
+	// A property it doesn't read changed, the last result is reused
+	c2_window_props_property_changed(props, 1);
+	TEST_TRUE(c2_match(&ps, &w, cond, NULL));
+	TEST_EQUAL(memo->generation, matched);
+	TEST_TRUE(props->generation > matched);
+
+	c2_window_props_free(ps.c2_state, props);
+	c2_list_free(&cond, NULL);
+	c2_list_free(&other, NULL);
+	while (ps.track_atom_lst) {
+		auto next = ps.track_atom_lst->next;
+		free(ps.track_atom_lst);
+		ps.track_atom_lst = next;
+	}
+	c2_state_free(ps.c2_state);
+	cache_free(atoms.c);
+}
+
+TEST_CASE(c2_index) {
+	// Parsed conditions are prepended, so these are in reverse
+	static const char *const rules[] = {
+	    "role = 'r'",        "class_g = 'c6'",        "class_g = 'c5'",
+	    "class_g = 'c4'",    "class_g = 'c3'",        "class_g = 'c2'",
+	    "class_g = 'c1'",    "class_i ?= 'FOO'",      "class_g = 'a'",
+	    "name *= 'y'",       "class_g = 'a' && name = 'x'",
+	};
+	c2_lptr_t *cond = NULL;
+	for (size_t i = 0; i < ARR_SIZE(rules); i++) {
+		TEST_TRUE(c2_parse(&cond, rules[i], NULL));
+	}
+	for (auto i = cond; i; i = i->next) {
+		TEST_TRUE(c2_compile(i));
+	}
+	auto index = c2_index_new(cond);
+	TEST_TRUE(index);
+	TEST_EQUAL(index->nunkeyed, 1);
+
+	struct managed_win w = {.name = "y1", .class_general = "a", .class_instance = "foo"};
+	// Conditions without a key are tried in between the others
+	TEST_EQUAL(c2_match_indexed(NULL, &w, NULL, index), index->conds[1]);
+	w.name = "z";
+	TEST_EQUAL(c2_match_indexed(NULL, &w, NULL, index), index->conds[2]);
+	w.class_general = "b";
+	w.class_instance = "Foo";
+	TEST_EQUAL(c2_match_indexed(NULL, &w, NULL, index), index->conds[3]);
+	w.class_general = "c3";
+	w.class_instance = NULL;
+	TEST_EQUAL(c2_match_indexed(NULL, &w, NULL, index), index->conds[6]);
+	w.class_general = "d";
+	TEST_EQUAL(c2_match_indexed(NULL, &w, NULL, index), NULL);
+
+	c2_index_free(index);
+	c2_list_free(&cond, NULL);
+}
+
+TEST_CASE(c2_string_matcher) {
+	static const char *const rules[] = {
+	    "name = 'he'",  "name ^= 'he'", "name *= 'she'",
+	    "name *?= 'HERS'", "name = ''", "name ^= 'us'",
+	};
+	auto state = c2_state_new();
+	c2_lptr_t *cond = NULL;
+	for (size_t i = 0; i < ARR_SIZE(rules); i++) {
+		TEST_TRUE(c2_parse(&cond, rules[i], NULL));
+		c2_string_matcher_add(state, cond->ptr.l);
+		TEST_EQUAL(cond->ptr.l->string_leaf, i + 1);
+	}
+
+	auto m = &state->strings[c2_string_predef_index(C2_L_PNAME)];
+	uint64_t bits = 0;
+	// Overlapping occurrences are all found
+	c2_string_matcher_run(m, "ushers", &bits, 1);
+	TEST_EQUAL(bits, 0x2c);
+	c2_string_matcher_run(m, "he", &bits, 1);
+	TEST_EQUAL(bits, 0x3);
+	c2_string_matcher_run(m, "", &bits, 1);
+	TEST_EQUAL(bits, 0x10);
+	c2_string_matcher_run(m, NULL, &bits, 1);
+	TEST_EQUAL(bits, 0);
+
+	c2_list_free(&cond, NULL);
+	c2_state_free(state);
+}
+
+#ifdef CONFIG_REGEX_PCRE
+TEST_CASE(c2_string_matcher_regex) {
+	TEST_TRUE(c2_regex_joinable("^fo+$"));
+	TEST_TRUE(c2_regex_joinable("a\\(b"));
+	TEST_TRUE(!c2_regex_joinable("(?i)baz"));
+	TEST_TRUE(!c2_regex_joinable("(a)\\1"));
+	TEST_TRUE(!c2_regex_joinable("\\Qa"));
+	TEST_TRUE(!c2_regex_joinable("(*UTF)a"));
+
+	static const char *const rules[] = {
+	    "name ~= '^fo+$'",
+	    "name ~?= 'BAR'",
+	    "name ~= '(?i)baz'",
+	    "name = 'bar'",
+	};
+	session_t ps = {.c2_state = c2_state_new()};
+	c2_lptr_t *cond = NULL;
+	for (size_t i = 0; i < ARR_SIZE(rules); i++) {
+		TEST_TRUE(c2_parse(&cond, rules[i], NULL));
+		TEST_TRUE(c2_l_postprocess(&ps, cond->ptr.l));
+	}
+
+	auto m = &ps.c2_state->strings[c2_string_predef_index(C2_L_PNAME)];
+	uint64_t bits = 0;
+	c2_string_matcher_run(m, "foo", &bits, 1);
+	TEST_EQUAL(bits, 0x1);
+	// Only the regexes that keep their meaning are joined, with their case
+	TEST_TRUE(m->regex_pcre);
+	TEST_TRUE(m->leaves[0].joined);
+	TEST_TRUE(m->leaves[1].joined);
+	TEST_TRUE(!m->leaves[2].joined);
+	TEST_TRUE(!m->leaves[3].joined);
+	c2_string_matcher_run(m, "Foo", &bits, 1);
+	TEST_EQUAL(bits, 0);
+	c2_string_matcher_run(m, "xBaRx", &bits, 1);
+	TEST_EQUAL(bits, 0x2);
+	c2_string_matcher_run(m, "bar", &bits, 1);
+	TEST_EQUAL(bits, 0xa);
+	// Tried even though the joined regex doesn't match
+	c2_string_matcher_run(m, "BAZ", &bits, 1);
+	TEST_EQUAL(bits, 0x4);
+
+	// When the joined regex doesn't compile, all of them are tried one by one.
+	// That is logged, and tests run before the logger is set up.
+	log_init_tls();
+	auto pleaf = m->leaves[1].leaf;
+	free(pleaf->ptnstr);
+	pleaf->ptnstr = strdup("BAR(");
+	m->built = false;
+	c2_string_matcher_run(m, "bar", &bits, 1);
+	TEST_EQUAL(bits, 0xa);
+	TEST_TRUE(!m->regex_pcre);
+	TEST_TRUE(!m->leaves[0].joined);
+	TEST_TRUE(!m->leaves[1].joined);
+	c2_string_matcher_run(m, "foo", &bits, 1);
+	TEST_EQUAL(bits, 0x1);
+	log_deinit_tls();
+
+	c2_list_free(&cond, NULL);
+	c2_state_free(ps.c2_state);
+}
+#endif
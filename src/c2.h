@@ -17,16 +17,40 @@
 typedef struct _c2_lptr c2_lptr_t;
 typedef struct session session_t;
 struct managed_win;
+struct c2_state;
+struct c2_window_props;
 
 typedef void (*c2_userdata_free)(void *);
 c2_lptr_t *c2_parse(c2_lptr_t **pcondlst, const char *pattern, void *data);
 
 c2_lptr_t *c2_free_lptr(c2_lptr_t *lp, c2_userdata_free f);
 
+/// Match a window against a condition list, and return the data of the first
+/// condition that matched in `pdata`. For postprocessed lists, the result is
+/// remembered in the window's snapshot, and only matched again once something read
+/// by the conditions up to the one that matched changes.
 bool c2_match(session_t *ps, const struct managed_win *w, const c2_lptr_t *condlst,
               void **pdata);
 
+/// Resolve the atoms of a condition list, register the properties it reads in
+/// `ps->c2_state`, and compile its conditions. Conditions are only matched once
+/// they are compiled.
 bool c2_list_postprocess(session_t *ps, c2_lptr_t *list);
+
+/// Create the state shared by all condition lists of a session, which keeps track
+/// of the window properties the conditions read.
+struct c2_state *c2_state_new(void);
+void c2_state_free(struct c2_state *);
+
+/// Ask for all the window properties read by the conditions of `w`, in the property
+/// batch of the session.
+void c2_window_props_request(session_t *ps, const struct managed_win *w);
+/// Take a new snapshot of all the window properties read by the conditions of `w`.
+/// All condition lists match against this snapshot, instead of fetching the
+/// properties themselves. The properties are read from the property batch of the
+/// session if it's collected, otherwise they are fetched in a batch of their own.
+void c2_window_props_update(session_t *ps, struct managed_win *w);
+void c2_window_props_free(const struct c2_state *, struct c2_window_props *);
 typedef bool (*c2_list_foreach_cb_t)(const c2_lptr_t *cond, void *data);
 bool c2_list_foreach(const c2_lptr_t *list, c2_list_foreach_cb_t cb, void *data);
 /// Return user data stored in a condition.
@@ -54,6 +54,12 @@ void *cache_get(struct cache *c, const char *key, int *err) {
 	return e->value;
 }
 
+void *cache_peek(struct cache *c, const char *key) {
+	struct cache_entry *e;
+	HASH_FIND_STR(c->entries, key, e);
+	return e ? e->value : NULL;
+}
+
 static inline void _cache_invalidate(struct cache *c, struct cache_entry *e) {
 	if (c->free) {
 		c->free(c->user_data, e->value);
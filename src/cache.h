@@ -15,6 +15,11 @@ struct cache *new_cache(void *user_data, cache_getter_t getter, cache_free_t f);
 /// getter will be called, and the returned value will be stored into the cache.
 void *cache_get(struct cache *, const char *key, int *err);
 
+/// Fetch a value from the cache, without calling the getter. Returns NULL if the value
+/// isn't in the cache, which can't be told apart from a cached NULL value. Used to
+/// check whether a key is there before inserting it with `cache_set`.
+void *cache_peek(struct cache *, const char *key);
+
 /// Invalidate a value in the cache.
 void cache_invalidate(struct cache *, const char *key);
 
@@ -25,8 +30,9 @@ void cache_invalidate_all(struct cache *);
 /// `new_cache`
 void *cache_free(struct cache *);
 
-/// Insert a key-value pair into the cache. Only used for internal testing. Takes
-/// ownership of `data`
+/// Insert a key-value pair into the cache, without calling the getter. Used for values
+/// obtained some other way, e.g. the atoms and names the atom cache learns from
+/// batched requests. Takes ownership of `data`
 ///
 /// If `key` already exists in the cache, this function will abort the program.
 void cache_set(struct cache *c, const char *key, void *data);
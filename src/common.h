@@ -51,10 +51,16 @@
 #endif
 
 // FIXME This list of includes should get shorter
+#include "animation.h"
 #include "backend/backend.h"
 #include "backend/driver.h"
+#include "benchmark.h"
 #include "compiler.h"
 #include "config.h"
+#include "context_cache.h"
+#include "event_trace.h"
+#include "frame_scheduler.h"
+#include "frame_stats.h"
 #include "list.h"
 #include "region.h"
 #include "render.h"
@@ -152,6 +158,8 @@ typedef struct session {
 	/// Use an ev_idle callback for drawing
 	/// So we only start drawing when events are processed
 	ev_idle draw_idle;
+	/// Timer that starts painting when the frame scheduler says so.
+	ev_timer render_timer;
 	/// Called every time we have timeouts or new data on socket,
 	/// so we can be sure if xcb read from X socket at anytime during event
 	/// handling, we will not left any event unhandled in the queue
@@ -177,12 +185,23 @@ typedef struct session {
 
 	// Manager for layouts and inner layers
 	struct layout_manager *layout_manager;
+	/// Timing statistics of the rendering stages
+	struct frame_stats frame_stats;
+	/// Decides when to paint frames, based on the vblank timing.
+	struct frame_scheduler frame_scheduler;
+	/// Per-frame measurements of benchmark mode, if a report is requested
+	struct benchmark benchmark;
+	/// Recording of the handled X events, if requested
+	struct event_trace *event_trace;
 
 	bool legacy_backend_ready; // TODO:Kirill - tmp addition
 
 	// === Display related ===
 	/// Whether the X server is grabbed by us
 	bool server_grabbed;
+	/// Properties of the windows being updated, fetched together while the
+	/// server is grabbed
+	struct x_prop_batch prop_batch;
 	/// Display in use.
 	Display *dpy;
 	/// Previous handler of X errors
@@ -249,6 +268,8 @@ typedef struct session {
 	bool tmout_unredir_hit;
 	/// Whether we need to redraw the screen
 	bool redraw_needed;
+	/// Whether a redraw was put off because the backend was busy
+	bool redraw_deferred;
 
 	/// Cache a xfixes region so we don't need to allocate it every time.
 	/// A workaround for yshui/picom#301
@@ -267,8 +288,10 @@ typedef struct session {
 	xcb_render_picture_t *alpha_picts;
 	/// Time of last fading. In milliseconds.
 	long long fade_time;
-	/// Time of last window animation step. In milliseconds.
-	long animation_time; // TODO(dccsillag) turn into `long long`, like fade_time
+	/// Clock of the window animations.
+	struct animation_clock animation_clock;
+	/// Window animations that are running.
+	struct animation_table animation_table;
 	/// Head pointer of the error ignore linked list.
 	ignore_t *ignore_head;
 	/// Pointer to the <code>next</code> member of tail element of the error
@@ -318,6 +341,10 @@ typedef struct session {
 	/// Backend shadow context.
 	struct backend_shadow_context *shadow_context;
 	struct backend_shadow_context *shadow_context_active;
+	/// Shadow contexts shared by all windows, keyed by backend and radius.
+	struct context_cache shadow_contexts;
+	/// Blur contexts shared by all windows, keyed by backend and blur parameters.
+	struct context_cache blur_contexts;
 	// for shadow precomputation
 	/// A region in which shadow is not painted on.
 	region_t shadow_exclude_reg;
@@ -392,6 +419,8 @@ typedef struct session {
 	xcb_atom_t atoms_wintypes[NUM_WINTYPES];
 	/// Linked list of additional atoms to track.
 	latom_t *track_atom_lst;
+	/// Properties read by the rules.
+	struct c2_state *c2_state;
 
 #ifdef CONFIG_DBUS
 	// === DBus related ===
@@ -528,6 +557,11 @@ static inline void set_ignore_cookie(session_t *ps, xcb_void_cookie_t cookie) {
  * @return true if it has the attribute, false otherwise
  */
 static inline bool wid_has_prop(const session_t *ps, xcb_window_t w, xcb_atom_t atom) {
+	auto batched = x_prop_batch_find(&ps->prop_batch, w, atom);
+	if (batched) {
+		return batched->type != XCB_NONE;
+	}
+
 	auto r = xcb_get_property_reply(
 	    ps->c, xcb_get_property(ps->c, 0, w, atom, XCB_GET_PROPERTY_TYPE_ANY, 0, 0), NULL);
 	if (!r) {
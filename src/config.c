@@ -946,9 +946,13 @@ char *parse_config(options_t *opt, const char *config_file, bool *shadow_enable,
 	    .dbus = false,
 	    .benchmark = 0,
 	    .benchmark_wid = XCB_NONE,
+	    .benchmark_report = NULL,
+	    .record_events = NULL,
+	    .frame_stats_file = NULL,
 	    .logpath = NULL,
 
 	    .use_damage = true,
+	    .frame_pacing = true,
 
 	    .shadow_red = 0.0,
 	    .shadow_green = 0.0,
@@ -157,6 +157,12 @@ typedef struct options {
 	int benchmark;
 	/// Window to constantly repaint in benchmark mode. 0 for full-screen.
 	xcb_window_t benchmark_wid;
+	/// Path to write a JSON report of the benchmark to. NULL for disabled.
+	char *benchmark_report;
+	/// Path to record the handled X events to. NULL for disabled.
+	char *record_events;
+	/// Path to write frame timing statistics to when exiting. NULL for disabled.
+	char *frame_stats_file;
 	/// A list of conditions of windows not to paint.
 	c2_lptr_t *paint_blacklist;
 	/// Whether to show all X errors.
@@ -174,6 +180,8 @@ typedef struct options {
 	bool vsync_use_glfinish;
 	/// Whether use damage information to help limit the area to paint
 	bool use_damage;
+	/// Whether to time frames against the vblanks reported by Present
+	bool frame_pacing;
 
 	// === Shadow ===
 	/// Red, green and blue tone of the shadow.
@@ -832,6 +832,9 @@ char *parse_config_libconfig(options_t *opt, const char *config_file, bool *shad
 	// --use-damage
 	lcfg_lookup_bool(&cfg, "use-damage", &opt->use_damage);
 
+	// --no-frame-pacing
+	lcfg_lookup_bool(&cfg, "frame-pacing", &opt->frame_pacing);
+
 	// --max-brightness
 	if (config_lookup_float(&cfg, "max-brightness", &opt->max_brightness) &&
 	    opt->use_damage && opt->max_brightness < 1) {
@@ -0,0 +1,138 @@
+// SPDX-License-Identifier: MPL-2.0
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <uthash.h>
+
+#include <test.h>
+
+#include "compiler.h"
+#include "context_cache.h"
+#include "log.h"
+#include "utils.h"
+
+struct context_cache_entry {
+	void *ctx;
+	unsigned refcount;
+	UT_hash_handle hh;
+	UT_hash_handle hh_ctx;
+	char key[];
+};
+
+void context_cache_init(struct context_cache *c, size_t key_size, void *user_data,
+                        context_cache_create_t create, context_cache_destroy_t destroy) {
+	*c = (struct context_cache){
+	    .key_size = key_size,
+	    .user_data = user_data,
+	    .create = create,
+	    .destroy = destroy,
+	};
+}
+
+static void context_cache_remove(struct context_cache *c, struct context_cache_entry *e) {
+	HASH_DELETE(hh, c->entries, e);
+	HASH_DELETE(hh_ctx, c->entries_by_ctx, e);
+	c->destroy(c->user_data, e->ctx);
+	free(e);
+}
+
+void context_cache_deinit(struct context_cache *c) {
+	struct context_cache_entry *e, *tmp;
+	HASH_ITER(hh, c->entries, e, tmp) {
+		log_warn("Context %p still has %u references, destroying it anyway",
+		         e->ctx, e->refcount);
+		context_cache_remove(c, e);
+	}
+	c->entries = c->entries_by_ctx = NULL;
+}
+
+void *context_cache_get(struct context_cache *c, const void *key) {
+	struct context_cache_entry *e = NULL;
+	HASH_FIND(hh, c->entries, key, c->key_size, e);
+	if (e) {
+		c->hits++;
+		e->refcount++;
+		return e->ctx;
+	}
+
+	c->misses++;
+	void *ctx = c->create(c->user_data, key);
+	if (!ctx) {
+		return NULL;
+	}
+
+	e = cvalloc(sizeof(*e) + c->key_size);
+	memset(e, 0, sizeof(*e));
+	memcpy(e->key, key, c->key_size);
+	e->ctx = ctx;
+	e->refcount = 1;
+	HASH_ADD_KEYPTR(hh, c->entries, e->key, c->key_size, e);
+	HASH_ADD(hh_ctx, c->entries_by_ctx, ctx, sizeof(e->ctx), e);
+	return ctx;
+}
+
+void context_cache_put(struct context_cache *c, void *ctx) {
+	struct context_cache_entry *e = NULL;
+	HASH_FIND(hh_ctx, c->entries_by_ctx, &ctx, sizeof(ctx), e);
+	if (!e) {
+		log_error("Context %p is not from this cache", ctx);
+		assert(false);
+		return;
+	}
+	if (--e->refcount == 0) {
+		context_cache_remove(c, e);
+	}
+}
+
+unsigned context_cache_size(const struct context_cache *c) {
+	return HASH_COUNT(c->entries);
+}
+
+static void *test_create(void *user_data, const void *key) {
+	// Odd keys fail to create
+	if (*(const int *)key % 2) {
+		return NULL;
+	}
+	(*(int *)user_data)++;
+	auto ret = cmalloc(int);
+	*ret = *(const int *)key;
+	return ret;
+}
+
+static void test_destroy(void *user_data, void *ctx) {
+	(*(int *)user_data)--;
+	free(ctx);
+}
+
+TEST_CASE(context_cache_refcount) {
+	int alive = 0;
+	struct context_cache c;
+	context_cache_init(&c, sizeof(int), &alive, test_create, test_destroy);
+
+	int key = 2;
+	int *a = context_cache_get(&c, &key);
+	int *b = context_cache_get(&c, &key);
+	TEST_EQUAL(a, b);
+	TEST_EQUAL(*a, 2);
+	TEST_EQUAL(alive, 1);
+	TEST_EQUAL(c.hits, 1);
+	TEST_EQUAL(c.misses, 1);
+
+	key = 4;
+	int *d = context_cache_get(&c, &key);
+	TEST_EQUAL(*d, 4);
+	TEST_EQUAL(context_cache_size(&c), 2);
+
+	key = 3;
+	TEST_EQUAL(context_cache_get(&c, &key), NULL);
+	TEST_EQUAL(context_cache_size(&c), 2);
+
+	context_cache_put(&c, a);
+	TEST_EQUAL(alive, 2);
+	context_cache_put(&c, b);
+	TEST_EQUAL(alive, 1);
+	TEST_EQUAL(context_cache_size(&c), 1);
+
+	context_cache_deinit(&c);
+	TEST_EQUAL(alive, 0);
+}
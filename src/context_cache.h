@@ -0,0 +1,49 @@
+// SPDX-License-Identifier: MPL-2.0
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+struct context_cache_entry;
+
+typedef void *(*context_cache_create_t)(void *user_data, const void *key);
+typedef void (*context_cache_destroy_t)(void *user_data, void *ctx);
+
+/// A refcounted cache of rendering contexts (shadow kernels, blur contexts...), so
+/// windows asking for identical parameters share a single context.
+///
+/// Keys are fixed-size blobs compared bytewise, so callers must zero any padding in
+/// their key structs. A context is destroyed as soon as its last reference is put.
+struct context_cache {
+	struct context_cache_entry *entries;
+	/// Same entries, indexed by context pointer
+	struct context_cache_entry *entries_by_ctx;
+	size_t key_size;
+	void *user_data;
+	context_cache_create_t create;
+	context_cache_destroy_t destroy;
+
+	/// Number of lookups served by an existing context
+	uint64_t hits;
+	/// Number of lookups that had to create a new context
+	uint64_t misses;
+};
+
+/// Initialize an empty cache. `create` is called on a miss to make a context for
+/// `key`, it may return NULL on failure; `destroy` frees a context whose last
+/// reference is gone. `user_data` is passed to both.
+void context_cache_init(struct context_cache *, size_t key_size, void *user_data,
+                        context_cache_create_t create, context_cache_destroy_t destroy);
+
+/// Destroy all contexts still in the cache, complaining about the ones that were
+/// never put. The cache stays usable afterwards, and keeps its counters.
+void context_cache_deinit(struct context_cache *);
+
+/// Get a reference to the context for `key`, creating it if there is none yet.
+/// Returns NULL if it had to be created and `create` failed.
+void *context_cache_get(struct context_cache *, const void *key);
+
+/// Drop a reference acquired with `context_cache_get`.
+void context_cache_put(struct context_cache *, void *ctx);
+
+/// Number of distinct contexts currently alive.
+unsigned context_cache_size(const struct context_cache *);
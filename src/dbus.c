@@ -564,6 +564,49 @@ static bool cdbus_append_empty_dict(session_t *ps attr_unused, DBusMessage *msg,
 	return true;
 }
 
+/**
+ * Callback to append frame timing statistics to a message, as an array of
+ * (stage, count, mean, p50, p90, p99, max), durations in microseconds.
+ */
+static bool
+cdbus_apdarg_frame_stats(session_t *ps, DBusMessage *msg, const void *data attr_unused) {
+	DBusMessageIter it, it2, it3;
+	dbus_message_iter_init_append(msg, &it);
+	if (!dbus_message_iter_open_container(&it, DBUS_TYPE_ARRAY, "(stttttt)", &it2)) {
+		return false;
+	}
+	for (int i = 0; i < NUM_FRAME_STAGES; i++) {
+		const char *name = frame_stage_name(i);
+		const auto h = &ps->frame_stats.stages[i];
+		const dbus_uint64_t values[] = {
+		    h->count,
+		    h->count ? h->sum_us / h->count : 0,
+		    frame_stats_percentile(&ps->frame_stats, i, 50),
+		    frame_stats_percentile(&ps->frame_stats, i, 90),
+		    frame_stats_percentile(&ps->frame_stats, i, 99),
+		    h->max_us,
+		};
+		if (!dbus_message_iter_open_container(&it2, DBUS_TYPE_STRUCT, NULL, &it3) ||
+		    !dbus_message_iter_append_basic(&it3, DBUS_TYPE_STRING, &name)) {
+			log_error("Failed to append argument.");
+			return false;
+		}
+		for (size_t j = 0; j < ARR_SIZE(values); j++) {
+			if (!dbus_message_iter_append_basic(&it3, DBUS_TYPE_UINT64, &values[j])) {
+				log_error("Failed to append argument.");
+				return false;
+			}
+		}
+		if (!dbus_message_iter_close_container(&it2, &it3)) {
+			return false;
+		}
+	}
+	if (!dbus_message_iter_close_container(&it, &it2)) {
+		return false;
+	}
+	return true;
+}
+
 /**
  * Callback to append all window IDs to a message.
  */
@@ -1387,6 +1430,9 @@ static bool cdbus_process_introspect(session_t *ps, DBusMessage *msg) {
 	    "    </signal>\n"
 	    "    <method name='reset' />\n"
 	    "    <method name='repaint' />\n"
+	    "    <method name='frame_stats'>\n"
+	    "      <arg name='stats' direction='out' type='a(stttttt)' />\n"
+	    "    </method>\n"
 	    "  </interface>\n"
 	    "  <interface name='" PICOM_COMPOSITOR_INTERFACE "'>\n"
 	    "    <signal name='WinAdded'>\n"
@@ -1529,6 +1575,8 @@ cdbus_process(DBusConnection *c attr_unused, DBusMessage *msg, void *ud) {
 		handled = cdbus_process_opts_get(ps, msg);
 	} else if (cdbus_m_ismethod("opts_set")) {
 		handled = cdbus_process_opts_set(ps, msg);
+	} else if (cdbus_m_ismethod("frame_stats")) {
+		handled = cdbus_reply(ps, msg, cdbus_apdarg_frame_stats, NULL);
 	}
 #undef cdbus_m_ismethod
 	else if (dbus_message_is_method_call(msg, "org.freedesktop.DBus.Introspectable",
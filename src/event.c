@@ -439,17 +439,8 @@ static inline void ev_expose(session_t *ps, xcb_expose_event_t *ev) {
 static inline void ev_property_notify(session_t *ps, xcb_property_notify_event_t *ev) {
 	if (unlikely(log_get_level_tls() <= LOG_LEVEL_TRACE)) {
 		// Print out changed atom
-		xcb_get_atom_name_reply_t *reply =
-		    xcb_get_atom_name_reply(ps->c, xcb_get_atom_name(ps->c, ev->atom), NULL);
-		const char *name = "?";
-		int name_len = 1;
-		if (reply) {
-			name = xcb_get_atom_name_name(reply);
-			name_len = xcb_get_atom_name_name_length(reply);
-		}
-
-		log_debug("{ atom = %.*s }", name_len, name);
-		free(reply);
+		const char *name = get_atom_name(ps->atoms, ev->atom);
+		log_debug("{ atom = %s }", name ?: "?");
 	}
 
 	if (ps->root == ev->window) {
@@ -467,6 +458,14 @@ static inline void ev_property_notify(session_t *ps, xcb_property_notify_event_t
 		return;
 	}
 
+	if (ps->event_trace) {
+		auto w = find_toplevel(ps, ev->window) ?: find_managed_win(ps, ev->window);
+		if (w) {
+			event_trace_record_property(ps->event_trace, ps->c, w->base.id,
+			                            ev->window, ev->atom);
+		}
+	}
+
 	ps->pending_updates = true;
 	// If WM_STATE changes
 	if (ev->atom == ps->atoms->aWM_STATE) {
@@ -661,7 +660,14 @@ void repair_win(session_t *ps, struct managed_win *w)
 		pixman_region32_subtract(&parts, &parts, w->reg_ignore);
 	}
 
-	add_damage(ps, &parts);
+	if (ps->o.legacy_backends) {
+		add_damage(ps, &parts);
+	} else {
+		// Kept with the window, the layout manager derives the screen damage
+		// from it.
+		pixman_region32_translate(&parts, -w->g.x, -w->g.y);
+		pixman_region32_union(&w->damaged, &w->damaged, &parts);
+	}
 	pixman_region32_fini(&parts);
 }
 
@@ -683,7 +689,14 @@ static inline void ev_damage_notify(session_t *ps, xcb_damage_notify_event_t *de
 
 static inline void ev_shape_notify(session_t *ps, xcb_shape_notify_event_t *ev) {
 	auto w = find_managed_win(ps, ev->affected_window);
-	if (!w || w->a.map_state == XCB_MAP_STATE_UNMAPPED) {
+	if (!w) {
+		return;
+	}
+
+	// The cached bounding shape is out of date even if the window is not
+	// mapped, it will be fetched again when the window is next updated
+	win_set_flags(w, WIN_FLAGS_SHAPE_STALE);
+	if (w->a.map_state == XCB_MAP_STATE_UNMAPPED) {
 		return;
 	}
 
@@ -715,6 +728,10 @@ ev_selection_clear(session_t *ps, xcb_selection_clear_event_t attr_unused *ev) {
 }
 
 void ev_handle(session_t *ps, xcb_generic_event_t *ev) {
+	if (ps->event_trace) {
+		event_trace_record(ps->event_trace, ev);
+	}
+
 	if (XCB_EVENT_RESPONSE_TYPE(ev) != KeymapNotify) {
 		discard_ignore(ps, ev->full_sequence);
 	}
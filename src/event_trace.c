@@ -0,0 +1,309 @@
+// SPDX-License-Identifier: MPL-2.0
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <xcb/xcb.h>
+
+#include "atom.h"
+#include "compiler.h"
+#include "event_trace.h"
+#include "log.h"
+#include "utils.h"
+
+/// Longest property value recorded, in 32-bit units
+#define EVENT_TRACE_MAX_PROPERTY_LENGTH 4096
+
+/// A record that comes after a property whose value hasn't been read yet. Records
+/// are written in order, so it waits until the value is there.
+struct event_trace_pending {
+	uint64_t timestamp;
+	enum event_trace_kind kind;
+	/// For properties, the top-level window, and the request for the value
+	xcb_window_t toplevel;
+	xcb_atom_t property;
+	xcb_get_property_cookie_t cookie;
+	xcb_get_property_reply_t *reply;
+	/// For the rest, the data of the record
+	uint32_t size;
+	char *data;
+};
+
+struct event_trace {
+	FILE *f;
+	uint64_t start_us;
+	struct event_trace_pending *pending;
+	unsigned npending, pending_capacity;
+};
+
+/// Start of a property record, followed by the names and the value
+struct event_trace_property {
+	uint32_t window;
+	uint8_t format;
+	uint8_t pad[3];
+};
+
+static uint64_t event_trace_now_us(void) {
+	struct timespec tm = {0, 0};
+	clock_gettime(CLOCK_MONOTONIC, &tm);
+	return (uint64_t)tm.tv_sec * 1000000UL + (uint64_t)tm.tv_nsec / 1000;
+}
+
+struct event_trace *event_trace_open(const char *path, xcb_window_t root) {
+	FILE *f = fopen(path, "wb");
+	if (!f) {
+		log_error("Failed to open event trace %s", path);
+		return NULL;
+	}
+	const uint32_t header[] = {EVENT_TRACE_VERSION, root};
+	if (fwrite("picomevt", 8, 1, f) != 1 || fwrite(header, sizeof(header), 1, f) != 1) {
+		log_error("Failed to write event trace header to %s", path);
+		fclose(f);
+		return NULL;
+	}
+
+	auto ret = ccalloc(1, struct event_trace);
+	ret->f = f;
+	ret->start_us = event_trace_now_us();
+	return ret;
+}
+
+void event_trace_close(struct event_trace *t) {
+	if (t->npending) {
+		log_error("%u records of the event trace were never flushed, dropping them",
+		          t->npending);
+	}
+	for (unsigned i = 0; i < t->npending; i++) {
+		free(t->pending[i].reply);
+		free(t->pending[i].data);
+	}
+	free(t->pending);
+	if (fclose(t->f) != 0) {
+		log_error("Failed to write the event trace, it might be truncated");
+	}
+	free(t);
+}
+
+static struct event_trace_pending *event_trace_add_pending(struct event_trace *t) {
+	if (t->npending == t->pending_capacity) {
+		t->pending_capacity = max2(t->pending_capacity * 2, 16U);
+		t->pending = crealloc(t->pending, t->pending_capacity);
+	}
+	auto ret = &t->pending[t->npending++];
+	*ret = (struct event_trace_pending){
+	    .timestamp = event_trace_now_us() - t->start_us,
+	};
+	return ret;
+}
+
+static void event_trace_write_at(struct event_trace *t, uint64_t timestamp,
+                                 enum event_trace_kind kind, const void *data,
+                                 uint32_t size, const void *extra, uint32_t extra_size) {
+	const uint32_t kind32 = kind;
+	const uint32_t total = size + extra_size;
+	fwrite(&timestamp, sizeof(timestamp), 1, t->f);
+	fwrite(&kind32, sizeof(kind32), 1, t->f);
+	fwrite(&total, sizeof(total), 1, t->f);
+	if (size) {
+		fwrite(data, size, 1, t->f);
+	}
+	if (extra_size) {
+		fwrite(extra, extra_size, 1, t->f);
+	}
+}
+
+static void event_trace_write(struct event_trace *t, enum event_trace_kind kind,
+                              const void *data, uint32_t size, const void *extra,
+                              uint32_t extra_size) {
+	if (!t->npending) {
+		event_trace_write_at(t, event_trace_now_us() - t->start_us, kind, data,
+		                     size, extra, extra_size);
+		return;
+	}
+
+	auto pending = event_trace_add_pending(t);
+	pending->kind = kind;
+	pending->size = size + extra_size;
+	pending->data = ccalloc(pending->size ?: 1, char);
+	if (size) {
+		memcpy(pending->data, data, size);
+	}
+	if (extra_size) {
+		memcpy(pending->data + size, extra, extra_size);
+	}
+}
+
+void event_trace_record_reset(struct event_trace *t) {
+	event_trace_write(t, EVENT_TRACE_RESET, NULL, 0, NULL, 0);
+}
+
+void event_trace_record(struct event_trace *t, const xcb_generic_event_t *ev) {
+	const uint32_t wire_size = 32;
+	if ((ev->response_type & 0x7f) != XCB_GE_GENERIC) {
+		event_trace_write(t, EVENT_TRACE_EVENT, ev, wire_size, NULL, 0);
+		return;
+	}
+
+	// libxcb puts full_sequence right after the first 32 bytes, and the rest of
+	// a generic event after that.
+	auto ge = (const xcb_ge_generic_event_t *)ev;
+	event_trace_write(t, EVENT_TRACE_EVENT, ev, wire_size,
+	                  (const char *)ev + wire_size + sizeof(uint32_t), ge->length * 4);
+}
+
+void event_trace_record_property(struct event_trace *t, xcb_connection_t *c,
+                                 xcb_window_t toplevel, xcb_window_t window,
+                                 xcb_atom_t property) {
+	auto pending = event_trace_add_pending(t);
+	pending->kind = EVENT_TRACE_PROPERTY;
+	pending->toplevel = toplevel;
+	pending->property = property;
+	pending->cookie = xcb_get_property(c, 0, window, property, XCB_GET_PROPERTY_TYPE_ANY,
+	                                   0, EVENT_TRACE_MAX_PROPERTY_LENGTH);
+}
+
+static void
+event_trace_write_property(struct event_trace *t, struct atom *atoms,
+                           const struct event_trace_pending *pending) {
+	const char *name = get_atom_name(atoms, pending->property);
+	if (!name) {
+		return;
+	}
+
+	auto r = pending->reply;
+	struct event_trace_property header = {.window = pending->toplevel};
+	const char *type = "";
+	const void *value = NULL;
+	size_t value_size = 0;
+	char *atom_names = NULL;
+	if (r && r->type != XCB_NONE) {
+		header.format = r->format;
+		type = get_atom_name(atoms, r->type) ?: "";
+		value = xcb_get_property_value(r);
+		value_size = (size_t)xcb_get_property_value_length(r);
+	}
+	if (r && r->type == XCB_ATOM_ATOM && r->format == 32) {
+		// Atoms are different on another server, record their names
+		auto values = (const xcb_atom_t *)value;
+		size_t n = value_size / sizeof(xcb_atom_t);
+		value_size = 0;
+		for (size_t i = 0; i < n; i++) {
+			const char *atom_name = get_atom_name(atoms, values[i]) ?: "";
+			size_t len = strlen(atom_name) + 1;
+			atom_names = crealloc(atom_names, value_size + len);
+			memcpy(atom_names + value_size, atom_name, len);
+			value_size += len;
+		}
+		value = atom_names;
+	}
+
+	size_t name_size = strlen(name) + 1, type_size = strlen(type) + 1;
+	size_t size = sizeof(header) + name_size + type_size;
+	auto data = ccalloc(size, char);
+	memcpy(data, &header, sizeof(header));
+	memcpy(data + sizeof(header), name, name_size);
+	memcpy(data + sizeof(header) + name_size, type, type_size);
+	event_trace_write_at(t, pending->timestamp, EVENT_TRACE_PROPERTY, data,
+	                     (uint32_t)size, value, (uint32_t)value_size);
+	free(data);
+	free(atom_names);
+}
+
+bool event_trace_flush(struct event_trace *t, xcb_connection_t *c, struct atom *atoms) {
+	if (!t->npending) {
+		return false;
+	}
+
+	// The requests were sent when the properties were recorded, collect all the
+	// replies, then the names of all the atoms in them, with one more round trip.
+	xcb_atom_t *names = NULL;
+	size_t nnames = 0, names_capacity = 0;
+	for (unsigned i = 0; i < t->npending; i++) {
+		auto pending = &t->pending[i];
+		if (pending->kind != EVENT_TRACE_PROPERTY) {
+			continue;
+		}
+		pending->reply = xcb_get_property_reply(c, pending->cookie, NULL);
+
+		size_t n = 2;
+		const xcb_atom_t *values = NULL;
+		if (pending->reply && pending->reply->type == XCB_ATOM_ATOM &&
+		    pending->reply->format == 32) {
+			values = xcb_get_property_value(pending->reply);
+			n += (size_t)xcb_get_property_value_length(pending->reply) /
+			     sizeof(xcb_atom_t);
+		}
+		if (nnames + n > names_capacity) {
+			names_capacity = max2(names_capacity * 2, nnames + n);
+			names = crealloc(names, names_capacity);
+		}
+		names[nnames++] = pending->property;
+		names[nnames++] = pending->reply ? pending->reply->type : XCB_NONE;
+		for (size_t j = 2; j < n; j++) {
+			names[nnames++] = values[j - 2];
+		}
+	}
+	prefetch_atom_names(atoms, names, nnames);
+	free(names);
+
+	for (unsigned i = 0; i < t->npending; i++) {
+		auto pending = &t->pending[i];
+		if (pending->kind == EVENT_TRACE_PROPERTY) {
+			event_trace_write_property(t, atoms, pending);
+			free(pending->reply);
+		} else {
+			event_trace_write_at(t, pending->timestamp, pending->kind,
+			                     pending->data, pending->size, NULL, 0);
+			free(pending->data);
+		}
+	}
+	t->npending = 0;
+	return true;
+}
+
+void event_trace_record_tree(struct event_trace *t, xcb_connection_t *c,
+                             const xcb_window_t *children, int nchildren) {
+	auto geometry_cookies = ccalloc(nchildren, xcb_get_geometry_cookie_t);
+	auto attr_cookies = ccalloc(nchildren, xcb_get_window_attributes_cookie_t);
+	for (int i = 0; i < nchildren; i++) {
+		geometry_cookies[i] = xcb_get_geometry(c, children[i]);
+		attr_cookies[i] = xcb_get_window_attributes(c, children[i]);
+	}
+
+	for (int i = 0; i < nchildren; i++) {
+		auto g = xcb_get_geometry_reply(c, geometry_cookies[i], NULL);
+		auto a = xcb_get_window_attributes_reply(c, attr_cookies[i], NULL);
+		if (!g || !a) {
+			// The window is already gone, it won't be in the trace either
+			free(g);
+			free(a);
+			continue;
+		}
+
+		xcb_create_notify_event_t create = {
+		    .response_type = XCB_CREATE_NOTIFY,
+		    .parent = g->root,
+		    .window = children[i],
+		    .x = g->x,
+		    .y = g->y,
+		    .width = g->width,
+		    .height = g->height,
+		    .border_width = g->border_width,
+		    .override_redirect = a->override_redirect,
+		};
+		event_trace_write(t, EVENT_TRACE_EVENT, &create, sizeof(create), NULL, 0);
+		if (a->map_state != XCB_MAP_STATE_UNMAPPED) {
+			xcb_map_notify_event_t map = {
+			    .response_type = XCB_MAP_NOTIFY,
+			    .event = g->root,
+			    .window = children[i],
+			    .override_redirect = a->override_redirect,
+			};
+			event_trace_write(t, EVENT_TRACE_EVENT, &map, sizeof(map), NULL, 0);
+		}
+		free(g);
+		free(a);
+	}
+	free(geometry_cookies);
+	free(attr_cookies);
+}
@@ -0,0 +1,75 @@
+// SPDX-License-Identifier: MPL-2.0
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include <xcb/xcb.h>
+
+struct atom;
+
+/// Recording of the X events handled by picom, for replaying a user's workflow
+/// on another X server with tests/replay_events.py. The replies picom gets are
+/// recorded by running it through tests/x_stub.py, which can also serve them back
+/// for a deterministic replay.
+///
+/// The trace is a binary file in native byte order. It starts with a header:
+///
+///     char magic[8] = "picomevt"; uint32_t version; uint32_t root;
+///
+/// followed by records:
+///
+///     uint64_t timestamp_us; uint32_t kind; uint32_t size; uint8_t data[size];
+///
+/// where timestamp_us is the time since the trace was started, and kind is one of
+/// `enum event_trace_kind`. For events, data is the event as it came from the wire:
+/// 32 bytes, plus the extra data of generic events. For properties, it is:
+///
+///     uint32_t window; uint8_t format; uint8_t pad[3];
+///     char property[]; char type[]; uint8_t value[];
+///
+/// where window is the top-level window the property belongs to, and property and
+/// type are the NUL terminated names of the atoms. format is 0 if the window doesn't
+/// have the property. The value is as the server returned it, except values of type
+/// ATOM, which are NUL terminated atom names instead. A reset has no data, the
+/// windows that exist are recorded again after it.
+///
+/// The trace is kept open across resets.
+struct event_trace;
+
+#define EVENT_TRACE_VERSION 2
+
+enum event_trace_kind {
+	EVENT_TRACE_EVENT,
+	EVENT_TRACE_PROPERTY,
+	EVENT_TRACE_RESET,
+};
+
+/// Create a new trace at `path`, overwriting it if it exists. Returns NULL on
+/// failure.
+struct event_trace *event_trace_open(const char *path, xcb_window_t root);
+/// Flush and close the trace. Records still waiting for a property value are
+/// dropped, so the trace has to be flushed before the X connection is closed.
+void event_trace_close(struct event_trace *);
+
+/// Append `ev` to the trace.
+void event_trace_record(struct event_trace *, const xcb_generic_event_t *ev);
+
+/// Record the current value of `property` of `window`, as a property of `toplevel`.
+/// This asks the X server for the value, which is read by `event_trace_flush`. Until
+/// then, the records that follow are kept in memory.
+void event_trace_record_property(struct event_trace *, xcb_connection_t *c,
+                                 xcb_window_t toplevel, xcb_window_t window,
+                                 xcb_atom_t property);
+
+/// Read the values of the recorded properties and write the records waiting for
+/// them. Returns whether there were any, in which case waiting for the values might
+/// have queued X events.
+bool event_trace_flush(struct event_trace *, xcb_connection_t *c, struct atom *atoms);
+
+/// Record that picom was reset.
+void event_trace_record_reset(struct event_trace *);
+
+/// Record the windows that existed before the trace started, as if they were just
+/// created (and mapped, if they are). `children` are the children of the root window,
+/// from bottom to top.
+void event_trace_record_tree(struct event_trace *, xcb_connection_t *c,
+                             const xcb_window_t *children, int nchildren);
@@ -0,0 +1,163 @@
+// SPDX-License-Identifier: MPL-2.0
+#include <stdlib.h>
+#include <xcb/present.h>
+#include <xcb/xcb.h>
+
+#include <test.h>
+
+#include "compiler.h"
+#include "frame_scheduler.h"
+#include "log.h"
+#include "utils.h"
+
+/// Vblanks further than this from our clock can't be from the same clock, e.g. if
+/// the X server is on another machine
+#define FRAME_SCHEDULER_MAX_CLOCK_SKEW_US 10000000UL
+
+void frame_scheduler_init(struct frame_scheduler *s, xcb_connection_t *c, xcb_window_t window) {
+	*s = (struct frame_scheduler){0};
+	s->window = window;
+	s->eid = xcb_generate_id(c);
+	auto e = xcb_request_check(
+	    c, xcb_present_select_input_checked(c, s->eid, window,
+	                                        XCB_PRESENT_EVENT_MASK_COMPLETE_NOTIFY));
+	if (e) {
+		log_warn("Cannot select present input, frames will not be paced");
+		free(e);
+		return;
+	}
+	s->event = xcb_register_for_special_xge(c, &xcb_present_id, s->eid, NULL);
+	if (!s->event) {
+		log_warn("Cannot register for special XGE, frames will not be paced");
+		return;
+	}
+	s->enabled = true;
+}
+
+void frame_scheduler_deinit(struct frame_scheduler *s, xcb_connection_t *c) {
+	if (s->event) {
+		xcb_present_select_input(c, s->eid, s->window, 0);
+		xcb_unregister_for_special_event(c, s->event);
+	}
+	*s = (struct frame_scheduler){0};
+}
+
+void frame_scheduler_handle_events(struct frame_scheduler *s, xcb_connection_t *c) {
+	if (!s->event) {
+		return;
+	}
+	xcb_present_generic_event_t *ev;
+	while ((ev = (void *)xcb_poll_for_special_event(c, s->event))) {
+		if (ev->evtype == XCB_PRESENT_COMPLETE_NOTIFY) {
+			auto cne = (xcb_present_complete_notify_event_t *)ev;
+			frame_scheduler_add_vblank(s, cne->msc, cne->ust);
+			if (cne->kind == XCB_PRESENT_COMPLETE_KIND_NOTIFY_MSC) {
+				s->notify_pending = false;
+			}
+		}
+		free(ev);
+	}
+}
+
+void frame_scheduler_request_vblank(struct frame_scheduler *s, xcb_connection_t *c) {
+	if (!s->enabled || s->notify_pending) {
+		return;
+	}
+	// With a divisor of 0, the target MSC 0 has always been reached, so the
+	// event is sent right away, with the timing of the latest vblank.
+	xcb_present_notify_msc(c, s->window, 0, 0, 0, 0);
+	s->notify_pending = true;
+}
+
+void frame_scheduler_add_vblank(struct frame_scheduler *s, uint64_t msc, uint64_t ust) {
+	if (s->last_ust && msc > s->last_msc && ust > s->last_ust) {
+		uint64_t interval = (ust - s->last_ust) / (msc - s->last_msc);
+		// Ignore nonsense, like vblanks of a different CRTC
+		if (interval >= 2000 && interval <= 100000) {
+			s->refresh_us =
+			    s->refresh_us ? (s->refresh_us * 7 + interval) / 8 : interval;
+		}
+	}
+	if (!s->last_ust || msc >= s->last_msc) {
+		s->last_msc = msc;
+		s->last_ust = ust;
+	}
+}
+
+void frame_scheduler_add_render_time(struct frame_scheduler *s, uint64_t duration_us) {
+	s->render_us[s->nrender++ % FRAME_SCHEDULER_NSAMPLES] = duration_us;
+}
+
+/// Conservative estimate of how long the next frame takes to paint
+static uint64_t frame_scheduler_render_cost(const struct frame_scheduler *s) {
+	uint64_t ret = 0;
+	for (unsigned i = 0; i < min2(s->nrender, FRAME_SCHEDULER_NSAMPLES); i++) {
+		ret = max2(ret, s->render_us[i]);
+	}
+	return ret + FRAME_SCHEDULER_SLACK_US;
+}
+
+/// The first vblank a frame started at `now_us` can make, that isn't the one the
+/// last frame was painted for. Returns 0 if the vblank timing is unknown.
+static uint64_t frame_scheduler_next_vblank(const struct frame_scheduler *s,
+                                            uint64_t now_us, uint64_t cost) {
+	if (!s->refresh_us || !s->last_ust ||
+	    s->last_ust > now_us + FRAME_SCHEDULER_MAX_CLOCK_SKEW_US ||
+	    now_us > s->last_ust + FRAME_SCHEDULER_MAX_CLOCK_SKEW_US) {
+		return 0;
+	}
+
+	uint64_t ready = now_us + cost;
+	uint64_t vblank = s->last_ust;
+	if (ready > vblank) {
+		vblank += (ready - vblank + s->refresh_us - 1) / s->refresh_us * s->refresh_us;
+	}
+	// Don't paint twice for the same vblank
+	if (s->target_ust && vblank < s->target_ust + s->refresh_us / 2) {
+		vblank += (s->target_ust + s->refresh_us / 2 - vblank + s->refresh_us - 1) /
+		          s->refresh_us * s->refresh_us;
+	}
+	return vblank;
+}
+
+uint64_t frame_scheduler_delay(const struct frame_scheduler *s, uint64_t now_us) {
+	if (!s->enabled) {
+		return 0;
+	}
+	auto cost = frame_scheduler_render_cost(s);
+	auto vblank = frame_scheduler_next_vblank(s, now_us, cost);
+	if (vblank < now_us + cost) {
+		return 0;
+	}
+	return vblank - cost - now_us;
+}
+
+void frame_scheduler_begin_frame(struct frame_scheduler *s, uint64_t now_us) {
+	s->target_ust =
+	    frame_scheduler_next_vblank(s, now_us, frame_scheduler_render_cost(s));
+}
+
+TEST_CASE(frame_scheduler_delay) {
+	struct frame_scheduler s = {.enabled = true};
+	// Unknown timing, paint right away
+	TEST_EQUAL(frame_scheduler_delay(&s, 1000000), 0);
+
+	frame_scheduler_add_vblank(&s, 100, 1000000);
+	frame_scheduler_add_vblank(&s, 102, 1032000);
+	TEST_EQUAL(s.refresh_us, 16000);
+
+	// Next vblank at 1048000, 2000us of render cost (1000 + slack)
+	frame_scheduler_add_render_time(&s, 1000);
+	TEST_EQUAL(frame_scheduler_delay(&s, 1040000), 6000);
+	// Too late for that one, aim at the one after
+	TEST_EQUAL(frame_scheduler_delay(&s, 1047000), 15000);
+
+	// Once a frame is painted for a vblank, the next one waits for the vblank
+	// after that
+	frame_scheduler_begin_frame(&s, 1046000);
+	TEST_EQUAL(s.target_ust, 1048000);
+	TEST_EQUAL(frame_scheduler_delay(&s, 1047000), 15000);
+
+	// UST from a different clock
+	TEST_EQUAL(frame_scheduler_delay(&s, 100000000), 0);
+}
@@ -0,0 +1,68 @@
+// SPDX-License-Identifier: MPL-2.0
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include <xcb/xcb.h>
+
+/// Number of recent render durations the render cost is estimated from
+#define FRAME_SCHEDULER_NSAMPLES 16
+/// Extra time given to each frame on top of the estimated render cost, in
+/// microseconds
+#define FRAME_SCHEDULER_SLACK_US 1000
+
+/// Schedules frames against the vblanks reported by the Present extension.
+///
+/// Instead of painting as soon as something is damaged, the next frame is started
+/// just early enough to be done by the next vblank, given how long recent frames
+/// took to render. Damage arriving before that is coalesced into the same frame.
+///
+/// The vblank timing comes from PresentCompleteNotify events on the target window:
+/// the ones generated by our own NotifyMSC requests, and the ones of presented
+/// pixmaps if the backend uses Present.
+struct frame_scheduler {
+	/// Whether frames are scheduled, otherwise they are painted as soon as possible
+	bool enabled;
+	xcb_special_event_t *event;
+	uint32_t eid;
+	xcb_window_t window;
+	/// Whether a NotifyMSC request is waiting for its event
+	bool notify_pending;
+
+	/// The last vblank we know of. UST is in microseconds of the X server's
+	/// monotonic clock, 0 if there was no vblank yet.
+	uint64_t last_msc, last_ust;
+	/// Estimated time between two vblanks, in microseconds, 0 if unknown
+	uint64_t refresh_us;
+	/// The vblank the last frame was painted for, 0 if it was painted without
+	/// knowing the vblank timing
+	uint64_t target_ust;
+
+	/// Recent render durations, in microseconds
+	uint64_t render_us[FRAME_SCHEDULER_NSAMPLES];
+	unsigned nrender;
+};
+
+/// Start receiving Present events for `window`. Leaves the scheduler disabled if
+/// that isn't possible.
+void frame_scheduler_init(struct frame_scheduler *, xcb_connection_t *c, xcb_window_t window);
+void frame_scheduler_deinit(struct frame_scheduler *, xcb_connection_t *c);
+
+/// Process the Present events that have arrived, without blocking.
+void frame_scheduler_handle_events(struct frame_scheduler *, xcb_connection_t *c);
+
+/// Ask for the timing of the latest vblank, unless a request is already pending.
+void frame_scheduler_request_vblank(struct frame_scheduler *, xcb_connection_t *c);
+
+/// Record that vblank number `msc` happened at `ust`.
+void frame_scheduler_add_vblank(struct frame_scheduler *, uint64_t msc, uint64_t ust);
+
+/// Record how long painting a frame took.
+void frame_scheduler_add_render_time(struct frame_scheduler *, uint64_t duration_us);
+
+/// How long to wait, starting at `now_us`, before painting the next frame. Returns 0
+/// to paint right away, which is also what happens when the vblank timing isn't
+/// known.
+uint64_t frame_scheduler_delay(const struct frame_scheduler *, uint64_t now_us);
+
+/// Note that painting a frame starts at `now_us`, and which vblank it is for.
+void frame_scheduler_begin_frame(struct frame_scheduler *, uint64_t now_us);
@@ -0,0 +1,131 @@
+// SPDX-License-Identifier: MPL-2.0
+#include <assert.h>
+#include <inttypes.h>
+
+#include <test.h>
+
+#include "compiler.h"
+#include "frame_stats.h"
+#include "utils.h"
+
+static const char *const frame_stage_names[NUM_FRAME_STAGES] = {
+    [FRAME_STAGE_X_EVENTS] = "x_events",
+    [FRAME_STAGE_PENDING_UPDATES] = "pending_updates",
+    [FRAME_STAGE_SERVER_GRAB] = "server_grab",
+    [FRAME_STAGE_PREPROCESS] = "preprocess",
+    [FRAME_STAGE_LAYOUT] = "layout",
+    [FRAME_STAGE_COMPOSE] = "compose",
+    [FRAME_STAGE_BLUR] = "blur",
+    [FRAME_STAGE_SHADOW] = "shadow",
+    [FRAME_STAGE_PRESENT] = "present",
+    [FRAME_STAGE_FRAME] = "frame",
+};
+
+const char *frame_stage_name(enum frame_stage stage) {
+	assert(stage < NUM_FRAME_STAGES);
+	return frame_stage_names[stage];
+}
+
+/// Index of the bucket `value` falls into.
+///
+/// Values smaller than FRAME_STATS_SUB_BUCKETS have a bucket each. After that,
+/// each [2^e, 2^(e+1)) range is split into FRAME_STATS_SUB_BUCKETS buckets.
+static unsigned frame_stats_bucket(uint64_t value) {
+	const unsigned sub_bits = 3;
+	static_assert(1 << 3 == FRAME_STATS_SUB_BUCKETS, "sub_bits doesn't match");
+	if (value < FRAME_STATS_SUB_BUCKETS) {
+		return (unsigned)value;
+	}
+	unsigned exp = 63 - (unsigned)__builtin_clzll(value);
+	if (exp > FRAME_STATS_MAX_EXP) {
+		return FRAME_STATS_NBUCKETS - 1;
+	}
+	unsigned sub = (unsigned)(value >> (exp - sub_bits)) & (FRAME_STATS_SUB_BUCKETS - 1);
+	return (exp - sub_bits + 1) * FRAME_STATS_SUB_BUCKETS + sub;
+}
+
+/// Smallest value that doesn't fall into bucket `index` or any bucket before it.
+static uint64_t frame_stats_bucket_end(unsigned index) {
+	const unsigned sub_bits = 3;
+	if (index < FRAME_STATS_SUB_BUCKETS) {
+		return index + 1;
+	}
+	unsigned exp = index / FRAME_STATS_SUB_BUCKETS + sub_bits - 1;
+	uint64_t sub = index % FRAME_STATS_SUB_BUCKETS;
+	return (FRAME_STATS_SUB_BUCKETS + sub + 1) << (exp - sub_bits);
+}
+
+void frame_stats_record(struct frame_stats *stats, enum frame_stage stage,
+                        uint64_t duration_us) {
+	assert(stage < NUM_FRAME_STAGES);
+	auto h = &stats->stages[stage];
+	h->count++;
+	h->sum_us += duration_us;
+	h->max_us = max2(h->max_us, duration_us);
+	h->buckets[frame_stats_bucket(duration_us)]++;
+}
+
+TEST_CASE(frame_stats_bucket) {
+	for (uint64_t v = 0; v < 1000; v++) {
+		auto b = frame_stats_bucket(v);
+		TEST_TRUE(v < frame_stats_bucket_end(b));
+		TEST_TRUE(b == 0 || v >= frame_stats_bucket_end(b - 1));
+	}
+	TEST_EQUAL(frame_stats_bucket(UINT64_MAX), FRAME_STATS_NBUCKETS - 1);
+}
+
+uint64_t frame_stats_percentile(const struct frame_stats *stats, enum frame_stage stage,
+                                double percentile) {
+	assert(stage < NUM_FRAME_STAGES);
+	auto h = &stats->stages[stage];
+	if (h->count == 0) {
+		return 0;
+	}
+
+	// Number of samples that are no bigger than the result
+	auto rank = (uint64_t)((double)h->count * percentile / 100.0 + 0.5);
+	rank = clamp(rank, 1, h->count);
+
+	uint64_t seen = 0;
+	for (unsigned i = 0; i < FRAME_STATS_NBUCKETS; i++) {
+		seen += h->buckets[i];
+		if (seen >= rank) {
+			// Report the upper end of the bucket, but never more than what
+			// we actually saw
+			return min2(frame_stats_bucket_end(i) - 1, h->max_us);
+		}
+	}
+	unreachable;
+}
+
+bool frame_stats_dump(const struct frame_stats *stats, FILE *f) {
+	if (fprintf(f, "# stage count mean_us p50_us p90_us p99_us max_us\n") < 0) {
+		return false;
+	}
+	for (int i = 0; i < NUM_FRAME_STAGES; i++) {
+		auto h = &stats->stages[i];
+		uint64_t mean = h->count ? h->sum_us / h->count : 0;
+		if (fprintf(f, "%s %" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRIu64
+		               " %" PRIu64 "\n",
+		            frame_stage_names[i], h->count, mean,
+		            frame_stats_percentile(stats, i, 50),
+		            frame_stats_percentile(stats, i, 90),
+		            frame_stats_percentile(stats, i, 99), h->max_us) < 0) {
+			return false;
+		}
+	}
+	return fflush(f) == 0;
+}
+
+TEST_CASE(frame_stats_percentile) {
+	struct frame_stats stats = {0};
+	TEST_EQUAL(frame_stats_percentile(&stats, FRAME_STAGE_FRAME, 50), 0);
+
+	for (uint64_t i = 1; i <= 100; i++) {
+		frame_stats_record(&stats, FRAME_STAGE_FRAME, i);
+	}
+	auto p50 = frame_stats_percentile(&stats, FRAME_STAGE_FRAME, 50);
+	TEST_TRUE(p50 >= 50 && p50 <= 50 + 50 / FRAME_STATS_SUB_BUCKETS);
+	TEST_EQUAL(frame_stats_percentile(&stats, FRAME_STAGE_FRAME, 100), 100);
+	TEST_EQUAL(stats.stages[FRAME_STAGE_FRAME].count, 100);
+}
@@ -0,0 +1,85 @@
+// SPDX-License-Identifier: MPL-2.0
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+/// Stages of producing a frame whose durations are recorded
+enum frame_stage {
+	/// Handling X events
+	FRAME_STAGE_X_EVENTS = 0,
+	/// handle_pending_updates, including the work done after the X critical
+	/// section
+	FRAME_STAGE_PENDING_UPDATES,
+	/// Holding the X server grab in handle_pending_updates, during which all
+	/// other X clients are stalled
+	FRAME_STAGE_SERVER_GRAB,
+	/// paint_preprocess
+	FRAME_STAGE_PREPROCESS,
+	/// Building the render layout
+	FRAME_STAGE_LAYOUT,
+	/// Composing window contents, summed over all windows of a frame
+	FRAME_STAGE_COMPOSE,
+	/// Blurring window backgrounds, summed over all windows of a frame
+	FRAME_STAGE_BLUR,
+	/// Drawing window shadows, summed over all windows of a frame
+	FRAME_STAGE_SHADOW,
+	/// Presenting the frame, including waiting for vblank if the backend does so
+	FRAME_STAGE_PRESENT,
+	/// The whole draw callback
+	FRAME_STAGE_FRAME,
+
+	NUM_FRAME_STAGES,
+};
+
+/// Number of linear sub-buckets each power of two is divided into. Values are
+/// exact below this, and off by at most 1/FRAME_STATS_SUB_BUCKETS above.
+#define FRAME_STATS_SUB_BUCKETS 8
+/// Largest power of two (in microseconds) that gets its own buckets, longer
+/// durations all end up in the last bucket.
+#define FRAME_STATS_MAX_EXP 26
+#define FRAME_STATS_NBUCKETS ((FRAME_STATS_MAX_EXP - 1) * FRAME_STATS_SUB_BUCKETS)
+
+/// A log-linear histogram of durations, in microseconds. It has a fixed size, so
+/// recording a sample never allocates.
+struct frame_histogram {
+	uint64_t count;
+	uint64_t sum_us;
+	uint64_t max_us;
+	uint32_t buckets[FRAME_STATS_NBUCKETS];
+};
+
+/// Timing statistics of all frame stages, since the session started.
+///
+/// Only ever touched from the main loop, so it needs no locking.
+struct frame_stats {
+	struct frame_histogram stages[NUM_FRAME_STAGES];
+};
+
+/// Get the current time of the monotonic clock, in microseconds.
+static inline uint64_t frame_stats_now_us(void) {
+	struct timespec tm = {0, 0};
+	clock_gettime(CLOCK_MONOTONIC, &tm);
+	return (uint64_t)tm.tv_sec * 1000000UL + (uint64_t)tm.tv_nsec / 1000;
+}
+
+/// Record a sample of `duration_us` microseconds for `stage`.
+void frame_stats_record(struct frame_stats *, enum frame_stage stage, uint64_t duration_us);
+
+/// Record the time passed since `start_us` for `stage`.
+static inline void
+frame_stats_record_since(struct frame_stats *stats, enum frame_stage stage, uint64_t start_us) {
+	frame_stats_record(stats, stage, frame_stats_now_us() - start_us);
+}
+
+/// Estimate the `percentile` (0-100) of the samples recorded for `stage`, in
+/// microseconds. Returns 0 if there are no samples.
+uint64_t frame_stats_percentile(const struct frame_stats *, enum frame_stage stage,
+                                double percentile);
+
+/// Return the name of a stage, as used in the reports.
+const char *frame_stage_name(enum frame_stage stage);
+
+/// Write a report of all stages to `f`, one line per stage.
+bool frame_stats_dump(const struct frame_stats *, FILE *f);
@@ -194,6 +194,13 @@ static const struct picom_option picom_options[] = {
 	{"blur-size-rule"              , required_argument, 821, "SIZE:COND", "Specify a list of blur size rules."}, // Kirill
 	{"blur-deviation-rule"         , required_argument, 822, "DEVIATION:COND", "Specify a list of blur deviation rules."}, // Kirill
 	{"blur-strength-rule"          , required_argument, 823, "STRENGTH:COND", "Specify a list of blur strength rules."}, // Kirill
+    {"frame-stats-file"            , required_argument, 824, "PATH"        , "Write per-stage frame timing statistics to this file when picom exits "
+                                                                             "or resets."},
+    {"benchmark-report"            , required_argument, 825, "PATH"        , "Write per-frame measurements of benchmark mode to this file as JSON."},
+    {"record-events"               , required_argument, 826, "PATH"        , "Record the handled X events to this file, to be replayed with "
+                                                                             "tests/replay_events.py."},
+    {"no-frame-pacing"             , no_argument      , 827, NULL          , "Paint as soon as something changes, instead of timing frames to finish "
+                                                                             "right before the next vblank."},
 };
 // clang-format on
 
@@ -856,6 +863,25 @@ bool get_cfg(options_t *opt, int argc, char *const *argv, bool shadow_enable,
 				exit(1);
 			break;
 		}
+		case 824:
+			// --frame-stats-file
+			free(opt->frame_stats_file);
+			opt->frame_stats_file = strdup(optarg);
+			break;
+		case 825:
+			// --benchmark-report
+			free(opt->benchmark_report);
+			opt->benchmark_report = strdup(optarg);
+			break;
+		case 826:
+			// --record-events
+			free(opt->record_events);
+			opt->record_events = strdup(optarg);
+			break;
+		case 827:
+			// --no-frame-pacing
+			opt->frame_pacing = false;
+			break;
 		default: usage(argv[0], 1); break;
 #undef P_CASEBOOL
 		}
@@ -187,7 +187,30 @@ static inline struct managed_win *find_win_all(session_t *ps, const xcb_window_t
 	return w;
 }
 
+/// Start painting the next frame when the frame scheduler says so, or right away if
+/// frames aren't paced. Damage that arrives in the meantime goes into the same frame.
+static void schedule_render(session_t *ps) {
+	if (ev_is_active(&ps->draw_idle) || ev_is_active(&ps->render_timer) ||
+	    ps->redraw_deferred) {
+		return;
+	}
+	// Keep the vblank timing fresh for the frames after this one
+	frame_scheduler_request_vblank(&ps->frame_scheduler, ps->c);
+	auto delay_us = frame_scheduler_delay(&ps->frame_scheduler, frame_stats_now_us());
+	if (!delay_us) {
+		ev_idle_start(ps->loop, &ps->draw_idle);
+		return;
+	}
+	ev_timer_set(&ps->render_timer, (double)delay_us / 1000000.0, 0);
+	ev_timer_start(ps->loop, &ps->render_timer);
+}
+
 void queue_redraw(session_t *ps) {
+	if (ps->frame_scheduler.enabled) {
+		ps->redraw_needed = true;
+		schedule_render(ps);
+		return;
+	}
 	// If --benchmark is used, redraw is always queued
 	if (!ps->redraw_needed && !ps->o.benchmark) {
 		ev_idle_start(ps->loop, &ps->draw_idle);
@@ -281,6 +304,24 @@ static bool run_fade(session_t *ps, struct managed_win **_w, long long steps) {
 	return true;
 }
 
+/// Whether the window, placed at (x, y) with a size of width x height, would be
+/// completely hidden behind the opaque windows above it, going by its reg_ignore
+/// from the last frame. The shadow is included.
+static bool win_rect_obscured(const struct managed_win *w, int x, int y, int width, int height) {
+	if (!w->to_paint || !w->reg_ignore) {
+		// reg_ignore is only computed for painted windows
+		return false;
+	}
+	pixman_box32_t box = {.x1 = x, .y1 = y, .x2 = x + width, .y2 = y + height};
+	if (w->shadow) {
+		box.x1 = min2(box.x1, x + w->shadow_dx);
+		box.y1 = min2(box.y1, y + w->shadow_dy);
+		box.x2 = max2(box.x2, x + w->shadow_dx + w->shadow_width - w->widthb + width);
+		box.y2 = max2(box.y2, y + w->shadow_dy + w->shadow_height - w->heightb + height);
+	}
+	return pixman_region32_contains_rectangle(w->reg_ignore, &box) == PIXMAN_REGION_IN;
+}
+
 // === Error handling ===
 
 void discard_ignore(session_t *ps, unsigned long sequence) {
@@ -343,7 +384,7 @@ uint32_t determine_evmask(session_t *ps, xcb_window_t wid, win_evmode_t mode) {
 void update_ewmh_active_win(session_t *ps) {
 	// Search for the window
 	xcb_window_t wid =
-	    wid_get_prop_window(ps->c, ps->root, ps->atoms->a_NET_ACTIVE_WINDOW);
+	    wid_get_prop_window(ps, ps->root, ps->atoms->a_NET_ACTIVE_WINDOW);
 	auto w = find_win_all(ps, wid);
 
 	// Mark the window focused. No need to unfocus the previous one.
@@ -357,9 +398,9 @@ void update_ewmh_active_win(session_t *ps) {
  * to true.
  *
  * @param ps current session
- * @return struct _win of currently focused window, NULL if not found
+ * @param wid the window with the input focus
  */
-static void recheck_focus(session_t *ps) {
+static void recheck_focus(session_t *ps, xcb_window_t wid) {
 	// Use EWMH _NET_ACTIVE_WINDOW if enabled
 	if (ps->o.use_ewmh_active_win) {
 		update_ewmh_active_win(ps);
@@ -368,15 +409,6 @@ static void recheck_focus(session_t *ps) {
 
 	// Determine the currently focused window so we can apply appropriate
 	// opacity on it
-	xcb_window_t wid = XCB_NONE;
-	xcb_get_input_focus_reply_t *reply =
-	    xcb_get_input_focus_reply(ps->c, xcb_get_input_focus(ps->c), NULL);
-
-	if (reply) {
-		wid = reply->focus;
-		free(reply);
-	}
-
 	auto w = find_win_all(ps, wid);
 
 	log_trace("%#010" PRIx32 " (%#010lx \"%s\") focused.", wid,
@@ -405,6 +437,103 @@ static void rebuild_shadow_exclude_reg(session_t *ps) {
 		exit(1);
 }
 
+/// Key of `ps->shadow_contexts`
+struct shadow_context_key {
+	/// NULL for the legacy backends
+	backend_t *backend;
+	int radius;
+};
+
+static void *shadow_context_cache_create(void *user_data, const void *key) {
+	session_t *ps = user_data;
+	const struct shadow_context_key *k = key;
+	log_debug("Creating shadow context for radius %d (%" PRIu64 " hits, %" PRIu64
+	          " misses so far)",
+	          k->radius, ps->shadow_contexts.hits, ps->shadow_contexts.misses);
+	if (!k->backend) {
+		auto kernel = gaussian_kernel_autodetect_deviation(k->radius);
+		sum_kernel_preprocess(kernel);
+		return kernel;
+	}
+	return k->backend->ops->create_shadow_context(k->backend, k->radius);
+}
+
+static void shadow_context_cache_destroy(void *user_data, void *ctx) {
+	session_t *ps = user_data;
+	if (ps->o.legacy_backends) {
+		free_conv(ctx);
+	} else {
+		ps->backend_data->ops->destroy_shadow_context(ps->backend_data, ctx);
+	}
+}
+
+struct backend_shadow_context *session_get_shadow_context(session_t *ps, int radius) {
+	struct shadow_context_key key;
+	// Padding is part of the key
+	memset(&key, 0, sizeof(key));
+	key.backend = ps->o.legacy_backends ? NULL : ps->backend_data;
+	key.radius = radius;
+	return context_cache_get(&ps->shadow_contexts, &key);
+}
+
+void session_put_shadow_context(session_t *ps, struct backend_shadow_context *ctx) {
+	context_cache_put(&ps->shadow_contexts, ctx);
+}
+
+/// Key of `ps->blur_contexts`
+struct blur_context_key {
+	backend_t *backend;
+	enum blur_method method;
+	int size;
+	int strength;
+	double deviation;
+};
+
+static void *blur_context_cache_create(void *user_data attr_unused, const void *key) {
+	const struct blur_context_key *k = key;
+	struct gaussian_blur_args gargs = {.size = k->size, .deviation = k->deviation};
+	struct box_blur_args bargs = {.size = k->size};
+	struct dual_kawase_blur_args dkargs = {.size = k->size, .strength = k->strength};
+	void *args = NULL;
+	switch (k->method) {
+	case BLUR_METHOD_BOX: args = &bargs; break;
+	case BLUR_METHOD_GAUSSIAN: args = &gargs; break;
+	case BLUR_METHOD_DUAL_KAWASE: args = &dkargs; break;
+	default: unreachable;
+	}
+	return k->backend->ops->create_blur_context(k->backend, k->method, args);
+}
+
+static void blur_context_cache_destroy(void *user_data, void *ctx) {
+	session_t *ps = user_data;
+	ps->backend_data->ops->destroy_blur_context(ps->backend_data, ctx);
+}
+
+void *session_get_blur_context(session_t *ps, enum blur_method method, void *args) {
+	struct blur_context_key key;
+	// Padding is part of the key
+	memset(&key, 0, sizeof(key));
+	key.backend = ps->backend_data;
+	key.method = method;
+	switch (method) {
+	case BLUR_METHOD_BOX: key.size = ((struct box_blur_args *)args)->size; break;
+	case BLUR_METHOD_GAUSSIAN:
+		key.size = ((struct gaussian_blur_args *)args)->size;
+		key.deviation = ((struct gaussian_blur_args *)args)->deviation;
+		break;
+	case BLUR_METHOD_DUAL_KAWASE:
+		key.size = ((struct dual_kawase_blur_args *)args)->size;
+		key.strength = ((struct dual_kawase_blur_args *)args)->strength;
+		break;
+	default: log_error("Blur method %d can't be shared", method); return NULL;
+	}
+	return context_cache_get(&ps->blur_contexts, &key);
+}
+
+void session_put_blur_context(session_t *ps, void *ctx) {
+	context_cache_put(&ps->blur_contexts, ctx);
+}
+
 static void destroy_session_contexts(session_t *ps)
 {
 	if (ps->backend_blur_context)
@@ -415,12 +544,12 @@ static void destroy_session_contexts(session_t *ps)
 	}
 	if (ps->shadow_context)
 	{
-		ps->backend_data->ops->destroy_shadow_context(ps->backend_data, ps->shadow_context);
+		session_put_shadow_context(ps, ps->shadow_context);
 		ps->shadow_context = NULL;
 	}
 	if (ps->shadow_context_active)
 	{
-		ps->backend_data->ops->destroy_shadow_context(ps->backend_data, ps->shadow_context_active);
+		session_put_shadow_context(ps, ps->shadow_context_active);
 		ps->shadow_context_active = NULL;
 	}
 }
@@ -429,13 +558,12 @@ static void destroy_win_contexts(session_t *ps, struct managed_win *w)
 {
 	if(w->blur_context)
 	{
-		ps->backend_data->ops->destroy_blur_context(ps->backend_data, w->blur_context);
+		session_put_blur_context(ps, w->blur_context);
 		w->blur_context = NULL;
 	}
 	if(w->shadow_context)
 	{
-		if(ps->o.legacy_backends) free_conv((conv *)w->shadow_context);
-		else ps->backend_data->ops->destroy_shadow_context(ps->backend_data, w->shadow_context);
+		session_put_shadow_context(ps, w->shadow_context);
 		w->shadow_context = NULL;
 	}
 	if(w->shadow_picture)
@@ -492,6 +620,10 @@ static void destroy_backend(session_t *ps) {
 	if (ps->backend_data) {
 		// deinit backend
 		destroy_session_contexts(ps);
+		// Every window has put its contexts by now, this only catches leaks
+		// while the backend can still free them
+		context_cache_deinit(&ps->shadow_contexts);
+		context_cache_deinit(&ps->blur_contexts);
 		ps->backend_data->ops->deinit(ps->backend_data);
 		ps->backend_data = NULL;
 	}
@@ -546,15 +678,14 @@ static bool initialize_backend(session_t *ps) {
 		}
 		ps->backend_data->ops = backend_list[ps->o.backend];
 
-		ps->shadow_context = ps->backend_data->ops->create_shadow_context(
-		    ps->backend_data, ps->o.shadow_radius);
+		ps->shadow_context = session_get_shadow_context(ps, ps->o.shadow_radius);
 		if (!ps->shadow_context) {
 			log_fatal("Failed to initialize shadow context, aborting...");
 			goto err;
 		}
 
-		ps->shadow_context_active = ps->backend_data->ops->create_shadow_context(
-		    ps->backend_data, ps->o.shadow_radius_active);
+		ps->shadow_context_active =
+		    session_get_shadow_context(ps, ps->o.shadow_radius_active);
 		if (!ps->shadow_context_active) {
 			log_fatal("Failed to initialize shadow context for active windows, aborting...");
 			goto err;
@@ -734,118 +865,79 @@ paint_preprocess(session_t *ps, bool *fade_running, bool *animation) {
 	}
 	ps->fade_time += steps * ps->o.fade_delta;
 
-	if (ps->o.animations && !ps->animation_time)
-		ps->animation_time = now;
-
-	double delta_secs = (double)(now - ps->animation_time) / 1000;
-
-	// First, let's process fading, and animated shaders
-	// TODO(yshui) check if a window is fully obscured, and if we don't need to
-	//             process fading or animation for it.
+	// Window animations are advanced by whole steps of fixed length, so they play
+	// out the same whatever the frame rate is
+	unsigned animation_steps =
+	    animation_clock_tick(&ps->animation_clock, animation_now_ns());
+	const struct animation_spring spring = {
+	    .stiffness = ps->o.animation_stiffness,
+	    .dampening = ps->o.animation_dampening,
+	    .mass = ps->o.animation_window_mass,
+	    .clamping = ps->o.animation_clamping,
+	};
+	// All running animations are stepped at once, only the windows whose geometry
+	// changed get their new values written back
+	animation_table_step(&ps->animation_table, &spring, animation_steps);
+
+	// First, let's process fading, and animated shaders. Windows that were fully
+	// obscured in the last frame have their fading and animations fast-forwarded,
+	// and animated shaders on them don't cause repaints. Whether a window is
+	// obscured is known from its reg_ignore, as long as none of the windows above
+	// it changed since.
+	bool above_reg_ignore_valid = true;
 	win_stack_foreach_managed_safe(w, &ps->window_stack) {
 		const winmode_t mode_old = w->mode;
 		const bool was_painted = w->to_paint;
 		const double opacity_old = w->opacity;
+		const bool obscured =
+		    above_reg_ignore_valid &&
+		    win_rect_obscured(w, w->g.x, w->g.y, w->widthb, w->heightb);
 
 		// IMPORTANT: These window animation steps must happen before any other
 		// [pre]processing. This is because it changes the window's geometry.
-		if (!isnan(w->animation_progress) &&
-		    w->animation_progress <= 0.999999999 &&
+		if (!isnan(w->animation.progress) &&
+		    w->animation.progress <= 0.999999999 &&
 		    win_should_animate(ps, w)) {
 
 			if (win_check_flags_all(w, WIN_FLAGS_ANIMATION_BLACKLIST_OUT |
-									   WIN_FLAGS_ANIMATION_BLACKLIST_IN))
-			{
+			                               WIN_FLAGS_ANIMATION_BLACKLIST_IN)) {
 				win_clear_flags(w, WIN_FLAGS_ANIMATION_BLACKLIST_OUT |
-								   WIN_FLAGS_ANIMATION_BLACKLIST_IN);
-				delta_secs = 1;
+				                       WIN_FLAGS_ANIMATION_BLACKLIST_IN);
+				animation_table_remove(&ps->animation_table, &w->animation);
+				animation_finish(&w->animation);
+			} else if (obscured &&
+			           win_rect_obscured(
+			               w, (int)(w->animation.dest_center_x - w->animation.dest_w * 0.5),
+			               (int)(w->animation.dest_center_y - w->animation.dest_h * 0.5),
+			               (int)w->animation.dest_w + w->widthb - w->g.width,
+			               (int)w->animation.dest_h + w->heightb - w->g.height)) {
+				// Hidden where it is and where it's going, nobody would
+				// see the animation
+				animation_table_remove(&ps->animation_table, &w->animation);
+				animation_finish(&w->animation);
+			} else if (!w->animation.table_row) {
+				// Newly started, it's stepped from the next frame on
+				animation_table_add(&ps->animation_table, &w->animation);
 			}
 
-			double neg_displacement_x =
-			    w->animation_dest_center_x - w->animation_center_x;
-			double neg_displacement_y =
-			    w->animation_dest_center_y - w->animation_center_y;
-			double neg_displacement_w = w->animation_dest_w - w->animation_w;
-			double neg_displacement_h = w->animation_dest_h - w->animation_h;
-			double animation_stiffness = ps->o.animation_stiffness;
-
 			if (w->state == WSTATE_FADING)
 				w->opacity_target = win_calc_opacity_target(ps, w);
+			*animation = true;
+		} else if (w->animation.table_row) {
+			// Not supposed to animate anymore, stop where it is
+			animation_table_remove(&ps->animation_table, &w->animation);
+		}
 
-			double acceleration_x =
-			    (animation_stiffness * neg_displacement_x -
-			     ps->o.animation_dampening * w->animation_velocity_x) /
-			    ps->o.animation_window_mass;
-			double acceleration_y =
-			    (animation_stiffness * neg_displacement_y -
-			     ps->o.animation_dampening * w->animation_velocity_y) /
-			    ps->o.animation_window_mass;
-			double acceleration_w =
-			    (animation_stiffness * neg_displacement_w -
-			     ps->o.animation_dampening * w->animation_velocity_w) /
-			    ps->o.animation_window_mass;
-			double acceleration_h =
-			    (animation_stiffness * neg_displacement_h -
-			     ps->o.animation_dampening * w->animation_velocity_h) /
-			    ps->o.animation_window_mass;
-
-			w->animation_velocity_x += acceleration_x * delta_secs;
-			w->animation_velocity_y += acceleration_y * delta_secs;
-			w->animation_velocity_w += acceleration_w * delta_secs;
-			w->animation_velocity_h += acceleration_h * delta_secs;
-
-			// Animate window geometry
-			double new_animation_x =
-			    w->animation_center_x + w->animation_velocity_x * delta_secs;
-			double new_animation_y =
-			    w->animation_center_y + w->animation_velocity_y * delta_secs;
-			double new_animation_w =
-			    w->animation_w + w->animation_velocity_w * delta_secs;
-			double new_animation_h =
-			    w->animation_h + w->animation_velocity_h * delta_secs;
-
-			// Negative new width/height causes segfault and it can happen
-			// when clamping disabled and shading a window
-			if (new_animation_h < 0)
-				new_animation_h = 0;
-
-			if (new_animation_w < 0)
-				new_animation_w = 0;
-
-			if (ps->o.animation_clamping) {
-				w->animation_center_x = clamp(
-					new_animation_x,
-					min2(w->animation_center_x, w->animation_dest_center_x),
-					max2(w->animation_center_x, w->animation_dest_center_x));
-				w->animation_center_y = clamp(
-					new_animation_y,
-					min2(w->animation_center_y, w->animation_dest_center_y),
-					max2(w->animation_center_y, w->animation_dest_center_y));
-				w->animation_w =
-					clamp(new_animation_w,
-							min2(w->animation_w, w->animation_dest_w),
-							max2(w->animation_w, w->animation_dest_w));
-				w->animation_h =
-					clamp(new_animation_h,
-							min2(w->animation_h, w->animation_dest_h),
-				 			max2(w->animation_h, w->animation_dest_h));
-			} else {
-				w->animation_center_x = new_animation_x;
-				w->animation_center_y = new_animation_y;
-				w->animation_w = new_animation_w;
-				w->animation_h = new_animation_h;
-			}
-
-			// Now we are done doing the math; we just need to submit our
-			// changes (if there are any).
-
+		if (w->animation.updated) {
+			w->animation.updated = false;
 			struct win_geometry old_g = w->g;
-			double old_animation_progress = w->animation_progress;
 
-			new_animation_x = round(w->animation_center_x - w->animation_w * 0.5);
-			new_animation_y = round(w->animation_center_y - w->animation_h * 0.5);
-			new_animation_w = round(w->animation_w);
-			new_animation_h = round(w->animation_h);
+			// The table has done the math; we just need to submit our
+			// changes (if there are any).
+			double new_animation_x = round(w->animation.center_x - w->animation.w * 0.5);
+			double new_animation_y = round(w->animation.center_y - w->animation.h * 0.5);
+			double new_animation_w = round(w->animation.w);
+			double new_animation_h = round(w->animation.h);
 
 			bool position_changed =
 			    new_animation_x != old_g.x || new_animation_y != old_g.y;
@@ -853,32 +945,18 @@ paint_preprocess(session_t *ps, bool *fade_running, bool *animation) {
 			                    new_animation_h != old_g.height;
 			bool geometry_changed = position_changed || size_changed;
 
-			// Mark past window region with damage
-			if (was_painted && geometry_changed)
+			// Mark past window region with damage. The new backends
+			// derive this from the layouts.
+			if (was_painted && geometry_changed && ps->o.legacy_backends)
 				add_damage_from_win(ps, w);
 
-			double x_dist = w->animation_dest_center_x - w->animation_center_x;
-			double y_dist = w->animation_dest_center_y - w->animation_center_y;
-			double w_dist = w->animation_dest_w - w->animation_w;
-			double h_dist = w->animation_dest_h - w->animation_h;
-
-			w->animation_progress =
-			    1.0 - w->animation_inv_og_distance *
-			              sqrt(x_dist * x_dist + y_dist * y_dist +
-			                   w_dist * w_dist + h_dist * h_dist);
-
-			// When clamping disabled we don't want the overlayed image to
-			// fade in again because process is moving to negative value
-			if (w->animation_progress < old_animation_progress)
-				w->animation_progress = old_animation_progress;
-
 			w->g.x = (int16_t)new_animation_x;
 			w->g.y = (int16_t)new_animation_y;
 			w->g.width = (uint16_t)new_animation_w;
 			w->g.height = (uint16_t)new_animation_h;
 
 			if (((w->g.width == 0 || w->g.height == 0) &&
-			     (w->animation_dest_w == 0 || w->animation_dest_h == 0))) {
+			     (w->animation.dest_w == 0 || w->animation.dest_h == 0))) {
 				w->g.x = w->pending_g.x;
 				w->g.y = w->pending_g.y;
 
@@ -886,52 +964,30 @@ paint_preprocess(session_t *ps, bool *fade_running, bool *animation) {
 				w->g.height = 0;
 			}
 
-			// Submit window size change
-			if (size_changed) 
-			{
+			// Submit window size change. The new backends stretch the
+			// images to the animated size, the legacy ones need them
+			// rebuilt.
+			if (size_changed && !ps->o.legacy_backends) {
+				win_on_win_animated_size_change(ps, w);
+			} else if (size_changed) {
 				win_on_win_size_change(ps, w);
 
-				pixman_region32_clear(&w->bounding_shape);
-				pixman_region32_fini(&w->bounding_shape);
-				pixman_region32_init_rect(&w->bounding_shape, 0, 0, (uint)w->widthb, (uint)w->heightb);
-
-				if(w->bounding_shaped)
-				{
-					xcb_shape_get_rectangles_reply_t *r = xcb_shape_get_rectangles_reply(ps->c, xcb_shape_get_rectangles(ps->c, w->base.id, XCB_SHAPE_SK_BOUNDING), NULL);
-					if (r) 
-					{
-						xcb_rectangle_t *xrects = xcb_shape_get_rectangles_rectangles(r);
-						int nrects = xcb_shape_get_rectangles_rectangles_length(r);
-						rect_t *rects = from_x_rects(nrects, xrects);
-						free(r);
-
-						region_t br;
-						pixman_region32_init_rects(&br, rects, nrects);
-						free(rects);
-
-						pixman_region32_translate(&br, w->g.border_width, w->g.border_width);
-						pixman_region32_intersect(&w->bounding_shape, &w->bounding_shape, &br);
-						pixman_region32_fini(&br);
-					}
-				}
+				// The X bounding shape is cached, and only refetched
+				// on ShapeNotify, so no round trip here.
+				win_clip_bounding_shape(w);
 
 				win_clear_flags(w, WIN_FLAGS_PIXMAP_STALE);
 				win_process_image_flags(ps, w);
 			}
 			// Mark new window region with damage
 			if (was_painted && geometry_changed) {
-				add_damage_from_win(ps, w);
+				if (ps->o.legacy_backends) {
+					add_damage_from_win(ps, w);
+				}
 				w->reg_ignore_valid = false;
 			}
 
-			// We can't check for 1 here as sometimes 1 = 0.999999999999999
-			// in case of floating numbers
-			if (w->animation_progress >= 0.999999999) {
-				w->animation_progress = 1;
-				w->animation_velocity_x = 0.0;
-				w->animation_velocity_y = 0.0;
-				w->animation_velocity_w = 0.0;
-				w->animation_velocity_h = 0.0;
+			if (w->animation.progress == 1) {
 				w->opacity = win_calc_opacity_target(ps, w);
 			}
 			*animation = true;
@@ -942,11 +998,17 @@ paint_preprocess(session_t *ps, bool *fade_running, bool *animation) {
 			add_damage_from_win(ps, w);
 		}
 
-		if (w->fg_shader && (w->fg_shader->attributes & SHADER_ATTRIBUTE_ANIMATED)) {
+		if (w->fg_shader && (w->fg_shader->attributes & SHADER_ATTRIBUTE_ANIMATED) &&
+		    !obscured) {
 			add_damage_from_win(ps, w);
 			*animation = true;
 		}
 
+		if (obscured && w->opacity != w->opacity_target) {
+			// Nobody can see the fade, skip to its end
+			w->opacity = w->opacity_target;
+		}
+
 		// Run fading
 		if (run_fade(ps, &w, steps)) {
 			*fade_running = true;
@@ -956,12 +1018,14 @@ paint_preprocess(session_t *ps, bool *fade_running, bool *animation) {
 		// If was_painted == false, and to_paint is also false, we don't care
 		// If was_painted == false, but to_paint is true, damage will be added in
 		// the loop below
-		if (was_painted && w->opacity != opacity_old) {
+		// The new backends derive this from the layouts.
+		if (was_painted && w->opacity != opacity_old && ps->o.legacy_backends) {
 			add_damage_from_win(ps, w);
 		}
 
 		if (win_check_fade_finished(ps, w)) {
 			// the window has been destroyed because fading finished
+			above_reg_ignore_valid = false;
 			continue;
 		}
 
@@ -979,11 +1043,9 @@ paint_preprocess(session_t *ps, bool *fade_running, bool *animation) {
 		if (was_painted && w->mode != mode_old) {
 			w->reg_ignore_valid = false;
 		}
+		above_reg_ignore_valid = above_reg_ignore_valid && w->reg_ignore_valid;
 	}
 
-	if (animation)
-		ps->animation_time = now;
-
 	// Opacity will not change, from now on.
 	rc_region_t *last_reg_ignore = rc_region_new();
 
@@ -1173,6 +1235,80 @@ paint_preprocess(session_t *ps, bool *fade_running, bool *animation) {
 	return bottom;
 }
 
+/// Add a mapped, damaged, opaque window to the bottom of the stack, for testing
+static struct managed_win *
+test_add_win(session_t *ps, xcb_window_t id, int x, int y, int width, int height) {
+	auto w = ccalloc(1, struct managed_win);
+	w->base.id = id;
+	w->base.managed = true;
+	w->state = WSTATE_MAPPED;
+	w->g = (struct win_geometry){.x = (int16_t)x,
+	                             .y = (int16_t)y,
+	                             .width = (uint16_t)width,
+	                             .height = (uint16_t)height};
+	w->widthb = width;
+	w->heightb = height;
+	w->opacity = w->opacity_target = 1;
+	w->fade_force = UNSET;
+	w->ever_damaged = true;
+	pixman_region32_init_rect(&w->bounding_shape, 0, 0, (uint)width, (uint)height);
+	list_insert_before(&ps->window_stack, &w->base.stack_neighbour);
+	return w;
+}
+
+TEST_CASE(paint_preprocess_uncovered_by_restack) {
+	auto ps = ccalloc(1, session_t);
+	region_t damage;
+	pixman_region32_init(&damage);
+	ps->damage = &damage;
+	ps->redirected = true;
+	ps->root_width = ps->root_height = 100;
+	ps->o.redirected_force = UNSET;
+	ps->o.fade_delta = 10;
+	ps->o.fade_in_step = 0.01;
+	list_init_head(&ps->window_stack);
+
+	// `top` covers `below` entirely, and an animated shader runs on `below`
+	auto top = test_add_win(ps, 1, 0, 0, 100, 100);
+	auto below = test_add_win(ps, 2, 10, 10, 50, 50);
+	struct shader_info shader = {.attributes = SHADER_ATTRIBUTE_ANIMATED};
+	below->fg_shader = &shader;
+	const pixman_box32_t below_box = {.x1 = 10, .y1 = 10, .x2 = 60, .y2 = 60};
+
+	bool fade_running, animation;
+	paint_preprocess(ps, &fade_running, &animation);
+	TEST_TRUE(below->to_paint);
+	TEST_TRUE(animation);
+
+	// Once the last frame showed it's covered, the shader doesn't cause repaints
+	pixman_region32_clear(&damage);
+	paint_preprocess(ps, &fade_running, &animation);
+	TEST_TRUE(!animation);
+	TEST_TRUE(!pixman_region32_not_empty(&damage));
+
+	// `top` goes below it, and `below` starts fading, before the next frame
+	restack_bottom(ps, &top->base);
+	pixman_region32_clear(&damage);
+	below->state = WSTATE_FADING;
+	below->fade_force = ON;
+	below->opacity = 0.5;
+
+	paint_preprocess(ps, &fade_running, &animation);
+	TEST_TRUE(below->to_paint);
+	TEST_TRUE(animation);
+	TEST_TRUE(fade_running);
+	TEST_TRUE(below->opacity < 1);
+	TEST_EQUAL(pixman_region32_contains_rectangle(&damage, &below_box), PIXMAN_REGION_IN);
+
+	win_stack_foreach_managed_safe(w, &ps->window_stack) {
+		rc_region_unref(&w->reg_ignore);
+		pixman_region32_fini(&w->bounding_shape);
+		free(w);
+	}
+	pixman_region32_fini(&damage);
+	free(ps);
+}
+
 void root_damaged(session_t *ps) {
 	if (ps->root_tile_paint.pixmap) {
 		free_root_tile(ps);
@@ -1597,10 +1733,30 @@ static void unredirect(session_t *ps) {
 static void handle_queued_x_events(EV_P attr_unused, ev_prepare *w, int revents attr_unused) {
 	session_t *ps = session_ptr(w, event_check);
 	xcb_generic_event_t *ev;
-	while ((ev = xcb_poll_for_queued_event(ps->c))) {
-		ev_handle(ps, ev);
-		free(ev);
-	};
+	uint64_t start_us = 0;
+	do {
+		while ((ev = xcb_poll_for_queued_event(ps->c))) {
+			if (!start_us) {
+				start_us = frame_stats_now_us();
+			}
+			ev_handle(ps, ev);
+			free(ev);
+		};
+		// The values of the properties recorded in the event trace are read all
+		// together, waiting for them can queue more events.
+	} while (ps->event_trace && event_trace_flush(ps->event_trace, ps->c, ps->atoms));
+	if (start_us) {
+		frame_stats_record_since(&ps->frame_stats, FRAME_STAGE_X_EVENTS, start_us);
+	}
+	frame_scheduler_handle_events(&ps->frame_scheduler, ps->c);
+	if (ps->backend_data && ps->backend_data->ops->handle_events) {
+		ps->backend_data->ops->handle_events(ps->backend_data);
+	}
+	if (ps->redraw_deferred && (!ps->backend_data || !ps->backend_data->busy)) {
+		// The backend became ready (or went away), resume painting
+		ps->redraw_deferred = false;
+		schedule_render(ps);
+	}
 	// Flush because if we go into sleep when there is still
 	// requests in the outgoing buffer, they will not be sent
 	// for an indefinite amount of time.
@@ -1615,33 +1771,71 @@ static void handle_queued_x_events(EV_P attr_unused, ev_prepare *w, int revents
 	}
 }
 
-static void handle_new_windows(session_t *ps) {
-	list_foreach_safe(struct win, w, &ps->window_stack, stack_neighbour) {
+/// Start managing the new windows, all together. Returns how many there were.
+static unsigned handle_new_windows(session_t *ps) {
+	unsigned n = 0;
+	list_foreach(struct win, w, &ps->window_stack, stack_neighbour) {
 		if (w->is_new) {
-			auto new_w = fill_win(ps, w);
-			if (!new_w->managed) {
-				continue;
-			}
-			auto mw = (struct managed_win *)new_w;
-			if (mw->a.map_state == XCB_MAP_STATE_VIEWABLE) {
-				win_set_flags(mw, WIN_FLAGS_MAPPED);
-
-				// This window might be damaged before we called fill_win
-				// and created the damage handle. And there is no way for
-				// us to find out. So just blindly mark it damaged
-				mw->ever_damaged = true;
-			}
+			n++;
 		}
 	}
+	if (!n) {
+		return 0;
+	}
+
+	auto ws = ccalloc(n, struct win *);
+	n = 0;
+	list_foreach(struct win, w, &ps->window_stack, stack_neighbour) {
+		if (w->is_new) {
+			ws[n++] = w;
+		}
+	}
+	fill_wins(ps, ws, n);
+
+	for (unsigned i = 0; i < n; i++) {
+		if (!ws[i]->managed) {
+			continue;
+		}
+		auto mw = (struct managed_win *)ws[i];
+		if (mw->a.map_state == XCB_MAP_STATE_VIEWABLE) {
+			win_set_flags(mw, WIN_FLAGS_MAPPED);
+
+			// This window might be damaged before we called fill_win
+			// and created the damage handle. And there is no way for
+			// us to find out. So just blindly mark it damaged
+			mw->ever_damaged = true;
+		}
+	}
+	free(ws);
+	return n;
 }
 
 static void refresh_windows(session_t *ps) {
+	// Send the requests for the stale properties of all windows first, so they
+	// are all read after a single round trip
+	win_stack_foreach_managed(w, &ps->window_stack) {
+		win_request_stale_properties(ps, w);
+	}
+	x_prop_batch_collect(&ps->prop_batch, ps->c);
+
 	win_stack_foreach_managed(w, &ps->window_stack) {
 		win_process_update_flags(ps, w);
 	}
+	x_prop_batch_clear(&ps->prop_batch);
 }
 
+/// Match the rules and bind the images of all windows whose flags ask for it. This
+/// doesn't need the X critical section.
 static void refresh_images(session_t *ps) {
+	// The properties the rules read are fetched for all windows at once
+	win_stack_foreach_managed(w, &ps->window_stack) {
+		win_request_factor_change_properties(ps, w);
+	}
+	x_prop_batch_collect(&ps->prop_batch, ps->c);
+	win_stack_foreach_managed(w, &ps->window_stack) {
+		win_process_factor_change_flags(ps, w);
+	}
+	x_prop_batch_clear(&ps->prop_batch);
 	win_stack_foreach_managed(w, &ps->window_stack) {
 		win_process_image_flags(ps, w);
 	}
@@ -1661,10 +1855,20 @@ static void fade_timer_callback(EV_P attr_unused, ev_timer *w, int revents attr_
 	queue_redraw(ps);
 }
 
+static void render_timer_callback(EV_P_ ev_timer *w, int revents attr_unused) {
+	session_t *ps = session_ptr(w, render_timer);
+	ev_idle_start(EV_A_ & ps->draw_idle);
+}
+
 static void handle_pending_updates(EV_P_ struct session *ps) {
 	if (ps->pending_updates) {
 		log_debug("Delayed handling of events, entering critical section");
-		auto e = xcb_request_check(ps->c, xcb_grab_server_checked(ps->c));
+		auto start_us = frame_stats_now_us();
+		auto grab = xcb_grab_server_checked(ps->c);
+		// Asked for now, read after the other fetches of the critical section,
+		// so it doesn't need a round trip of its own
+		auto focus = xcb_get_input_focus(ps->c);
+		auto e = xcb_request_check(ps->c, grab);
 		if (e) {
 			log_fatal_x_error(e, "failed to grab x server");
 			free(e);
@@ -1677,7 +1881,9 @@ static void handle_pending_updates(EV_P_ struct session *ps) {
 		handle_queued_x_events(EV_A_ & ps->event_check, 0);
 
 		// Call fill_win on new windows
-		handle_new_windows(ps);
+		auto adopt_start_us = frame_stats_now_us();
+		auto nnew = handle_new_windows(ps);
+		auto adopt_us = frame_stats_now_us() - adopt_start_us;
 
 		// Handle screen changes
 		// This HAS TO be called before refresh_windows, as handle_root_flags
@@ -1689,16 +1895,16 @@ static void handle_pending_updates(EV_P_ struct session *ps) {
 		refresh_windows(ps);
 
 		{
-			auto r = xcb_get_input_focus_reply(
-			    ps->c, xcb_get_input_focus(ps->c), NULL);
+			auto r = xcb_get_input_focus_reply(ps->c, focus, NULL);
 			if (!ps->active_win || (r && r->focus != ps->active_win->base.id)) {
-				recheck_focus(ps);
+				recheck_focus(ps, r ? r->focus : XCB_NONE);
 			}
 			free(r);
 		}
 
-		// Process window flags (stale images)
-		refresh_images(ps);
+		// New pixmaps have to be named while the windows are known to be
+		// mapped, binding them can wait
+		win_name_stale_pixmaps(ps);
 
 		e = xcb_request_check(ps->c, xcb_ungrab_server_checked(ps->c));
 		if (e) {
@@ -1708,7 +1914,21 @@ static void handle_pending_updates(EV_P_ struct session *ps) {
 		}
 
 		ps->server_grabbed = false;
+		frame_stats_record_since(&ps->frame_stats, FRAME_STAGE_SERVER_GRAB,
+		                         start_us);
+
+		// Process window flags (rules and stale images)
+		refresh_images(ps);
+
 		ps->pending_updates = false;
+		if (ps->first_frame && nnew) {
+			// Startup or reset, when all the existing windows are taken in
+			log_info("Adopted %u windows in %" PRIu64 " us, %" PRIu64
+			         " us with their first update",
+			         nnew, adopt_us, frame_stats_now_us() - start_us);
+		}
+		frame_stats_record_since(&ps->frame_stats, FRAME_STAGE_PENDING_UPDATES,
+		                         start_us);
 		log_debug("Exited critical section");
 	}
 }
@@ -1749,7 +1969,9 @@ static void draw_callback_impl(EV_P_ session_t *ps, int revents attr_unused) {
 	bool fade_running = false;
 	bool animation = false;
 	bool was_redirected = ps->redirected;
+	auto preprocess_start_us = frame_stats_now_us();
 	auto bottom = paint_preprocess(ps, &fade_running, &animation);
+	frame_stats_record_since(&ps->frame_stats, FRAME_STAGE_PREPROCESS, preprocess_start_us);
 	ps->tmout_unredir_hit = false;
 
 	if (!was_redirected && ps->redirected) {
@@ -1787,8 +2009,10 @@ static void draw_callback_impl(EV_P_ session_t *ps, int revents attr_unused) {
 		log_trace("Render start, frame %d", paint);
 		if (!ps->o.legacy_backends) 
 		{
+			auto layout_start_us = frame_stats_now_us();
 			layout_manager_append_layout(ps->layout_manager, &ps->window_stack, ps->root_image_generation,
 			    						(struct geometry){.width = ps->root_width, .height = ps->root_height});
+			frame_stats_record_since(&ps->frame_stats, FRAME_STAGE_LAYOUT, layout_start_us);
 
 			paint_all_new(ps, false);
 		} 
@@ -1800,7 +2024,12 @@ static void draw_callback_impl(EV_P_ session_t *ps, int revents attr_unused) {
 		ps->first_frame = false;
 		paint++;
 		if (ps->o.benchmark && paint >= ps->o.benchmark) {
-			exit(0);
+			if (!ps->benchmark.frames) {
+				exit(0);
+			}
+			// Leave the main loop normally, so the report gets written when
+			// the session is destroyed.
+			quit(ps);
 		}
 	}
 
@@ -1808,7 +2037,7 @@ static void draw_callback_impl(EV_P_ session_t *ps, int revents attr_unused) {
 		ps->fade_time = 0L;
 	}
 	if (!animation) {
-		ps->animation_time = 0L;
+		animation_clock_stop(&ps->animation_clock);
 	}
 
 	// TODO(yshui) Investigate how big the X critical section needs to be. There are
@@ -1820,7 +2049,37 @@ static void draw_callback_impl(EV_P_ session_t *ps, int revents attr_unused) {
 static void draw_callback(EV_P_ ev_idle *w, int revents) {
 	session_t *ps = session_ptr(w, draw_idle);
 
+	if (ps->backend_data && ps->backend_data->busy) {
+		// The last frame is still in flight, painting now would block until it
+		// completes. Keep handling X events instead, handle_queued_x_events
+		// restarts us once the backend is ready.
+		ps->redraw_deferred = true;
+		ev_idle_stop(EV_A_ w);
+		return;
+	}
+
+	if (ps->benchmark.frames) {
+		benchmark_begin_frame(&ps->benchmark, ps->backend_data);
+	}
+	auto start_us = frame_stats_now_us();
+	frame_scheduler_begin_frame(&ps->frame_scheduler, start_us);
 	draw_callback_impl(EV_A_ ps, revents);
+	frame_stats_record_since(&ps->frame_stats, FRAME_STAGE_FRAME, start_us);
+	if (ps->benchmark.frames) {
+		benchmark_end_frame(&ps->benchmark, ps->backend_data);
+	}
+
+	if (ps->frame_scheduler.enabled) {
+		frame_scheduler_add_render_time(&ps->frame_scheduler,
+		                                frame_stats_now_us() - start_us);
+		// Wait for the scheduler before painting again, instead of painting
+		// whenever the loop is idle
+		ev_idle_stop(EV_A_ & ps->draw_idle);
+		if (ps->redraw_needed) {
+			schedule_render(ps);
+		}
+		return;
+	}
 
 	// Don't do painting non-stop unless we are in benchmark mode, or if
 	// draw_callback_impl thinks we should continue painting.
@@ -1833,8 +2092,10 @@ static void x_event_callback(EV_P attr_unused, ev_io *w, int revents attr_unused
 	session_t *ps = (session_t *)w;
 	xcb_generic_event_t *ev = xcb_poll_for_event(ps->c);
 	if (ev) {
+		auto start_us = frame_stats_now_us();
 		ev_handle(ps, ev);
 		free(ev);
+		frame_stats_record_since(&ps->frame_stats, FRAME_STAGE_X_EVENTS, start_us);
 	}
 }
 
@@ -1921,11 +2182,14 @@ static bool load_shader_source_for_condition(const c2_lptr_t *cond, void *data)
  * @param argc number of commandline arguments
  * @param argv commandline arguments
  * @param dpy  the X Display
+ * @param event_trace the event trace, kept across resets. Opened if it's NULL and
+ *                    events are to be recorded.
  * @param config_file the path to the config file
  * @param all_xerros whether we should report all X errors
  * @param fork whether we will fork after initialization
  */
 static session_t *session_init(int argc, char **argv, Display *dpy,
+                               struct event_trace **event_trace,
                                const char *config_file, bool all_xerrors, bool fork) {
 	static const session_t s_def = {
 	    .backend_data = NULL,
@@ -1945,7 +2209,6 @@ static session_t *session_init(int argc, char **argv, Display *dpy,
 	    .tgt_picture = XCB_NONE,
 	    .tgt_buffer = PAINT_INIT,
 	    .reg_win = XCB_NONE,
-		.animation_time = 0L, // Kirill
 #ifdef CONFIG_OPENGL
 	    .glx_prog_win = GLX_PROG_MAIN_INIT,
 #endif
@@ -2151,6 +2414,20 @@ static session_t *session_init(int argc, char **argv, Display *dpy,
 		log_debug("Default window shader: \"%s\"", ps->o.window_shader_fg);
 	}
 
+	if (ps->o.benchmark && ps->o.benchmark_report) {
+		benchmark_init(&ps->benchmark, ps->o.benchmark);
+	}
+
+	if (ps->o.record_events) {
+		if (*event_trace) {
+			// The windows are recorded again, when they are queried below
+			event_trace_record_reset(*event_trace);
+		} else {
+			*event_trace = event_trace_open(ps->o.record_events, ps->root);
+		}
+		ps->event_trace = *event_trace;
+	}
+
 	if (ps->o.logpath) {
 		auto l = file_logger_new(ps->o.logpath);
 		if (l) {
@@ -2201,7 +2478,8 @@ static session_t *session_init(int argc, char **argv, Display *dpy,
     	ps->o.opacity_rules=0;
     }
 
-	// Get needed atoms for c2 condition lists
+	// Get needed atoms for c2 condition lists, and compile them
+	ps->c2_state = c2_state_new();
 	if (!(c2_list_postprocess(ps, ps->o.unredir_if_possible_blacklist) &&
 	      c2_list_postprocess(ps, ps->o.paint_blacklist) &&
 	      c2_list_postprocess(ps, ps->o.shadow_blacklist) &&
@@ -2247,14 +2525,15 @@ static session_t *session_init(int argc, char **argv, Display *dpy,
 		}
 	}
 
+	animation_table_init(&ps->animation_table);
+	context_cache_init(&ps->shadow_contexts, sizeof(struct shadow_context_key), ps,
+	                   shadow_context_cache_create, shadow_context_cache_destroy);
+	context_cache_init(&ps->blur_contexts, sizeof(struct blur_context_key), ps,
+	                   blur_context_cache_create, blur_context_cache_destroy);
 	if (ps->o.legacy_backends) {
-		ps->shadow_context =
-		    (void *)gaussian_kernel_autodetect_deviation(ps->o.shadow_radius);
-		sum_kernel_preprocess((conv *)ps->shadow_context);
-
+		ps->shadow_context = session_get_shadow_context(ps, ps->o.shadow_radius);
 		ps->shadow_context_active =
-		    (void *)gaussian_kernel_autodetect_deviation(ps->o.shadow_radius_active);
-		sum_kernel_preprocess((conv *)ps->shadow_context_active);
+		    session_get_shadow_context(ps, ps->o.shadow_radius_active);
 	}
 
 	rebuild_shadow_exclude_reg(ps);
@@ -2457,6 +2736,11 @@ static session_t *session_init(int argc, char **argv, Display *dpy,
 	ev_io_start(ps->loop, &ps->xiow);
 	ev_init(&ps->unredir_timer, tmout_unredir_callback);
 	ev_idle_init(&ps->draw_idle, draw_callback);
+	ev_init(&ps->render_timer, render_timer_callback);
+	if (ps->o.frame_pacing && ps->present_exists && !ps->o.benchmark) {
+		frame_scheduler_init(&ps->frame_scheduler, ps->c,
+		                     session_get_target_window(ps));
+	}
 
 	ev_init(&ps->fade_timer, fade_timer_callback);
 
@@ -2534,6 +2818,10 @@ static session_t *session_init(int argc, char **argv, Display *dpy,
 		children = xcb_query_tree_children(query_tree_reply);
 		nchildren = xcb_query_tree_children_length(query_tree_reply);
 
+		if (ps->event_trace) {
+			event_trace_record_tree(ps->event_trace, ps->c, children, nchildren);
+		}
+
 		for (int i = 0; i < nchildren; i++) {
 			add_win_above(ps, children[i], i ? children[i - 1] : XCB_NONE);
 		}
@@ -2574,6 +2862,43 @@ static void session_destroy(session_t *ps) {
 		unredirect(ps);
 	}
 
+	if (ps->o.frame_stats_file) {
+		auto f = fopen(ps->o.frame_stats_file, "w");
+		if (!f || !frame_stats_dump(&ps->frame_stats, f)) {
+			log_error("Failed to write frame statistics to %s",
+			          ps->o.frame_stats_file);
+		}
+		if (f) {
+			fclose(f);
+		}
+	}
+
+	if (ps->benchmark.frames) {
+		int nwindows = 0;
+		win_stack_foreach_managed(w, &ps->window_stack) {
+			if (w->state == WSTATE_MAPPED) {
+				nwindows++;
+			}
+		}
+		auto f = fopen(ps->o.benchmark_report, "w");
+		if (!f || !benchmark_write_report(&ps->benchmark, BACKEND_STRS[ps->o.backend],
+		                                  nwindows, f)) {
+			log_error("Failed to write benchmark report to %s",
+			          ps->o.benchmark_report);
+		}
+		if (f) {
+			fclose(f);
+		}
+		benchmark_deinit(&ps->benchmark);
+	}
+
+	if (ps->event_trace) {
+		// The trace is closed by main, but the properties have to be read while
+		// there is a connection
+		event_trace_flush(ps->event_trace, ps->c, ps->atoms);
+		ps->event_trace = NULL;
+	}
+
 	file_watch_destroy(ps->loop, ps->file_watch_handle);
 	ps->file_watch_handle = NULL;
 
@@ -2604,6 +2929,8 @@ static void session_destroy(session_t *ps) {
 		free(w);
 	}
 	list_init_head(&ps->window_stack);
+	animation_table_deinit(&ps->animation_table);
+	x_prop_batch_deinit(&ps->prop_batch);
 
 	// Free blacklists
 	c2_list_free(&ps->o.shadow_blacklist, NULL);
@@ -2642,6 +2969,8 @@ static void session_destroy(session_t *ps) {
 
 		ps->track_atom_lst = NULL;
 	}
+	c2_state_free(ps->c2_state);
+	ps->c2_state = NULL;
 
 	// Free ignore linked list
 	{
@@ -2674,6 +3003,9 @@ static void session_destroy(session_t *ps) {
 
 	free(ps->o.write_pid_path);
 	free(ps->o.logpath);
+	free(ps->o.frame_stats_file);
+	free(ps->o.benchmark_report);
+	free(ps->o.record_events);
 	for (int i = 0; i < ps->o.blur_kernel_count; ++i) {
 		free(ps->o.blur_kerns[i]);
 	}
@@ -2741,13 +3073,21 @@ static void session_destroy(session_t *ps) {
 	}
 #endif
 
+	frame_scheduler_deinit(&ps->frame_scheduler, ps->c);
+
 	// Flush all events
 	x_sync(ps->c);
 	ev_io_stop(ps->loop, &ps->xiow);
-	if (ps->o.legacy_backends) {
-		free_conv((conv *)ps->shadow_context);
-		free_conv((conv *)ps->shadow_context_active);
-	}
+	if (ps->o.legacy_backends && ps->shadow_context) {
+		session_put_shadow_context(ps, ps->shadow_context);
+		session_put_shadow_context(ps, ps->shadow_context_active);
+	}
+	log_debug("Shadow context cache: %" PRIu64 " hits, %" PRIu64 " misses",
+	          ps->shadow_contexts.hits, ps->shadow_contexts.misses);
+	log_debug("Blur context cache: %" PRIu64 " hits, %" PRIu64 " misses",
+	          ps->blur_contexts.hits, ps->blur_contexts.misses);
+	context_cache_deinit(&ps->shadow_contexts);
+	context_cache_deinit(&ps->blur_contexts);
 	destroy_atoms(ps->atoms);
 
 #ifdef DEBUG_XRC
@@ -2761,6 +3101,7 @@ static void session_destroy(session_t *ps) {
 	ev_timer_stop(ps->loop, &ps->unredir_timer);
 	ev_timer_stop(ps->loop, &ps->fade_timer);
 	ev_idle_stop(ps->loop, &ps->draw_idle);
+	ev_timer_stop(ps->loop, &ps->render_timer);
 	ev_prepare_stop(ps->loop, &ps->event_check);
 	ev_signal_stop(ps->loop, &ps->usr1_signal);
 	ev_signal_stop(ps->loop, &ps->int_signal);
@@ -2842,6 +3183,8 @@ int main(int argc, char **argv) {
 	bool quit = false;
 	int ret_code = 0;
 	char *pid_file = NULL;
+	// Kept across resets, so the trace isn't truncated by them
+	struct event_trace *event_trace = NULL;
 
 	do {
 		Display *dpy = XOpenDisplay(NULL);
@@ -2857,7 +3200,8 @@ int main(int argc, char **argv) {
 		log_deinit_tls();
 		log_init_tls();
 
-		ps_g = session_init(argc, argv, dpy, config_file, all_xerrors, need_fork);
+		ps_g = session_init(argc, argv, dpy, &event_trace, config_file, all_xerrors,
+		                    need_fork);
 		if (!ps_g) {
 			log_fatal("Failed to create new session.");
 			ret_code = 1;
@@ -2895,6 +3239,9 @@ int main(int argc, char **argv) {
 		}
 	} while (!quit);
 
+	if (event_trace) {
+		event_trace_close(event_trace);
+	}
 	free(config_file);
 	if (pid_file) {
 		log_trace("remove pid file %s", pid_file);
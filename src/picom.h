@@ -52,6 +52,21 @@ void set_root_flags(session_t *ps, uint64_t flags);
 
 void quit(session_t *ps);
 
+/// Get a reference to the shadow context for `radius` on the current backend, shared
+/// with every other user of the same radius. Returns NULL on failure.
+struct backend_shadow_context *session_get_shadow_context(session_t *ps, int radius);
+
+/// Drop a shadow context reference acquired with `session_get_shadow_context`.
+void session_put_shadow_context(session_t *ps, struct backend_shadow_context *ctx);
+
+/// Get a reference to the blur context of the current backend for `method` and
+/// `args`, shared with every other user of the same parameters. Kernel blur isn't
+/// supported. Returns NULL on failure.
+void *session_get_blur_context(session_t *ps, enum blur_method method, void *args);
+
+/// Drop a blur context reference acquired with `session_get_blur_context`.
+void session_put_blur_context(session_t *ps, void *ctx);
+
 xcb_window_t session_get_target_window(session_t *);
 
 uint8_t session_redirection_mode(session_t *ps);
@@ -0,0 +1,235 @@
+// SPDX-License-Identifier: MPL-2.0
+#include <stdbool.h>
+
+#include <test.h>
+
+#include "list.h"
+#include "region.h"
+#include "utils.h"
+#include "win.h"
+
+#include "layout.h"
+
+#include "damage.h"
+
+/// Add the region covered by `layer` on screen, including its shadow, to `damage`.
+static void layer_add_extents(region_t *damage, const struct layer *layer) {
+	pixman_region32_union_rect(damage, damage, layer->origin.x, layer->origin.y,
+	                           (unsigned)layer->size.width, (unsigned)layer->size.height);
+	if (layer->shadow_size.width > 0 && layer->shadow_size.height > 0) {
+		pixman_region32_union_rect(
+		    damage, damage, layer->shadow_origin.x, layer->shadow_origin.y,
+		    (unsigned)layer->shadow_size.width, (unsigned)layer->shadow_size.height);
+	}
+}
+
+/// Whether a layer would be rendered differently, ignoring the window content.
+static bool layer_differs(const struct layer *a, const struct layer *b) {
+	return a->origin.x != b->origin.x || a->origin.y != b->origin.y ||
+	       a->size.width != b->size.width || a->size.height != b->size.height ||
+	       a->shadow_origin.x != b->shadow_origin.x ||
+	       a->shadow_origin.y != b->shadow_origin.y ||
+	       a->shadow_size.width != b->shadow_size.width ||
+	       a->shadow_size.height != b->shadow_size.height || a->opacity != b->opacity ||
+	       a->is_opaque != b->is_opaque || a->is_clipping != b->is_clipping;
+}
+
+/// Damage between the current layout and the one `past_age` frames ago, if none of
+/// the layouts in between had any layer added, removed, restacked, moved, resized or
+/// changing opacity. Every layer then has the same rank in all of them, so there is
+/// no need to follow the layers back, nor to look for the ones that are gone.
+static void layout_manager_damage_unchanged(struct layout_manager *lm,
+                                            unsigned past_age, region_t *damage) {
+	auto curr = layout_manager_layout(lm, 0);
+	auto past = layout_manager_layout(lm, past_age);
+	region_t content;
+	pixman_region32_init(&content);
+	for (unsigned i = 0; i < curr->len; i++) {
+		auto layer = &curr->layers[i];
+		// The diff doesn't count layers that became opaque or clipping
+		if (layer_differs(layer, &past->layers[i])) {
+			layer_add_extents(damage, layer);
+			continue;
+		}
+		pixman_region32_clear(&content);
+		for (unsigned age = 0; age < past_age; age++) {
+			pixman_region32_union(&content, &content,
+			                      &layout_manager_layout(lm, age)->layers[i].damaged);
+		}
+		pixman_region32_translate(&content, layer->origin.x, layer->origin.y);
+		pixman_region32_union(damage, damage, &content);
+	}
+	pixman_region32_fini(&content);
+}
+
+bool layout_manager_damage(struct layout_manager *lm, unsigned buffer_age, region_t *damage) {
+	// Layouts that weren't presented are taken out of the ring, so the past layouts
+	// are those of the frames presented before this one.
+	unsigned past_age = buffer_age;
+	if (past_age >= lm->max_buffer_age || !layout_manager_layout(lm, past_age)->presented) {
+		return false;
+	}
+
+	auto curr = layout_manager_layout(lm, 0);
+	auto past = layout_manager_layout(lm, past_age);
+	if (curr->size.width != past->size.width || curr->size.height != past->size.height ||
+	    curr->root_image_generation != past->root_image_generation) {
+		return false;
+	}
+
+	// Most frames only have windows whose content changed
+	bool unchanged = true;
+	for (unsigned age = 0; age < past_age && unchanged; age++) {
+		unchanged = layout_diff_is_empty(&layout_manager_layout(lm, age)->diff);
+	}
+	if (unchanged) {
+		layout_manager_damage_unchanged(lm, past_age, damage);
+		return true;
+	}
+
+	region_t content;
+	pixman_region32_init(&content);
+	// Highest rank in `past` among the layers seen so far, see
+	// layout_manager_append_layout.
+	int max_past_rank = -1;
+	for (unsigned i = 0; i < curr->len; i++) {
+		auto layer = &curr->layers[i];
+
+		// Follow the layer back to `past`, collecting its content damage on the
+		// way.
+		pixman_region32_clear(&content);
+		int rank = (int)i;
+		for (unsigned age = 0; age < past_age && rank != -1; age++) {
+			auto l = &layout_manager_layout(lm, age)->layers[rank];
+			pixman_region32_union(&content, &content, &l->damaged);
+			rank = l->prev_rank;
+		}
+		if (rank == -1) {
+			// The window wasn't there in the past frame
+			layer_add_extents(damage, layer);
+			continue;
+		}
+
+		auto past_layer = &past->layers[rank];
+		bool restacked = rank < max_past_rank;
+		max_past_rank = max2(max_past_rank, rank);
+		if (restacked || layer_differs(layer, past_layer)) {
+			layer_add_extents(damage, layer);
+			layer_add_extents(damage, past_layer);
+			continue;
+		}
+
+		// The window might have moved around in between, but it's back where it
+		// was, and only the content it received since has changed.
+		pixman_region32_translate(&content, layer->origin.x, layer->origin.y);
+		pixman_region32_union(damage, damage, &content);
+	}
+	pixman_region32_fini(&content);
+
+	// Layers that are gone from the current layout
+	for (unsigned i = 0; i < past->len; i++) {
+		int rank = (int)i;
+		for (unsigned age = past_age; age > 0 && rank != -1; age--) {
+			rank = layout_manager_layout(lm, age)->layers[rank].next_rank;
+		}
+		if (rank == -1) {
+			layer_add_extents(damage, &past->layers[i]);
+		}
+	}
+	return true;
+}
+
+TEST_CASE(layout_manager_damage_skipped_frames) {
+	static int image;
+	struct list_node stack;
+	list_init_head(&stack);
+	struct managed_win w = {
+	    .base = {.id = 1, .managed = true},
+	    .ever_damaged = true,
+	    .win_image = &image,
+	    .g = {.x = 10, .y = 10, .width = 100, .height = 100},
+	    .pending_g = {.width = 100, .height = 100},
+	    .widthb = 100,
+	    .heightb = 100,
+	    .opacity = 1,
+	};
+	pixman_region32_init(&w.damaged);
+	list_insert_after(&stack, &w.base.stack_neighbour);
+	const struct geometry size = {.width = 1920, .height = 1080};
+	// The maximum buffer age of the xrender backend
+	auto lm = layout_manager_new(2);
+
+	// Two frames presented, then two without damage that aren't
+	for (int i = 0; i < 4; i++) {
+		layout_manager_append_layout(lm, &stack, 0, size);
+		layout_manager_layout(lm, 0)->presented = i < 2;
+	}
+	pixman_region32_union_rect(&w.damaged, &w.damaged, 0, 0, 10, 10);
+	layout_manager_append_layout(lm, &stack, 0, size);
+
+	// The back buffer has the first frame, only the window content changed since
+	region_t damage;
+	pixman_region32_init(&damage);
+	TEST_TRUE(layout_manager_damage(lm, 2, &damage));
+	auto extents = pixman_region32_extents(&damage);
+	TEST_EQUAL(extents->x1, 10);
+	TEST_EQUAL(extents->y1, 10);
+	TEST_EQUAL(extents->x2, 20);
+	TEST_EQUAL(extents->y2, 20);
+	layout_manager_layout(lm, 0)->presented = true;
+
+	// Content damage of a frame that isn't presented is carried over
+	pixman_region32_union_rect(&w.damaged, &w.damaged, 20, 20, 10, 10);
+	layout_manager_append_layout(lm, &stack, 0, size);
+	layout_manager_append_layout(lm, &stack, 0, size);
+	pixman_region32_clear(&damage);
+	TEST_TRUE(layout_manager_damage(lm, 1, &damage));
+	extents = pixman_region32_extents(&damage);
+	TEST_EQUAL(extents->x1, 30);
+	TEST_EQUAL(extents->y2, 40);
+
+	pixman_region32_fini(&damage);
+	pixman_region32_fini(&w.damaged);
+	layout_manager_free(lm);
+}
+
+TEST_CASE(layout_manager_damage_mode_change) {
+	static int image;
+	struct list_node stack;
+	list_init_head(&stack);
+	struct managed_win w = {
+	    .base = {.id = 1, .managed = true},
+	    .ever_damaged = true,
+	    .win_image = &image,
+	    .g = {.x = 10, .y = 10, .width = 100, .height = 100},
+	    .pending_g = {.width = 100, .height = 100},
+	    .widthb = 100,
+	    .heightb = 100,
+	    .opacity = 1,
+	};
+	pixman_region32_init(&w.damaged);
+	list_insert_after(&stack, &w.base.stack_neighbour);
+	const struct geometry size = {.width = 1920, .height = 1080};
+	auto lm = layout_manager_new(2);
+	layout_manager_append_layout(lm, &stack, 0, size);
+	layout_manager_layout(lm, 0)->presented = true;
+
+	// Nothing the diff counts changes, but the window stops clipping the ones
+	// beneath it
+	w.transparent_clipping = true;
+	layout_manager_append_layout(lm, &stack, 0, size);
+	TEST_TRUE(layout_diff_is_empty(&layout_manager_layout(lm, 0)->diff));
+
+	region_t damage;
+	pixman_region32_init(&damage);
+	TEST_TRUE(layout_manager_damage(lm, 1, &damage));
+	auto extents = pixman_region32_extents(&damage);
+	TEST_EQUAL(extents->x1, 10);
+	TEST_EQUAL(extents->y1, 10);
+	TEST_EQUAL(extents->x2, 110);
+	TEST_EQUAL(extents->y2, 110);
+
+	pixman_region32_fini(&damage);
+	pixman_region32_fini(&w.damaged);
+	layout_manager_free(lm);
+}
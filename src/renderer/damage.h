@@ -0,0 +1,19 @@
+// SPDX-License-Identifier: MPL-2.0
+#pragma once
+#include <stdbool.h>
+
+#include "region.h"
+
+struct layout_manager;
+
+/// Compute the region of the screen that changed between the current layout and the
+/// one that was presented `buffer_age` frames ago, and add it to `damage`.
+///
+/// This covers layers that were added, removed, moved, resized, restacked or changed
+/// opacity, and the content damage of the windows in between. Damage that isn't
+/// reflected in the layouts (e.g. shadow color or dimming changes, the root window)
+/// still has to come from the damage ring.
+///
+/// Returns false if the layout of that frame is no longer available, or the screen
+/// changed as a whole, in which case the whole screen should be considered damaged.
+bool layout_manager_damage(struct layout_manager *lm, unsigned buffer_age, region_t *damage);
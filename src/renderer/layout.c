@@ -29,6 +29,9 @@ layer_from_window(struct layer *out_layer, struct managed_win *w, struct geometr
 
 	out_layer->origin = (struct coord){.x = w->g.x, .y = w->g.y};
 	out_layer->size = (struct geometry){.width = w->widthb, .height = w->heightb};
+	auto image_size = win_image_size(w);
+	out_layer->scaled = out_layer->size.width != image_size.width ||
+	                    out_layer->size.height != image_size.height;
 	if (w->shadow) 
 	{
 		out_layer->shadow_origin =
@@ -72,18 +75,23 @@ out:
 }
 
 static void layout_deinit(struct layout *layout) {
+	for (unsigned i = 0; i < layout->capacity; i++) {
+		pixman_region32_fini(&layout->layers[i].damaged);
+	}
 	free(layout->layers);
 	*layout = (struct layout){};
 }
 
 struct layout_manager *layout_manager_new(unsigned max_buffer_age) {
-	struct layout_manager *planner = malloc(sizeof(struct layout_manager) + (max_buffer_age + 1) * sizeof(struct layout));
-	planner->max_buffer_age = max_buffer_age + 1;
+	// One more layout than the current one and the past ones, so the past ones are
+	// kept while the layout replacing one that wasn't presented is computed.
+	struct layout_manager *planner = malloc(sizeof(struct layout_manager) + (max_buffer_age + 2) * sizeof(struct layout));
+	planner->max_buffer_age = max_buffer_age + 2;
 	planner->current = 0;
 	planner->layer_indices = NULL;
 	list_init_head(&planner->free_indices);
 	pixman_region32_init(&planner->scratch_region);
-	for (unsigned i = 0; i <= max_buffer_age; i++) {
+	for (unsigned i = 0; i < planner->max_buffer_age; i++) {
 		planner->layouts[i] = (struct layout){};
 	}
 	return planner;
@@ -106,53 +114,76 @@ void layout_manager_free(struct layout_manager *lm) {
 	free(lm);
 }
 
-void layout_manager_append_layout(struct layout_manager *lm, struct list_node* window_stack, uint64_t root_pixmap_generation, struct geometry size) 
-{
-	auto prev_layout = &lm->layouts[lm->current];
-	lm->current = (lm->current + 1) % lm->max_buffer_age;
-	auto layout = &lm->layouts[lm->current];
-	layout->root_image_generation = root_pixmap_generation;
-
-	unsigned count = 0;
-	list_foreach(struct win, w, window_stack, stack_neighbour) {
-		if (w->managed) {
-			count += 1;
-		}
+/// Compare `layer` to the same window's layer in the previous layout, and record the
+/// changes in both the layer and the layout's diff.
+static void layer_compute_changes(struct layer *layer, const struct layer *prev_layer,
+                                  struct layout_diff *diff) {
+	layer->changes = 0;
+	if (prev_layer == NULL) {
+		layer->changes |= LAYER_CHANGE_ADDED;
+		diff->added++;
+		return;
 	}
-
-	unsigned nlayers = count;
-	if (nlayers > layout->capacity) 
-	{
-		struct layer *new_layers = realloc(layout->layers, nlayers * sizeof(struct layer));
-		BUG_ON(new_layers == NULL);
-		layout->capacity = nlayers;
-		layout->layers = new_layers;
+	if (layer->origin.x != prev_layer->origin.x || layer->origin.y != prev_layer->origin.y ||
+	    layer->shadow_origin.x != prev_layer->shadow_origin.x ||
+	    layer->shadow_origin.y != prev_layer->shadow_origin.y) {
+		layer->changes |= LAYER_CHANGE_MOVED;
+		diff->moved++;
 	}
+	if (layer->size.width != prev_layer->size.width ||
+	    layer->size.height != prev_layer->size.height ||
+	    layer->shadow_size.width != prev_layer->shadow_size.width ||
+	    layer->shadow_size.height != prev_layer->shadow_size.height) {
+		layer->changes |= LAYER_CHANGE_RESIZED;
+		diff->resized++;
+	}
+	if (layer->opacity != prev_layer->opacity) {
+		layer->changes |= LAYER_CHANGE_OPACITY;
+		diff->opacity_changed++;
+	}
+}
 
-	layout->size = size;
-
-	unsigned rank = 0;
-	struct layer_index *index, *next_index;
-	for (struct list_node *cursor = window_stack->prev; cursor != window_stack; cursor = cursor->prev) 
-	{
-		auto w = list_entry(cursor, struct win, stack_neighbour);
-		if (!w->managed) {
-			continue;
+/// Compute the changes of the layers of `layout` compared to `prev_layout`, which
+/// the layers are linked to by their ranks.
+static void layout_compute_diff(struct layout *layout, struct layout *prev_layout) {
+	layout->diff = (struct layout_diff){};
+	// Highest rank in the previous layout among the layers seen so far. A layer
+	// with a lower previous rank than this has been restacked below another one.
+	int max_prev_rank = -1;
+	for (unsigned i = 0; i < layout->len; i++) {
+		auto layer = &layout->layers[i];
+		struct layer *prev_layer = NULL;
+		bool restacked = false;
+		if (layer->prev_rank != -1) {
+			prev_layer = &prev_layout->layers[layer->prev_rank];
+			restacked = layer->prev_rank < max_prev_rank;
+			max_prev_rank = max2(max_prev_rank, layer->prev_rank);
 		}
-		if (!layer_from_window(&layout->layers[rank], (struct managed_win *)w, size)) {
-			continue;
+		layer_compute_changes(layer, prev_layer, &layout->diff);
+		if (restacked) {
+			layer->changes |= LAYER_CHANGE_RESTACKED;
+			layout->diff.restacked++;
 		}
-
-		HASH_FIND(hh, lm->layer_indices, &layout->layers[rank].key,
-		          sizeof(layout->layers[rank].key), index);
-		if (index) {
-			prev_layout->layers[index->index].next_rank = (int)rank;
-			layout->layers[rank].prev_rank = (int)index->index;
+	}
+	for (unsigned i = 0; i < prev_layout->len; i++) {
+		if (prev_layout->layers[i].next_rank == -1) {
+			layout->diff.removed++;
 		}
-		rank++;
-		assert(rank <= nlayers);
 	}
-	layout->len = rank;
+}
+
+/// Move the indices from the ranks of `prev_layout` to the ranks of `layout`.
+static void layout_manager_update_indices(struct layout_manager *lm,
+                                          struct layout *prev_layout,
+                                          struct layout *layout) {
+	// If no layer was added, removed or restacked, every layer kept its rank, and
+	// the indices are still correct.
+	if (layout->diff.added == 0 && layout->diff.removed == 0 &&
+	    layout->diff.restacked == 0) {
+		return;
+	}
+
+	struct layer_index *index, *next_index;
 
 	// Update indices. If a layer exist in both prev_layout and current layout,
 	// we could update the index using next_rank; if a layer no longer exist in
@@ -184,6 +215,110 @@ void layout_manager_append_layout(struct layout_manager *lm, struct list_node* w
 	}
 }
 
+/// Take the layout before the current one out of the ring, because it was never
+/// presented. The current layout is linked to the one before it instead, and takes
+/// over the content damage of its layers, so only presented layouts take up the
+/// ring and count towards the buffer age.
+static void layout_manager_drop_previous(struct layout_manager *lm) {
+	auto layout = layout_manager_layout(lm, 0);
+	auto skipped = layout_manager_layout(lm, 1);
+	auto prev_layout = layout_manager_layout(lm, 2);
+	for (unsigned i = 0; i < prev_layout->len; i++) {
+		auto layer = &prev_layout->layers[i];
+		if (layer->next_rank != -1) {
+			layer->next_rank = skipped->layers[layer->next_rank].next_rank;
+		}
+	}
+	for (unsigned i = 0; i < layout->len; i++) {
+		auto layer = &layout->layers[i];
+		if (layer->prev_rank != -1) {
+			auto skipped_layer = &skipped->layers[layer->prev_rank];
+			pixman_region32_union(&layer->damaged, &layer->damaged,
+			                      &skipped_layer->damaged);
+			layer->prev_rank = skipped_layer->prev_rank;
+		}
+	}
+	layout_compute_diff(layout, prev_layout);
+
+	// Swap the two layouts, the slot of the skipped one is reused next.
+	auto tmp = *layout;
+	*layout = *skipped;
+	*skipped = tmp;
+	lm->current = (lm->current + lm->max_buffer_age - 1) % lm->max_buffer_age;
+}
+
+void layout_manager_append_layout(struct layout_manager *lm, struct list_node* window_stack, uint64_t root_pixmap_generation, struct geometry size) 
+{
+	auto prev_layout = &lm->layouts[lm->current];
+	lm->current = (lm->current + 1) % lm->max_buffer_age;
+	auto layout = &lm->layouts[lm->current];
+	layout->root_image_generation = root_pixmap_generation;
+	layout->size = size;
+	layout->presented = false;
+
+	unsigned rank = 0;
+	struct layer_index *index;
+	for (struct list_node *cursor = window_stack->prev; cursor != window_stack; cursor = cursor->prev) 
+	{
+		auto w = list_entry(cursor, struct win, stack_neighbour);
+		if (!w->managed) {
+			continue;
+		}
+		if (rank == layout->capacity) {
+			// Grow the layers as we go, instead of counting the windows
+			// beforehand.
+			unsigned capacity = layout->capacity ? layout->capacity * 2 : 16;
+			struct layer *new_layers = realloc(layout->layers, capacity * sizeof(struct layer));
+			BUG_ON(new_layers == NULL);
+			for (unsigned i = layout->capacity; i < capacity; i++) {
+				pixman_region32_init(&new_layers[i].damaged);
+			}
+			layout->capacity = capacity;
+			layout->layers = new_layers;
+		}
+		auto mw = (struct managed_win *)w;
+		auto layer = &layout->layers[rank];
+		if (!layer_from_window(layer, mw, size)) {
+			// The window will be treated as a new layer when it's painted
+			// again, so its damage so far doesn't matter.
+			pixman_region32_clear(&mw->damaged);
+			continue;
+		}
+		// Move the window's damage into the layer, and reuse the layer's old
+		// region for the window.
+		region_t tmp = layer->damaged;
+		layer->damaged = mw->damaged;
+		mw->damaged = tmp;
+		pixman_region32_clear(&mw->damaged);
+
+		// Most of the time the stack doesn't change, so check the same rank of
+		// the previous layout before looking up the index.
+		int prev_rank = -1;
+		if (rank < prev_layout->len &&
+		    prev_layout->layers[rank].key.window == layer->key.window) {
+			prev_rank = (int)rank;
+		} else {
+			HASH_FIND(hh, lm->layer_indices, &layer->key, sizeof(layer->key), index);
+			if (index) {
+				prev_rank = (int)index->index;
+			}
+		}
+
+		if (prev_rank != -1) {
+			prev_layout->layers[prev_rank].next_rank = (int)rank;
+			layer->prev_rank = prev_rank;
+		}
+		rank++;
+	}
+	layout->len = rank;
+	layout_compute_diff(layout, prev_layout);
+	layout_manager_update_indices(lm, prev_layout, layout);
+
+	if (!prev_layout->presented) {
+		layout_manager_drop_previous(lm);
+	}
+}
+
 struct layout *layout_manager_layout(struct layout_manager *lm, unsigned age) {
 	if (age >= lm->max_buffer_age) {
 		assert(false);
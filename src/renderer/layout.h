@@ -15,6 +15,19 @@ struct layer_key {
 	uint32_t pad;       
 };
 
+/// How a layer changed compared to the previous layout
+enum layer_change {
+	/// The window wasn't in the previous layout
+	LAYER_CHANGE_ADDED = 1 << 0,
+	/// The window, or its shadow, moved
+	LAYER_CHANGE_MOVED = 1 << 1,
+	/// The window, or its shadow, changed size
+	LAYER_CHANGE_RESIZED = 1 << 2,
+	LAYER_CHANGE_OPACITY = 1 << 3,
+	/// The window is now below a window it used to be above
+	LAYER_CHANGE_RESTACKED = 1 << 4,
+};
+
 /// A layer to be rendered in a render layout
 struct layer {
 	/// Window that will be rendered in this layer
@@ -24,12 +37,16 @@ struct layer {
 	struct managed_win *win;
 	/// Origin (the top left outmost corner) of the window in screen coordinates
 	struct coord origin;
-	/// Size of the window
+	/// Size of the window. The window image is stretched to it.
 	struct geometry size;
 	/// Origin of the shadow in screen coordinates
 	struct coord shadow_origin;
-	/// Size of the shadow
+	/// Size of the shadow. The shadow image is stretched to it.
 	struct geometry shadow_size;
+	/// Whether `size` differs from the size the images of the window were bound
+	/// at, because the window is animated. The images are then scaled when
+	/// composed, and the window mask, which isn't, can't be used.
+	bool scaled;
 	/// Opacity of this window
 	float opacity;
 
@@ -42,6 +59,11 @@ struct layer {
 	/// Rank of this layer in the next frame, -1 if this window is
 	/// removed in the next frame
 	int next_rank;
+	/// Changes since the previous frame, a mask of `enum layer_change`
+	unsigned changes;
+	/// Content damage the window received since the previous frame, in window
+	/// local coordinates
+	region_t damaged;
 
 	/// Is this window completely opaque?
 	bool is_opaque;
@@ -52,6 +74,18 @@ struct layer {
 	bool to_paint;
 };
 
+/// Number of layers that changed between a layout and the one before it, by kind of
+/// change. A layer can be counted in more than one kind.
+struct layout_diff {
+	unsigned added;
+	/// Layers of the previous layout that are not in this one
+	unsigned removed;
+	unsigned moved;
+	unsigned resized;
+	unsigned opacity_changed;
+	unsigned restacked;
+};
+
 /// Layout of windows at a specific frame
 struct layout {
 	struct geometry size;
@@ -72,8 +106,20 @@ struct layout {
 	/// are recorded in the same order as the layers they correspond to. Each layer
 	/// can have 0 or more commands associated with it.
 	struct backend_command *commands;
+	/// Changes compared to the previous layout
+	struct layout_diff diff;
+	/// Whether this layout has been presented. Frames without damage are not
+	/// rendered, and their layouts are taken out of the ring when the next one is
+	/// appended, so they don't count towards the buffer age.
+	bool presented;
 };
 
+/// Whether nothing changed between a layout and the one before it
+static inline bool layout_diff_is_empty(const struct layout_diff *diff) {
+	return diff->added == 0 && diff->removed == 0 && diff->moved == 0 &&
+	       diff->resized == 0 && diff->opacity_changed == 0 && diff->restacked == 0;
+}
+
 struct layer_index {
 	UT_hash_handle hh;
 	struct layer_key key;
@@ -100,7 +146,8 @@ struct layout_manager {
 	// internal
 	/// Scratch region used for calculations, to avoid repeated allocations.
 	region_t scratch_region;
-	/// Current and past layouts, at most `max_buffer_age` layouts are stored.
+	/// Current and past layouts, at most `max_buffer_age` layouts are stored. The
+	/// oldest one can be a layout that wasn't presented, waiting to be reused.
 	struct layout layouts[];
 };
 
@@ -108,6 +155,9 @@ struct layout_manager {
 /// the end of layout manager's ring buffer.  The layout manager has a ring buffer of
 /// layouts, with its size chosen at creation time. Calling this will push at new layout
 /// at the end of the ring buffer, and remove the oldest layout if the buffer is full.
+/// The changes compared to the previous layout are recorded in the layers and in
+/// `struct layout::diff`. If the previous layout was never presented, it's replaced
+/// by the new one instead, which is then compared to the layout before it.
 void layout_manager_append_layout(struct layout_manager *lm, struct list_node* window_stack, uint64_t root_image_generation, struct geometry size);
 /// Get the layout `age` frames into the past. Age `0` is the most recently appended layout.
 struct layout *layout_manager_layout(struct layout_manager *lm, unsigned age);
@@ -6,6 +6,8 @@
 #include "string_utils.h"
 #include "utils.h"
 
+uint64_t allocchk_count = 0;
+
 /// Report allocation failure without allocating memory
 void report_allocation_failure(const char *func, const char *file, unsigned int line) {
 	// Since memory allocation failed, we try to print this error message without any
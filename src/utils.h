@@ -7,6 +7,7 @@
 #include <math.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -154,20 +155,6 @@ static inline int attr_const normalize_i_range(int i, int min, int max) {
 /// clamp `val` into interval [min, max]
 #define clamp(val, min, max) max2(min2(val, max), min)
 
-/**
- * Kirill
- * Linearly interpolate from a range into another.
- *
- * @param  a,b   first range
- * @param  c,d   second range
- * @param  value value to interpolate, should be in range [a,b]
- * @return interpolated value in range [c,d]
- */
-static inline int attr_const lerp_range(int a, int b, int c, int d, int value) {
-	ASSERT_IN_RANGE(value, a, b);
-	return (d-c)*(value-a)/(b-a) + c;
-}
-
 /**
  * Normalize a double value to a specific range.
  *
@@ -221,6 +208,10 @@ static inline struct color int_hex_to_rgb(int hex) {
 attr_noret void
 report_allocation_failure(const char *func, const char *file, unsigned int line);
 
+/// Number of successful allocations made through allocchk(), used by the benchmark
+/// mode. picom is single threaded, so this is a plain counter.
+extern uint64_t allocchk_count;
+
 /**
  * @brief Quit if the passed-in pointer is empty.
  */
@@ -229,6 +220,7 @@ allocchk_(const char *func_name, const char *file, unsigned int line, void *ptr)
 	if (unlikely(!ptr)) {
 		report_allocation_failure(func_name, file, line);
 	}
+	allocchk_count++;
 	return ptr;
 }
 
@@ -16,6 +16,8 @@
 #include <xcb/xcb_renderutil.h>
 #include <xcb/xinerama.h>
 
+#include <test.h>
+
 #include "atom.h"
 #include "backend/backend.h"
 #include "c2.h"
@@ -105,6 +107,7 @@ void win_update_shadow_prop(session_t *ps, struct managed_win *w, xcb_atom_t ato
 static bool win_has_any_shadow_value(session_t *ps, struct managed_win *w, uint32_t shadow_val_type);
 void win_update_shadow_geometry(session_t *ps, struct managed_win *w);
 void win_mark_shadow_for_update(session_t *ps, struct managed_win *w);
+static void win_on_focused_change(session_t *ps, struct managed_win *w);
 bool win_should_change_shadow_state(session_t *ps, struct managed_win *w, bool focused);
 void win_determine_shadow_color(session_t *ps, struct managed_win *w);
 
@@ -232,8 +235,18 @@ static void win_update_focused(session_t *ps, struct managed_win *w) {
 	}
 }
 
+/// Have the rules of a window matched again. That is done after the X server is
+/// ungrabbed, by win_process_factor_change_flags, so marking a window more than
+/// once in an update costs nothing.
+static inline void win_mark_factor_changed(struct managed_win *w) {
+	// Rules of a window being destroyed don't matter anymore
+	if (w->state != WSTATE_DESTROYING) {
+		win_set_flags(w, WIN_FLAGS_FACTOR_CHANGED);
+	}
+}
+
 /**
- * Run win_on_factor_change() on all windows with the same leader window.
+ * Mark all windows with the same leader window for a factor change.
  *
  * @param leader leader window ID
  */
@@ -249,7 +262,7 @@ static inline void group_on_factor_change(session_t *ps, xcb_window_t leader) {
 		}
 		auto mw = (struct managed_win *)w;
 		if (win_get_leader(ps, mw) == leader) {
-			win_on_factor_change(ps, mw);
+			win_mark_factor_changed(mw);
 		}
 	}
 }
@@ -394,18 +407,15 @@ static inline void win_release_mask(backend_t *base, struct managed_win *w) {
 	}
 }
 
+/// Bind the pixmap named by win_name_stale_pixmaps
 static inline bool win_bind_pixmap(struct backend_base *b, struct managed_win *w) {
 	assert(!w->win_image);
-	auto pixmap = x_new_id(b->c);
-	auto e = xcb_request_check(
-	    b->c, xcb_composite_name_window_pixmap_checked(b->c, w->base.id, pixmap));
-	if (e) {
-		log_error("Failed to get named pixmap for window %#010x(%s)", w->base.id,
-		          w->name);
-		free(e);
+	auto pixmap = w->named_pixmap;
+	if (!pixmap) {
+		// Naming it failed, and was already complained about
 		return false;
 	}
-	log_debug("New named pixmap for %#010x (%s) : %#010x", w->base.id, w->name, pixmap);
+	w->named_pixmap = XCB_NONE;
 	w->win_image =
 	    b->ops->bind_pixmap(b, pixmap, x_get_visual_info(b->c, w->a.visual), true);
 	if (!w->win_image) {
@@ -420,10 +430,22 @@ static inline bool win_bind_pixmap(struct backend_base *b, struct managed_win *w
 
 bool win_bind_mask(struct backend_base *b, struct managed_win *w) {
 	assert(!w->mask_image);
-	auto reg_bound_local = win_get_bounding_shape_global_by_val(w);
-	pixman_region32_translate(&reg_bound_local, -w->g.x, -w->g.y);
-	w->mask_image = b->ops->make_mask(
-	    b, (geometry_t){.width = w->widthb, .height = w->heightb}, &reg_bound_local);
+	// Like win_clip_bounding_shape, but at the size of the X window, not the
+	// animated one
+	auto size = win_image_size(w);
+	region_t reg_bound_local;
+	pixman_region32_init_rect(&reg_bound_local, 0, 0, (uint)size.width,
+	                          (uint)size.height);
+	if (w->bounding_shaped) {
+		region_t br;
+		pixman_region32_init(&br);
+		pixman_region32_copy(&br, &w->bounding_shape_x);
+		pixman_region32_translate(&br, w->pending_g.border_width,
+		                          w->pending_g.border_width);
+		pixman_region32_intersect(&reg_bound_local, &reg_bound_local, &br);
+		pixman_region32_fini(&br);
+	}
+	w->mask_image = b->ops->make_mask(b, size, &reg_bound_local);
 	pixman_region32_fini(&reg_bound_local);
 
 	if (!w->mask_image) {
@@ -440,7 +462,8 @@ bool win_bind_shadow(struct backend_base *b, struct managed_win *w, struct color
 	assert(w->shadow);
 	if ((w->corner_radius == 0 && w->bounding_shaped == false) ||
 	    b->ops->shadow_from_mask == NULL) {
-		w->shadow_image = b->ops->render_shadow(b, w->widthb, w->heightb, sctx, c);
+		auto size = win_image_size(w);
+		w->shadow_image = b->ops->render_shadow(b, size.width, size.height, sctx, c);
 	} else {
 		win_bind_mask(b, w);
 		w->shadow_image = b->ops->shadow_from_mask(b, w->mask_image, sctx, c);
@@ -484,6 +507,61 @@ static bool win_fetch_and_unset_property_stale(struct managed_win *w, xcb_atom_t
 /// Returns true if any of the properties are stale, as well as clear all the
 /// stale flags.
 static void win_clear_all_properties_stale(struct managed_win *w);
+/// Returns true if the `prop` property is stale, without changing that.
+static bool win_property_is_stale(const struct managed_win *w, xcb_atom_t prop);
+
+/// Request property `atom` of both the frame and the client window in the batch
+static void win_request_property(session_t *ps, struct managed_win *w, xcb_atom_t atom) {
+	x_prop_batch_request(&ps->prop_batch, ps->c, w->base.id, atom);
+	// The client window is going to be looked up again, its properties are read
+	// after that
+	if (w->client_win && w->client_win != w->base.id &&
+	    !win_check_flags_all(w, WIN_FLAGS_CLIENT_STALE)) {
+		x_prop_batch_request(&ps->prop_batch, ps->c, w->client_win, atom);
+	}
+}
+
+void win_request_stale_properties(session_t *ps, struct managed_win *w) {
+	if (!win_is_real_visible(w) && !win_check_flags_all(w, WIN_FLAGS_MAPPED)) {
+		return;
+	}
+	if (win_check_flags_all(w, WIN_FLAGS_CLIENT_STALE)) {
+		// The client window lookup starts with the frame, which is its own
+		// client if it has WM_STATE
+		x_prop_batch_request(&ps->prop_batch, ps->c, w->base.id, ps->atoms->aWM_STATE);
+	}
+	if (!win_check_flags_all(w, WIN_FLAGS_PROPERTY_STALE)) {
+		return;
+	}
+
+	const auto bits_per_element = sizeof(*w->stale_props) * 8;
+	for (size_t i = 0; i < w->stale_props_capacity; i++) {
+		for (auto bits = w->stale_props[i]; bits; bits &= bits - 1) {
+			auto atom = (xcb_atom_t)(i * bits_per_element +
+			                         (size_t)__builtin_ctzll(bits));
+			win_request_property(ps, w, atom);
+
+			// Properties that are read together with the stale one
+			xcb_atom_t other = XCB_NONE;
+			if (atom == ps->atoms->aWM_NAME) {
+				other = ps->atoms->a_NET_WM_NAME;
+			} else if (atom == ps->atoms->a_NET_WM_NAME) {
+				other = ps->atoms->aWM_NAME;
+			} else if (atom == ps->atoms->a_COMPTON_SHADOW) {
+				other = ps->atoms->a_KDE_WM_WINDOW_SHADOW;
+			} else if (atom == ps->atoms->a_KDE_WM_WINDOW_SHADOW) {
+				other = ps->atoms->a_COMPTON_SHADOW;
+			} else if (atom == ps->atoms->aWM_CLIENT_LEADER) {
+				other = ps->atoms->aWM_TRANSIENT_FOR;
+			} else if (atom == ps->atoms->aWM_TRANSIENT_FOR) {
+				other = ps->atoms->aWM_CLIENT_LEADER;
+			}
+			if (other != XCB_NONE && !win_property_is_stale(w, other)) {
+				win_request_property(ps, w, other);
+			}
+		}
+	}
+}
 
 /// Fetch new window properties from the X server, and run appropriate updates.
 /// Might set WIN_FLAGS_FACTOR_CHANGED
@@ -501,9 +579,7 @@ static void win_update_properties(session_t *ps, struct managed_win *w) {
 
 	if (win_fetch_and_unset_property_stale(w, ps->atoms->a_FLY_WM_WINDOW_CORNER_RADIUS)) {
 		win_update_rounding_prop(ps, w);
-		win_determine_rounded_corners(ps, w);
-		win_update_bounding_shape(ps, w);
-		add_damage_from_win(ps, w);
+		win_mark_factor_changed(w);
 	}
 
 	if (win_fetch_and_unset_property_stale(w, ps->atoms->a_FLY_WM_WINDOW_ANIMATION_BLACKLIST)) {
@@ -685,10 +761,10 @@ static void win_apply_animation(session_t *ps, struct managed_win *w,
 	switch (*animation)
 	{
 	case OPEN_WINDOW_ANIMATION_NONE:
-		w->animation_center_x = w->pending_g.x + w->pending_g.width * 0.5;
-		w->animation_center_y = w->pending_g.y + w->pending_g.height * 0.5;
-		w->animation_w = w->pending_g.width;
-		w->animation_h = w->pending_g.height;
+		w->animation.center_x = w->pending_g.x + w->pending_g.width * 0.5;
+		w->animation.center_y = w->pending_g.y + w->pending_g.height * 0.5;
+		w->animation.w = w->pending_g.width;
+		w->animation.h = w->pending_g.height;
 		break;
 	case OPEN_WINDOW_ANIMATION_FLYIN:
 		angle = 2 * M_PI * ((double)rand() / RAND_MAX);
@@ -736,16 +812,16 @@ static void win_apply_animation(session_t *ps, struct managed_win *w,
 		*anim_h = w->pending_g.height;
 		break;
 	case OPEN_WINDOW_ANIMATION_SLIDE_OUT:
-		w->animation_dest_center_x = w->pending_g.x + w->pending_g.width * 0.5;
-		w->animation_dest_center_y = w->pending_g.y;
-		w->animation_dest_w = w->pending_g.width;
-		w->animation_dest_h = w->pending_g.height;
+		w->animation.dest_center_x = w->pending_g.x + w->pending_g.width * 0.5;
+		w->animation.dest_center_y = w->pending_g.y;
+		w->animation.dest_w = w->pending_g.width;
+		w->animation.dest_h = w->pending_g.height;
 		break;
 	case OPEN_WINDOW_ANIMATION_SLIDE_OUT_CENTER:
-		w->animation_dest_center_x = *randr_mon_center_x;
-		w->animation_dest_center_y = w->pending_g.y;
-		w->animation_dest_w = w->pending_g.width;
-		w->animation_dest_h = w->pending_g.height;
+		w->animation.dest_center_x = *randr_mon_center_x;
+		w->animation.dest_center_y = w->pending_g.y;
+		w->animation.dest_w = w->pending_g.width;
+		w->animation.dest_h = w->pending_g.height;
 		break;
 	case OPEN_WINDOW_ANIMATION_ZOOM:
 		*anim_x = w->pending_g.x + w->pending_g.width * 0.5;
@@ -766,9 +842,9 @@ static void win_apply_animation(session_t *ps, struct managed_win *w,
 		*anim_h = 0;
 		break;
 	case OPEN_WINDOW_ANIMATION_SQUEEZE_BOTTOM:
-		w->animation_center_x = w->pending_g.x + w->pending_g.width * 0.5;
-		w->animation_center_y = w->pending_g.y + w->pending_g.height;
-		w->animation_w = w->pending_g.width;
+		w->animation.center_x = w->pending_g.x + w->pending_g.width * 0.5;
+		w->animation.center_y = w->pending_g.y + w->pending_g.height;
+		w->animation.w = w->pending_g.width;
 		*anim_h = 0;
 		*anim_y = w->pending_g.y + w->pending_g.height;
 		break;
@@ -782,13 +858,13 @@ static void init_animation(session_t *ps, struct managed_win *w) {
 
 	static double *anim_x, *anim_y, *anim_w, *anim_h;
 
-	anim_x = &w->animation_center_x, anim_y = &w->animation_center_y;
-	anim_w = &w->animation_w, anim_h = &w->animation_h;
+	anim_x = &w->animation.center_x, anim_y = &w->animation.center_y;
+	anim_w = &w->animation.w, anim_h = &w->animation.h;
 
 	if(w->dwm_mask & ANIM_UNMAP)
 	{
-		anim_x = &w->animation_dest_center_x, anim_y = &w->animation_dest_center_y;
-		anim_w = &w->animation_dest_w, anim_h = &w->animation_dest_h;
+		anim_x = &w->animation.dest_center_x, anim_y = &w->animation.dest_center_y;
+		anim_w = &w->animation.dest_w, anim_h = &w->animation.dest_h;
 	}
 
 	enum open_window_animation animation;
@@ -828,10 +904,6 @@ void win_process_update_flags(session_t *ps, struct managed_win *w) {
 		win_clear_flags(w, WIN_FLAGS_PROPERTY_STALE);
 	}
 
-	if(win_need_update_blur_context(ps, w))   win_determine_blur_context(ps, w);
-	if(win_need_update_shadow_context(ps, w)) win_determine_shadow_context(ps, w);
-	if(win_need_update_shadow_picture(ps, w)) win_determine_shadow_picture(ps, w);
-
 	bool damaged = false;
 	if (win_check_flags_any(w, WIN_FLAGS_SIZE_STALE | WIN_FLAGS_POSITION_STALE)) {
 		if (was_visible) {
@@ -847,54 +919,45 @@ void win_process_update_flags(session_t *ps, struct managed_win *w) {
 			add_damage_from_win(ps, w);
 		}
 
-		// Update window geometry
+		// Update window geometry. The animation is changed below, so take it
+		// out of the animation table first, it's added back when painting.
+		animation_table_remove(&ps->animation_table, &w->animation);
 		if (win_should_animate(ps, w)) {
 			win_update_bounding_shape(ps, w);
 
 			if (!was_visible || w->dwm_mask) {
 				init_animation(ps, w);
-				w->animation_dest_center_x =
+				w->animation.dest_center_x =
 				    w->pending_g.x + w->pending_g.width * 0.5;
-				w->animation_dest_center_y =
+				w->animation.dest_center_y =
 				    w->pending_g.y + w->pending_g.height * 0.5;
-				w->animation_dest_w = w->pending_g.width;
-				w->animation_dest_h = w->pending_g.height;
-				w->g.x = (int16_t)round(w->animation_center_x -
-				                        w->animation_w * 0.5);
-				w->g.y = (int16_t)round(w->animation_center_y -
-				                        w->animation_h * 0.5);
-				w->g.width = (uint16_t)round(w->animation_w);
-				w->g.height = (uint16_t)round(w->animation_h);
+				w->animation.dest_w = w->pending_g.width;
+				w->animation.dest_h = w->pending_g.height;
+				w->g.x = (int16_t)round(w->animation.center_x -
+				                        w->animation.w * 0.5);
+				w->g.y = (int16_t)round(w->animation.center_y -
+				                        w->animation.h * 0.5);
+				w->g.width = (uint16_t)round(w->animation.w);
+				w->g.height = (uint16_t)round(w->animation.h);
 
 			} else {
-				w->animation_dest_center_x =
+				w->animation.dest_center_x =
 				    w->pending_g.x + w->pending_g.width * 0.5;
-				w->animation_dest_center_y =
+				w->animation.dest_center_y =
 				    w->pending_g.y + w->pending_g.height * 0.5;
-				w->animation_dest_w = w->pending_g.width;
-				w->animation_dest_h = w->pending_g.height;
+				w->animation.dest_w = w->pending_g.width;
+				w->animation.dest_h = w->pending_g.height;
 			}
 
 			CLEAR_MASK(w->dwm_mask)
 			w->g.border_width = w->pending_g.border_width;
-			double x_dist = w->animation_dest_center_x - w->animation_center_x;
-			double y_dist = w->animation_dest_center_y - w->animation_center_y;
-			double w_dist = w->animation_dest_w - w->animation_w;
-			double h_dist = w->animation_dest_h - w->animation_h;
-			w->animation_inv_og_distance =
-			    1.0 / sqrt(x_dist * x_dist + y_dist * y_dist +
-			               w_dist * w_dist + h_dist * h_dist);
-
-			if (isinf(w->animation_inv_og_distance))
-				w->animation_inv_og_distance = 0;
-
-			w->animation_progress = 0.0;
+			animation_start(&w->animation);
 		} else {
 			// TODO:Kirill - need to work around (fixes incorrect size change on "WIN_FLAGS_ANIMATION_BLACKLIST_OUT | WIN_FLAGS_ANIMATION_BLACKLIST_IN")
-			if(w->animation_inv_og_distance && (w->g.width != w->pending_g.width || w->g.height != w->pending_g.height))
+			if(w->animation.inv_og_distance && (w->g.width != w->pending_g.width || w->g.height != w->pending_g.height))
 			{
 				win_set_flags(w, WIN_FLAGS_SIZE_STALE);
-				w->animation_inv_og_distance = 0;
+				w->animation.inv_og_distance = 0;
 			}
 
 			w->g = w->pending_g;
@@ -915,13 +978,6 @@ void win_process_update_flags(session_t *ps, struct managed_win *w) {
 		win_update_screen(ps->xinerama_nscrs, ps->xinerama_scr_regs, w);
 	}
 
-	// Factor change flags could be set by previous stages, so must be handled
-	// last
-	if (win_check_flags_all(w, WIN_FLAGS_FACTOR_CHANGED)) {
-		win_on_factor_change(ps, w);
-		win_clear_flags(w, WIN_FLAGS_FACTOR_CHANGED);
-	}
-
 	// Add damage, has to be done last so the window has the latest geometry
 	// information.
 	if (damaged) {
@@ -929,6 +985,50 @@ void win_process_update_flags(session_t *ps, struct managed_win *w) {
 	}
 }
 
+/// Request the properties the rules read, for a window whose rules are going to be
+/// matched again by `win_process_factor_change_flags`.
+void win_request_factor_change_properties(session_t *ps, struct managed_win *w) {
+	if (win_is_real_visible(w) && win_check_flags_all(w, WIN_FLAGS_FACTOR_CHANGED)) {
+		c2_window_props_request(ps, w);
+	}
+}
+
+/// The corner radius of a mapped window changed. The bounding shape doesn't depend
+/// on it, only the mask and the shadow have the corners cut out. The window image
+/// is kept: this runs after the X server is ungrabbed, so its pixmap can't be named
+/// again.
+static void win_on_corner_radius_change(session_t *ps, struct managed_win *w) {
+	win_mark_shadow_for_update(ps, w);
+	add_damage_from_win(ps, w);
+}
+
+/// Match the rules of a window again if the factor change flag is set. The flag can
+/// be set by any of the other updates, so this is done after all of them.
+void win_process_factor_change_flags(session_t *ps, struct managed_win *w) {
+	if (!win_is_real_visible(w)) {
+		// Flags of invisible windows are processed when they are mapped
+		return;
+	}
+
+	if (win_check_flags_all(w, WIN_FLAGS_FACTOR_CHANGED)) {
+		bool focused_old = w->focused;
+		int corner_radius_old = w->corner_radius;
+		win_on_factor_change(ps, w);
+		if (w->focused != focused_old) {
+			win_on_focused_change(ps, w);
+		}
+		if (w->corner_radius != corner_radius_old) {
+			win_on_corner_radius_change(ps, w);
+		}
+		win_clear_flags(w, WIN_FLAGS_FACTOR_CHANGED);
+	}
+
+	// These read the rule values set by win_on_factor_change
+	if(win_need_update_blur_context(ps, w))   win_determine_blur_context(ps, w);
+	if(win_need_update_shadow_context(ps, w)) win_determine_shadow_context(ps, w);
+	if(win_need_update_shadow_picture(ps, w)) win_determine_shadow_picture(ps, w);
+}
+
 void win_mark_shadow_for_update(session_t *ps, struct managed_win *w)
 {
 	win_set_flags(w, WIN_FLAGS_SHADOW_STALE);
@@ -998,6 +1098,72 @@ struct color win_get_shadow_color(session_t *ps, struct managed_win *w)
 	return shadow_color;
 }
 
+/// Whether win_process_image_flags is going to bind a new pixmap for the window
+static bool win_needs_new_pixmap(struct managed_win *w) {
+	// Flags of invisible windows are processed when they are mapped
+	return w->state != WSTATE_UNMAPPED && w->state != WSTATE_DESTROYING &&
+	       w->state != WSTATE_UNMAPPING &&
+	       win_check_flags_all(w, WIN_FLAGS_PIXMAP_STALE) &&
+	       !win_check_flags_all(w, WIN_FLAGS_IMAGE_ERROR);
+}
+
+struct name_pixmap_request {
+	struct managed_win *w;
+	xcb_void_cookie_t cookie;
+};
+
+void win_name_stale_pixmaps(session_t *ps) {
+	assert(ps->server_grabbed);
+	if (!ps->backend_data) {
+		// We are using legacy backend, nothing to do here.
+		return;
+	}
+
+	unsigned n = 0;
+	win_stack_foreach_managed(w, &ps->window_stack) {
+		if (win_needs_new_pixmap(w)) {
+			n++;
+		}
+	}
+	if (!n) {
+		return;
+	}
+
+	// Send all the requests before checking any of them, so naming the pixmaps
+	// takes a single round trip
+	auto reqs = ccalloc(n, struct name_pixmap_request);
+	n = 0;
+	win_stack_foreach_managed(w, &ps->window_stack) {
+		if (!win_needs_new_pixmap(w)) {
+			continue;
+		}
+		if (!win_check_flags_all(w, WIN_FLAGS_PIXMAP_NONE)) {
+			// Must release images first, otherwise breaks NVIDIA driver
+			win_release_pixmap(ps->backend_data, w);
+		}
+		assert(!w->named_pixmap);
+		w->named_pixmap = x_new_id(ps->c);
+		reqs[n].w = w;
+		reqs[n++].cookie = xcb_composite_name_window_pixmap_checked(
+		    ps->c, w->base.id, w->named_pixmap);
+	}
+
+	for (unsigned i = 0; i < n; i++) {
+		auto w = reqs[i].w;
+		auto e = xcb_request_check(ps->c, reqs[i].cookie);
+		if (e) {
+			log_error("Failed to get named pixmap for window %#010x(%s)",
+			          w->base.id, w->name);
+			free(e);
+			w->named_pixmap = XCB_NONE;
+			continue;
+		}
+		log_debug("New named pixmap for %#010x (%s) : %#010x", w->base.id,
+		          w->name, w->named_pixmap);
+	}
+	free(reqs);
+}
+
 void win_process_image_flags(session_t *ps, struct managed_win *w) {
 	assert(!win_check_flags_all(w, WIN_FLAGS_MAPPED));
 
@@ -1017,16 +1183,11 @@ void win_process_image_flags(session_t *ps, struct managed_win *w) {
 		}
 
 		if (win_check_flags_all(w, WIN_FLAGS_PIXMAP_STALE)) {
-			// Check to make sure the window is still mapped,
-			// otherwise we won't be able to rebind pixmap after
-			// releasing it, yet we might still need the pixmap for
-			// rendering.
+			// The old pixmap was released, and the new one named, by
+			// win_name_stale_pixmaps while the window was known to be
+			// mapped. A named pixmap stays valid after that, so binding
+			// it doesn't need the X critical section.
 			assert(w->state != WSTATE_UNMAPPING && w->state != WSTATE_DESTROYING);
-			if (!win_check_flags_all(w, WIN_FLAGS_PIXMAP_NONE)) {
-				// Must release images first, otherwise breaks
-				// NVIDIA driver
-				win_release_pixmap(ps->backend_data, w);
-			}
 			win_bind_pixmap(ps->backend_data, w);
 		}
 
@@ -1051,6 +1212,85 @@ void win_process_image_flags(session_t *ps, struct managed_win *w) {
 	}
 }
 
+static int test_images_released, test_pixmaps_bound, test_shadow;
+static double test_mask_corner_radius;
+static void test_release_image(backend_t *b attr_unused, void *image attr_unused) {
+	test_images_released++;
+}
+static void *test_bind_pixmap(backend_t *b attr_unused, xcb_pixmap_t p attr_unused,
+                              struct xvisual_info fmt attr_unused, bool owned attr_unused) {
+	test_pixmaps_bound++;
+	return NULL;
+}
+static void *test_make_mask(backend_t *b attr_unused, geometry_t size attr_unused,
+                            const region_t *reg attr_unused) {
+	return &test_mask_corner_radius;
+}
+static bool test_set_image_property(backend_t *b attr_unused, enum image_properties prop,
+                                    void *image, void *args) {
+	if (image == &test_mask_corner_radius && prop == IMAGE_PROPERTY_CORNER_RADIUS) {
+		test_mask_corner_radius = *(double *)args;
+	}
+	return true;
+}
+static void *test_shadow_from_mask(backend_t *b attr_unused, void *mask attr_unused,
+                                   struct backend_shadow_context *sctx attr_unused,
+                                   struct color c attr_unused) {
+	return &test_shadow;
+}
+
+TEST_CASE(win_corner_radius_change_keeps_window_image) {
+	struct backend_operations ops = {
+	    .release_image = test_release_image,
+	    .bind_pixmap = test_bind_pixmap,
+	    .make_mask = test_make_mask,
+	    .set_image_property = test_set_image_property,
+	    .shadow_from_mask = test_shadow_from_mask,
+	};
+	backend_t backend = {.ops = &ops};
+	auto ps = ccalloc(1, session_t);
+	region_t damage;
+	pixman_region32_init(&damage);
+	ps->damage = &damage;
+	ps->redirected = true;
+	ps->backend_data = &backend;
+
+	// A mapped window with a shadow, whose images were bound for a corner radius
+	// of 0
+	auto w = ccalloc(1, struct managed_win);
+	int win_image, old_mask, old_shadow;
+	w->state = WSTATE_MAPPED;
+	w->g = w->pending_g = (struct win_geometry){.width = 50, .height = 50};
+	w->widthb = w->heightb = 50;
+	w->shadow = true;
+	w->win_image = &win_image;
+	w->mask_image = &old_mask;
+	w->shadow_image = &old_shadow;
+
+	// Only the rules change, the window isn't resized
+	w->corner_radius = 10;
+	win_on_corner_radius_change(ps, w);
+	TEST_TRUE(!win_check_flags_any(w, WIN_FLAGS_PIXMAP_STALE));
+	TEST_TRUE(win_check_flags_all(w, WIN_FLAGS_SHADOW_STALE));
+	TEST_TRUE(w->mask_image == NULL);
+	TEST_TRUE(pixman_region32_not_empty(&damage));
+
+	// The shadow and its mask are bound again with the new radius, the window
+	// image is left alone
+	win_process_image_flags(ps, w);
+	TEST_EQUAL(test_pixmaps_bound, 0);
+	TEST_TRUE(w->win_image == &win_image);
+	TEST_TRUE(w->mask_image == &test_mask_corner_radius);
+	TEST_EQUAL(test_mask_corner_radius, 10);
+	TEST_TRUE(w->shadow_image == &test_shadow);
+	TEST_EQUAL(test_images_released, 2);
+	TEST_TRUE(!win_check_flags_any(w, WIN_FLAGS_IMAGES_STALE));
+
+	free(w);
+	pixman_region32_fini(&damage);
+	free(ps);
+}
+
 /**
  * Check if a window has rounded corners.
  * XXX This is really dumb
@@ -1168,7 +1408,7 @@ static inline bool win_bounding_shaped(const session_t *ps, xcb_window_t wid) {
 
 static wintype_t wid_get_prop_wintype(session_t *ps, xcb_window_t wid) {
 	winprop_t prop =
-	    x_get_prop(ps->c, wid, ps->atoms->a_NET_WM_WINDOW_TYPE, 32L, XCB_ATOM_ATOM, 32);
+	    wid_get_prop(ps, wid, ps->atoms->a_NET_WM_WINDOW_TYPE, 32L, XCB_ATOM_ATOM, 32);
 
 	for (unsigned i = 0; i < prop.nitems; ++i) {
 		for (wintype_t j = 1; j < NUM_WINTYPES; ++j) {
@@ -1191,7 +1431,7 @@ wid_get_opacity_prop(session_t *ps, xcb_window_t wid, opacity_t def, opacity_t *
 
 	if (!ps->o.enable_transparency) return false; //alex
 
-	winprop_t prop = x_get_prop(ps->c, wid, ps->atoms->a_NET_WM_WINDOW_OPACITY, 1L,
+	winprop_t prop = wid_get_prop(ps, wid, ps->atoms->a_NET_WM_WINDOW_OPACITY, 1L,
 	                            XCB_ATOM_CARDINAL, 32);
 
 	if (prop.nitems) {
@@ -1210,7 +1450,7 @@ wid_get_rounding_prop(session_t *ps, xcb_window_t wid, uint32_t def, uint32_t *o
 	bool ret = false;
 	*out = def;
 
-	winprop_t prop = x_get_prop(ps->c, wid, ps->atoms->a_FLY_WM_WINDOW_CORNER_RADIUS, 1L,
+	winprop_t prop = wid_get_prop(ps, wid, ps->atoms->a_FLY_WM_WINDOW_CORNER_RADIUS, 1L,
 	                            XCB_ATOM_CARDINAL, 32);
 
 	if (prop.nitems) {
@@ -1231,7 +1471,7 @@ wid_get_animating_prop(session_t *ps, xcb_window_t wid, int *out, uint32_t prop)
 
 	if(prop == ps->atoms->a_FLY_WM_WINDOW_ANIMATION_BLACKLIST)
 	{
-		winprop_t prop_val = x_get_prop(ps->c, wid, ps->atoms->a_FLY_WM_WINDOW_ANIMATION_BLACKLIST, 1L, XCB_ATOM_CARDINAL, 32);
+		winprop_t prop_val = wid_get_prop(ps, wid, ps->atoms->a_FLY_WM_WINDOW_ANIMATION_BLACKLIST, 1L, XCB_ATOM_CARDINAL, 32);
 		if (prop_val.nitems) ret = true;
 		free_winprop(&prop_val);
 	}
@@ -1252,7 +1492,7 @@ wid_get_shadow_color_prop(session_t *ps, xcb_window_t wid, struct color *out) {
 	char **strlst = NULL;
 	int nstr = 0;
 
-	winprop_t prop = x_get_prop(ps->c, wid, ps->atoms->a_FLY_WM_SHADOW_COLOR, 1L, XCB_ATOM_CARDINAL, 32);
+	winprop_t prop = wid_get_prop(ps, wid, ps->atoms->a_FLY_WM_SHADOW_COLOR, 1L, XCB_ATOM_CARDINAL, 32);
 
 	if(prop.nitems)
 	{
@@ -1281,7 +1521,7 @@ wid_get_shadow_color_prop(session_t *ps, xcb_window_t wid, struct color *out) {
 
 static bool wid_get_shadow_prop(session_t *ps, xcb_window_t wid, int *out, xcb_atom_t atom) {
 	bool ret = false;
-	winprop_t prop = x_get_prop(ps->c, wid, atom, 1L, XCB_ATOM_CARDINAL, 32);
+	winprop_t prop = wid_get_prop(ps, wid, atom, 1L, XCB_ATOM_CARDINAL, 32);
 	if (prop.nitems) {
 		*out = (int)*prop.c32;
 		if(atom == ps->atoms->a_FLY_WM_SHADOW_RADIUS && *out < 0) *out = 0;
@@ -1306,7 +1546,7 @@ wid_get_blur_prop(session_t *ps, xcb_window_t wid, int *out, xcb_atom_t atom) {
 			free(strlst);
 		}
 	} else {
-		winprop_t prop = x_get_prop(ps->c, wid, atom, 1L, XCB_ATOM_CARDINAL, 32);
+		winprop_t prop = wid_get_prop(ps, wid, atom, 1L, XCB_ATOM_CARDINAL, 32);
 
 		if (prop.nitems) {
 			*out = (int)*prop.c32;
@@ -1461,11 +1701,11 @@ bool win_should_fade(session_t *ps, const struct managed_win *w) {
  * The property must be set on the outermost window, usually the WM frame.
  */
 void win_update_prop_shadow_raw(session_t *ps, struct managed_win *w) {
-	winprop_t prop = x_get_prop(ps->c, w->base.id, ps->atoms->a_KDE_WM_WINDOW_SHADOW, 1,
+	winprop_t prop = wid_get_prop(ps, w->base.id, ps->atoms->a_KDE_WM_WINDOW_SHADOW, 1,
  	                            XCB_ATOM_CARDINAL, 32);
 
 	if (!prop.nitems) {
-		winprop_t prop1 = x_get_prop(ps->c, w->base.id, ps->atoms->a_COMPTON_SHADOW, 1,
+		winprop_t prop1 = wid_get_prop(ps, w->base.id, ps->atoms->a_COMPTON_SHADOW, 1,
 		                            XCB_ATOM_CARDINAL, 32);
 		if (!prop1.nitems) w->prop_shadow = -1;
 		else               w->prop_shadow = *prop1.c32;
@@ -1576,8 +1816,8 @@ static void win_determine_shadow(session_t *ps, struct managed_win *w) {
 }
 
 /**
- * Reread _COMPTON_SHADOW property from a window and update related
- * things.
+ * Reread _COMPTON_SHADOW property from a window, the shadow is determined again
+ * with the rest of the rules.
  */
 void win_update_prop_shadow(session_t *ps, struct managed_win *w) {
 	long long attr_shadow_old = w->prop_shadow;
@@ -1585,7 +1825,7 @@ void win_update_prop_shadow(session_t *ps, struct managed_win *w) {
 	win_update_prop_shadow_raw(ps, w);
 
 	if (w->prop_shadow != attr_shadow_old) {
-		win_determine_shadow(ps, w);
+		win_mark_factor_changed(w);
 	}
 }
 
@@ -1832,7 +2072,7 @@ static void win_determine_blur_context(session_t *ps, struct managed_win *w) {
 	}
 	}
 
-	w->blur_context = ps->backend_data->ops->create_blur_context(ps->backend_data, method, args);
+	w->blur_context = session_get_blur_context(ps, method, args);
 }
 
 static bool win_need_update_blur_context(session_t *ps, struct managed_win *w)
@@ -1911,12 +2151,7 @@ static void win_determine_shadow_context(session_t *ps, struct managed_win *w) {
 				 w->shadow_radius_rule :
 				 ps->o.wintype_option[w->window_type].shadow_radius;
 
-	if (ps->o.legacy_backends)
-	{
-		w->shadow_context = (void *)gaussian_kernel_autodetect_deviation(radius);
-		sum_kernel_preprocess((conv *)w->shadow_context);
-	}
-	else w->shadow_context = ps->backend_data->ops->create_shadow_context(ps->backend_data, radius);
+	w->shadow_context = session_get_shadow_context(ps, radius);
 }
 
 /**
@@ -2160,6 +2395,7 @@ void win_update_blur_rule(session_t *ps, struct managed_win *w) {
  */
 void win_on_factor_change(session_t *ps, struct managed_win *w) {
 	log_debug("Window %#010x (%s) factor change", w->base.id, w->name);
+	c2_window_props_update(ps, w);
 	// Focus needs to be updated first, as other rules might depend on the
 	// focused state of the window
 	win_update_focused(ps, w);
@@ -2250,6 +2486,18 @@ void win_on_win_size_change(session_t *ps, struct managed_win *w) {
 	free_paint(ps, &w->shadow_paint);
 }
 
+/**
+ * Update cache data in struct _win that depends on the size the window is drawn at,
+ * when it changes because the window is animated. The images keep the size of the
+ * X window and are stretched by the backend, so they stay valid.
+ */
+void win_on_win_animated_size_change(session_t *ps, struct managed_win *w) {
+	win_update_shadow_geometry(ps, w);
+	// The X bounding shape is cached, and only refetched on ShapeNotify, so no
+	// round trip here.
+	win_clip_bounding_shape(w);
+}
+
 /**
  * Update window type.
  */
@@ -2271,7 +2519,32 @@ void win_update_wintype(session_t *ps, struct managed_win *w) {
 	}
 
 	if (w->window_type != wtype_old) {
-		win_on_factor_change(ps, w);
+		win_mark_factor_changed(w);
+	}
+}
+
+/// Record the properties of the client window that picom reads, so they are set
+/// again when the event trace is replayed. Most are set before the window is mapped,
+/// so there are no PropertyNotify events for them in the trace.
+static void win_trace_client_properties(session_t *ps, struct managed_win *w) {
+	const xcb_atom_t atoms[] = {
+	    ps->atoms->aWM_NAME,
+	    ps->atoms->a_NET_WM_NAME,
+	    ps->atoms->aWM_CLASS,
+	    ps->atoms->aWM_WINDOW_ROLE,
+	    ps->atoms->aWM_TRANSIENT_FOR,
+	    ps->atoms->aWM_CLIENT_LEADER,
+	    ps->atoms->a_NET_WM_WINDOW_TYPE,
+	    ps->atoms->a_NET_WM_WINDOW_OPACITY,
+	};
+	for (size_t i = 0; i < ARR_SIZE(atoms); i++) {
+		event_trace_record_property(ps->event_trace, ps->c, w->base.id,
+		                            w->client_win, atoms[i]);
+	}
+	// And the ones the rules refer to
+	for (latom_t *platom = ps->track_atom_lst; platom; platom = platom->next) {
+		event_trace_record_property(ps->event_trace, ps->c, w->base.id,
+		                            w->client_win, platom->atom);
 	}
 }
 
@@ -2300,6 +2573,10 @@ void win_mark_client(session_t *ps, struct managed_win *w, xcb_window_t client)
 		free(e);
 	}
 
+	if (ps->event_trace) {
+		win_trace_client_properties(ps, w);
+	}
+
 	win_update_wintype(ps, w);
 
 	// Get frame widths. The window is in damaged area already.
@@ -2316,7 +2593,7 @@ void win_mark_client(session_t *ps, struct managed_win *w, xcb_window_t client)
 	win_update_role(ps, w);
 
 	// Update everything related to conditions
-	win_on_factor_change(ps, w);
+	win_mark_factor_changed(w);
 
 	auto r = xcb_get_window_attributes_reply(
 	    ps->c, xcb_get_window_attributes(ps->c, w->client_win), &e);
@@ -2428,8 +2705,22 @@ void free_win_res(session_t *ps, struct managed_win *w) {
 	free_paint(ps, &w->shadow_paint);
 	// Above should be done during unmapping
 	// Except when we are called by session_destroy
+	animation_table_remove(&ps->animation_table, &w->animation);
+	c2_window_props_free(ps->c2_state, w->c2_props);
+	w->c2_props = NULL;
+
+	if (w->shadow_context) {
+		session_put_shadow_context(ps, w->shadow_context);
+		w->shadow_context = NULL;
+	}
+	if (w->blur_context) {
+		session_put_blur_context(ps, w->blur_context);
+		w->blur_context = NULL;
+	}
 
 	pixman_region32_fini(&w->bounding_shape);
+	pixman_region32_fini(&w->bounding_shape_x);
+	pixman_region32_fini(&w->damaged);
 	// BadDamage may be thrown if the window is destroyed
 	set_ignore_cookie(ps, xcb_damage_destroy(ps->c, w->damage));
 	rc_region_unref(&w->reg_ignore);
@@ -2488,10 +2779,18 @@ struct win *add_win_above(session_t *ps, xcb_window_t id, xcb_window_t below) {
 	}
 }
 
-/// Query the Xorg for information about window `win`
-/// `win` pointer might become invalid after this function returns
-/// Returns the pointer to the window, might be different from `w`
-struct win *fill_win(session_t *ps, struct win *w) {
+/// X requests in flight for a window being adopted by fill_wins
+struct fill_win_request {
+	/// The new window, NULL if there is nothing left to do for it
+	struct win *w;
+	xcb_get_window_attributes_cookie_t attributes;
+	xcb_get_geometry_cookie_t geometry;
+	/// The managed window replacing `w`, once it's known to be managed
+	struct managed_win *new;
+	xcb_void_cookie_t damage;
+};
+
+void fill_wins(session_t *ps, struct win **ws, unsigned n) {
 	static const struct managed_win win_def = {
 	    // No need to initialize. (or, you can think that
 	    // they are initialized right here).
@@ -2566,6 +2865,8 @@ struct win *fill_win(session_t *ps, struct win *w) {
 	    .frame_extents = MARGIN_INIT,        // in win_mark_client
 	    .bounding_shaped = false,
 	    .bounding_shape = {0},
+	    .bounding_shape_x = {0},
+	    .damaged = {0},
 	    .rounded_corners = false,
 	    .paint_excluded = false,
 	    .fade_excluded = false,
@@ -2589,7 +2890,7 @@ struct win *fill_win(session_t *ps, struct win *w) {
 		.rounding_prop = 0,
 		.rounding_rule = 0,
 
-	    .animation_progress = 0.0,
+	    .animation.progress = 0.0,
 		.animating_map_prop = 0,
 		.animating_unmap_prop = 0,
 		.animating_rule_open = 0,
@@ -2600,145 +2901,182 @@ struct win *fill_win(session_t *ps, struct win *w) {
 		.has_animating_rule_unmap = false,
 	};
 
-	assert(!w->destroyed);
-	assert(w->is_new);
+	auto reqs = ccalloc(n, struct fill_win_request);
 
-	w->is_new = false;
+	// Send the queries of all windows before waiting for any reply
+	for (unsigned i = 0; i < n; i++) {
+		auto w = ws[i];
+		assert(!w->destroyed);
+		assert(w->is_new);
 
-	// Reject overlay window and already added windows
-	if (w->id == ps->overlay) {
-		return w;
-	}
+		w->is_new = false;
 
-	auto duplicated_win = find_managed_win(ps, w->id);
-	if (duplicated_win) {
-		log_debug("Window %#010x (recorded name: %s) added multiple "
-		          "times",
-		          w->id, duplicated_win->name);
-		return &duplicated_win->base;
-	}
-
-	log_debug("Managing window %#010x", w->id);
-	xcb_get_window_attributes_cookie_t acookie = xcb_get_window_attributes(ps->c, w->id);
-	xcb_get_window_attributes_reply_t *a =
-	    xcb_get_window_attributes_reply(ps->c, acookie, NULL);
-	if (!a || a->map_state == XCB_MAP_STATE_UNVIEWABLE) {
-		// Failed to get window attributes or geometry probably means
-		// the window is gone already. Unviewable means the window is
-		// already reparented elsewhere.
-		// BTW, we don't care about Input Only windows, except for
-		// stacking proposes, so we need to keep track of them still.
-		free(a);
-		return w;
-	}
+		// Reject overlay window and already added windows
+		if (w->id == ps->overlay) {
+			continue;
+		}
 
-	if (a->_class == XCB_WINDOW_CLASS_INPUT_ONLY) {
-		// No need to manage this window, but we still keep it on the
-		// window stack
-		w->managed = false;
-		free(a);
-		return w;
+		auto duplicated_win = find_managed_win(ps, w->id);
+		if (duplicated_win) {
+			log_debug("Window %#010x (recorded name: %s) added multiple "
+			          "times",
+			          w->id, duplicated_win->name);
+			ws[i] = &duplicated_win->base;
+			continue;
+		}
+
+		log_debug("Managing window %#010x", w->id);
+		reqs[i].w = w;
+		reqs[i].attributes = xcb_get_window_attributes(ps->c, w->id);
+		reqs[i].geometry = xcb_get_geometry(ps->c, w->id);
 	}
 
-	// Allocate and initialize the new win structure
-	auto new_internal = cmalloc(struct managed_win_internal);
-	auto new = (struct managed_win *)new_internal;
+	// Then create the damage of the windows to manage
+	for (unsigned i = 0; i < n; i++) {
+		auto w = reqs[i].w;
+		if (!w) {
+			continue;
+		}
 
-	// Fill structure
-	// We only need to initialize the part that are not initialized
-	// by map_win
-	*new = win_def;
-	new->base = *w;
-	new->base.managed = true;
-	new->a = *a;
-	pixman_region32_init(&new->bounding_shape);
+		xcb_generic_error_t *e = NULL;
+		auto a = xcb_get_window_attributes_reply(ps->c, reqs[i].attributes, NULL);
+		auto g = xcb_get_geometry_reply(ps->c, reqs[i].geometry, &e);
+		if (!a || a->map_state == XCB_MAP_STATE_UNVIEWABLE) {
+			// Failed to get window attributes or geometry probably means
+			// the window is gone already. Unviewable means the window is
+			// already reparented elsewhere.
+			// BTW, we don't care about Input Only windows, except for
+			// stacking proposes, so we need to keep track of them still.
+			free(a);
+			free(g);
+			free(e);
+			continue;
+		}
 
-	free(a);
+		if (a->_class == XCB_WINDOW_CLASS_INPUT_ONLY) {
+			// No need to manage this window, but we still keep it on the
+			// window stack
+			w->managed = false;
+			free(a);
+			free(g);
+			free(e);
+			continue;
+		}
 
-	xcb_generic_error_t *e;
-	auto g = xcb_get_geometry_reply(ps->c, xcb_get_geometry(ps->c, w->id), &e);
-	if (!g) {
-		log_error_x_error(e, "Failed to get geometry of window %#010x", w->id);
-		free(e);
-		free(new);
-		return w;
-	}
-	new->pending_g = (struct win_geometry){
-	    .x = g->x,
-	    .y = g->y,
-	    .width = g->width,
-	    .height = g->height,
-	    .border_width = g->border_width,
-	};
+		if (!g) {
+			log_error_x_error(e, "Failed to get geometry of window %#010x", w->id);
+			free(e);
+			free(a);
+			continue;
+		}
 
-	free(g);
+		// Allocate and initialize the new win structure
+		auto new_internal = cmalloc(struct managed_win_internal);
+		auto new = (struct managed_win *)new_internal;
+
+		// Fill structure
+		// We only need to initialize the part that are not initialized
+		// by map_win
+		*new = win_def;
+		new->base = *w;
+		new->base.managed = true;
+		new->a = *a;
+		pixman_region32_init(&new->bounding_shape);
+		pixman_region32_init(&new->bounding_shape_x);
+		pixman_region32_init(&new->damaged);
+		new->pending_g = (struct win_geometry){
+		    .x = g->x,
+		    .y = g->y,
+		    .width = g->width,
+		    .height = g->height,
+		    .border_width = g->border_width,
+		};
+		free(a);
+		free(g);
 
-	// Create Damage for window (if not Input Only)
-	new->damage = x_new_id(ps->c);
-	e = xcb_request_check(
-	    ps->c, xcb_damage_create_checked(ps->c, new->damage, w->id,
-	                                     XCB_DAMAGE_REPORT_LEVEL_NON_EMPTY));
-	if (e) {
-		log_error_x_error(e, "Failed to create damage");
-		free(e);
-		free(new);
-		return w;
+		// Create Damage for window (if not Input Only)
+		new->damage = x_new_id(ps->c);
+		reqs[i].damage = xcb_damage_create_checked(
+		    ps->c, new->damage, w->id, XCB_DAMAGE_REPORT_LEVEL_NON_EMPTY);
+		reqs[i].new = new;
 	}
 
-	// Set window event mask
-	xcb_change_window_attributes(
-	    ps->c, new->base.id, XCB_CW_EVENT_MASK,
-	    (const uint32_t[]){determine_evmask(ps, new->base.id, WIN_EVMODE_FRAME)});
+	// Finally start managing the windows whose damage could be created
+	for (unsigned i = 0; i < n; i++) {
+		auto w = reqs[i].w;
+		auto new = reqs[i].new;
+		if (!new) {
+			continue;
+		}
 
-	// Get notification when the shape of a window changes
-	if (ps->shape_exists) {
-		xcb_shape_select_input(ps->c, new->base.id, 1);
-	}
+		auto e = xcb_request_check(ps->c, reqs[i].damage);
+		if (e) {
+			log_error_x_error(e, "Failed to create damage");
+			free(e);
+			free(new);
+			continue;
+		}
 
-	new->pictfmt = x_get_pictform_for_visual(ps->c, new->a.visual);
-	new->client_pictfmt = NULL;
+		// Set window event mask
+		xcb_change_window_attributes(
+		    ps->c, new->base.id, XCB_CW_EVENT_MASK,
+		    (const uint32_t[]){determine_evmask(ps, new->base.id, WIN_EVMODE_FRAME)});
 
-	list_replace(&w->stack_neighbour, &new->base.stack_neighbour);
-	struct win *replaced = NULL;
-	HASH_REPLACE_INT(ps->windows, id, &new->base, replaced);
-	assert(replaced == w);
-	free(w);
+		// Get notification when the shape of a window changes
+		if (ps->shape_exists) {
+			xcb_shape_select_input(ps->c, new->base.id, 1);
+		}
 
-	// Set all the stale flags on this new window, so it's properties will get
-	// updated when it's mapped
-	win_set_flags(new, WIN_FLAGS_CLIENT_STALE | WIN_FLAGS_SIZE_STALE |
-	                       WIN_FLAGS_POSITION_STALE | WIN_FLAGS_PROPERTY_STALE |
-	                       WIN_FLAGS_FACTOR_CHANGED);
-	xcb_atom_t init_stale_props[] = {
-	    ps->atoms->a_NET_WM_WINDOW_TYPE, ps->atoms->a_NET_WM_WINDOW_OPACITY,
-	    ps->atoms->a_NET_FRAME_EXTENTS,  ps->atoms->aWM_NAME,
-	    ps->atoms->a_NET_WM_NAME,        ps->atoms->aWM_CLASS,
-	    ps->atoms->aWM_WINDOW_ROLE,      ps->atoms->a_COMPTON_SHADOW,
-	    ps->atoms->aWM_CLIENT_LEADER,    ps->atoms->aWM_TRANSIENT_FOR,
-		ps->atoms->a_FLY_WM_WINDOW_CORNER_RADIUS, // Kirill
-		ps->atoms->a_FLY_WM_WINDOW_ANIMATION_BLACKLIST,
-		ps->atoms->a_FLY_WM_WINDOW_MAP_ANIMATION,
-		ps->atoms->a_FLY_WM_WINDOW_UNMAP_ANIMATION,
-		ps->atoms->a_FLY_WM_SHADOW_COLOR,
-		ps->atoms->a_FLY_WM_SHADOW_OPACITY,
-	    ps->atoms->a_FLY_WM_SHADOW_RADIUS,
-	    ps->atoms->a_FLY_WM_SHADOW_OFFSET_X,
-	    ps->atoms->a_FLY_WM_SHADOW_OFFSET_Y,
-		ps->atoms->a_FLY_WM_BLUR_SIZE,
-	    ps->atoms->a_FLY_WM_BLUR_STRENGTH,
-	    ps->atoms->a_FLY_WM_BLUR_DEVIATION,
-	    ps->atoms->a_FLY_WM_BLUR_METHOD,
-	};
-	win_set_properties_stale(new, init_stale_props, ARR_SIZE(init_stale_props));
+		new->pictfmt = x_get_pictform_for_visual(ps->c, new->a.visual);
+		new->client_pictfmt = NULL;
+
+		list_replace(&w->stack_neighbour, &new->base.stack_neighbour);
+		struct win *replaced = NULL;
+		HASH_REPLACE_INT(ps->windows, id, &new->base, replaced);
+		assert(replaced == w);
+		free(w);
+		ws[i] = &new->base;
+
+		// Set all the stale flags on this new window, so it's properties will
+		// get updated when it's mapped
+		win_set_flags(new, WIN_FLAGS_CLIENT_STALE | WIN_FLAGS_SIZE_STALE |
+		                       WIN_FLAGS_SHAPE_STALE | WIN_FLAGS_POSITION_STALE |
+		                       WIN_FLAGS_PROPERTY_STALE | WIN_FLAGS_FACTOR_CHANGED);
+		xcb_atom_t init_stale_props[] = {
+		    ps->atoms->a_NET_WM_WINDOW_TYPE, ps->atoms->a_NET_WM_WINDOW_OPACITY,
+		    ps->atoms->a_NET_FRAME_EXTENTS,  ps->atoms->aWM_NAME,
+		    ps->atoms->a_NET_WM_NAME,        ps->atoms->aWM_CLASS,
+		    ps->atoms->aWM_WINDOW_ROLE,      ps->atoms->a_COMPTON_SHADOW,
+		    ps->atoms->aWM_CLIENT_LEADER,    ps->atoms->aWM_TRANSIENT_FOR,
+			ps->atoms->a_FLY_WM_WINDOW_CORNER_RADIUS, // Kirill
+			ps->atoms->a_FLY_WM_WINDOW_ANIMATION_BLACKLIST,
+			ps->atoms->a_FLY_WM_WINDOW_MAP_ANIMATION,
+			ps->atoms->a_FLY_WM_WINDOW_UNMAP_ANIMATION,
+			ps->atoms->a_FLY_WM_SHADOW_COLOR,
+			ps->atoms->a_FLY_WM_SHADOW_OPACITY,
+		    ps->atoms->a_FLY_WM_SHADOW_RADIUS,
+		    ps->atoms->a_FLY_WM_SHADOW_OFFSET_X,
+		    ps->atoms->a_FLY_WM_SHADOW_OFFSET_Y,
+			ps->atoms->a_FLY_WM_BLUR_SIZE,
+		    ps->atoms->a_FLY_WM_BLUR_STRENGTH,
+		    ps->atoms->a_FLY_WM_BLUR_DEVIATION,
+		    ps->atoms->a_FLY_WM_BLUR_METHOD,
+		};
+		win_set_properties_stale(new, init_stale_props, ARR_SIZE(init_stale_props));
 
 #ifdef CONFIG_DBUS
-	// Send D-Bus signal
-	if (ps->o.dbus) {
-		cdbus_ev_win_added(ps, &new->base);
-	}
+		// Send D-Bus signal
+		if (ps->o.dbus) {
+			cdbus_ev_win_added(ps, &new->base);
+		}
 #endif
+	}
+	free(reqs);
+}
 
-	return &new->base;
+struct win *fill_win(session_t *ps, struct win *w) {
+	fill_wins(ps, &w, 1);
+	return w;
 }
 
 /**
@@ -2766,7 +3104,7 @@ static inline void win_set_leader(session_t *ps, struct managed_win *w, xcb_wind
 		}
 
 		// Update everything related to conditions
-		win_on_factor_change(ps, w);
+		win_mark_factor_changed(w);
 	}
 }
 
@@ -2779,12 +3117,12 @@ void win_update_leader(session_t *ps, struct managed_win *w) {
 	// Read the leader properties
 	if (ps->o.detect_transient && !leader) {
 		leader =
-		    wid_get_prop_window(ps->c, w->client_win, ps->atoms->aWM_TRANSIENT_FOR);
+		    wid_get_prop_window(ps, w->client_win, ps->atoms->aWM_TRANSIENT_FOR);
 	}
 
 	if (ps->o.detect_client_leader && !leader) {
 		leader =
-		    wid_get_prop_window(ps->c, w->client_win, ps->atoms->aWM_CLIENT_LEADER);
+		    wid_get_prop_window(ps, w->client_win, ps->atoms->aWM_CLIENT_LEADER);
 	}
 
 	win_set_leader(ps, w, leader);
@@ -2884,8 +3222,9 @@ static void win_on_focus_change(session_t *ps, struct managed_win *w) {
 		}
 	}
 
-	// Update everything related to conditions
-	win_on_factor_change(ps, w);
+	// The focused state is updated with the rest of the conditions, after the X
+	// server is ungrabbed
+	win_mark_factor_changed(w);
 
 #ifdef CONFIG_DBUS
 	// Send D-Bus signal
@@ -2899,22 +3238,17 @@ static void win_on_focus_change(session_t *ps, struct managed_win *w) {
 #endif
 }
 
-void wins_update_shadow_states(session_t *ps, struct managed_win *old_active_win, struct managed_win *active_win)
+/// Switch the shadow of a window whose focused state changed, if focused windows
+/// have a shadow of their own
+static void win_on_focused_change(session_t *ps, struct managed_win *w)
 {
-	if((win_should_change_shadow_state(ps, old_active_win, false)))
-	{
-		win_update_shadow_geometry(ps, old_active_win);
-		win_mark_shadow_for_update(ps, old_active_win);
-	}
+	if(!win_should_change_shadow_state(ps, w, w->focused))
+		return;
 
-	if((win_should_change_shadow_state(ps, active_win, true)))
-	{
-		win_update_shadow_geometry(ps, active_win);
-		win_mark_shadow_for_update(ps, active_win);
-	}
+	win_update_shadow_geometry(ps, w);
+	win_mark_shadow_for_update(ps, w);
 
 	// TODO:Kirill - maybe use only root_damaged(ps)
-	// need transfer this call somewhere
 	if(ps->o.backend == BKEND_XRENDER)
 		force_repaint(ps);
 }
@@ -2941,9 +3275,6 @@ void win_set_focused(session_t *ps, struct managed_win *w) {
 	}
 
 	win_on_focus_change(ps, w);
-
-	if(ps->o.shadow_active)
-		wins_update_shadow_states(ps, old_active_win, w);
 }
 
 /**
@@ -2967,65 +3298,98 @@ void win_extents(const struct managed_win *w, region_t *res) {
 gen_by_val(win_extents);
 
 /**
- * Update the out-dated bounding shape of a window.
+ * Fetch the bounding shape of a window from the X server into
+ * `w->bounding_shape_x`.
  *
- * Mark the window shape as updated
+ * @return whether the shape is fetched. If not, `w->bounding_shape_x` is set to
+ *         cover the whole window.
  */
-void win_update_bounding_shape(session_t *ps, struct managed_win *w) {
+static bool win_fetch_bounding_shape(session_t *ps, struct managed_win *w) {
 	if (ps->shape_exists) {
 		w->bounding_shaped = win_bounding_shaped(ps, w->base.id);
 	}
 
-	// We don't handle property updates of non-visible windows until they are
-	// mapped.
-	assert(w->state != WSTATE_UNMAPPED && w->state != WSTATE_DESTROYING &&
-	       w->state != WSTATE_UNMAPPING);
+	pixman_region32_clear(&w->bounding_shape_x);
 
+	// Only request for a bounding region if the window is shaped
+	if (!w->bounding_shaped) {
+		return true;
+	}
+
+	/*
+	 * if window doesn't exist anymore,  this will generate an error
+	 * as well as not generate a region.
+	 */
+	xcb_shape_get_rectangles_reply_t *r = xcb_shape_get_rectangles_reply(
+	    ps->c, xcb_shape_get_rectangles(ps->c, w->base.id, XCB_SHAPE_SK_BOUNDING), NULL);
+
+	if (!r) {
+		pixman_region32_fini(&w->bounding_shape_x);
+		pixman_region32_init_rect(&w->bounding_shape_x, -w->g.border_width,
+		                          -w->g.border_width, (uint)w->widthb,
+		                          (uint)w->heightb);
+		return false;
+	}
+
+	xcb_rectangle_t *xrects = xcb_shape_get_rectangles_rectangles(r);
+	int nrects = xcb_shape_get_rectangles_rectangles_length(r);
+	rect_t *rects = from_x_rects(nrects, xrects);
+	free(r);
+
+	pixman_region32_fini(&w->bounding_shape_x);
+	pixman_region32_init_rects(&w->bounding_shape_x, rects, nrects);
+	free(rects);
+	return true;
+}
+
+void win_clip_bounding_shape(struct managed_win *w) {
 	pixman_region32_clear(&w->bounding_shape);
 	// Start with the window rectangular region
 	win_get_region_local(w, &w->bounding_shape);
 
-	// Only request for a bounding region if the window is shaped
-	// (while loop is used to avoid goto, not an actual loop)
-	while (w->bounding_shaped) {
-		/*
-		 * if window doesn't exist anymore,  this will generate an error
-		 * as well as not generate a region.
-		 */
-
-		xcb_shape_get_rectangles_reply_t *r = xcb_shape_get_rectangles_reply(
-		    ps->c,
-		    xcb_shape_get_rectangles(ps->c, w->base.id, XCB_SHAPE_SK_BOUNDING), NULL);
-
-		if (!r) {
-			break;
-		}
+	if (!w->bounding_shaped) {
+		return;
+	}
 
-		xcb_rectangle_t *xrects = xcb_shape_get_rectangles_rectangles(r);
-		int nrects = xcb_shape_get_rectangles_rectangles_length(r);
-		rect_t *rects = from_x_rects(nrects, xrects);
-		free(r);
+	region_t br;
+	pixman_region32_init(&br);
+	pixman_region32_copy(&br, &w->bounding_shape_x);
 
-		region_t br;
-		pixman_region32_init_rects(&br, rects, nrects);
-		free(rects);
-
-		// Add border width because we are using a different origin.
-		// X thinks the top left of the inner window is the origin
-		// (for the bounding shape, althought xcb_get_geometry thinks
-		//  the outer top left (outer means outside of the window
-		//  border) is the origin),
-		// We think the top left of the border is the origin
-		pixman_region32_translate(&br, w->g.border_width, w->g.border_width);
-
-		// Intersect the bounding region we got with the window rectangle,
-		// to make sure the bounding region is not bigger than the window
-		// rectangle
-		pixman_region32_intersect(&w->bounding_shape, &w->bounding_shape, &br);
-		pixman_region32_fini(&br);
-		break;
+	// Add border width because we are using a different origin.
+	// X thinks the top left of the inner window is the origin
+	// (for the bounding shape, althought xcb_get_geometry thinks
+	//  the outer top left (outer means outside of the window
+	//  border) is the origin),
+	// We think the top left of the border is the origin
+	pixman_region32_translate(&br, w->g.border_width, w->g.border_width);
+
+	// Intersect the bounding region we got with the window rectangle,
+	// to make sure the bounding region is not bigger than the window
+	// rectangle
+	pixman_region32_intersect(&w->bounding_shape, &w->bounding_shape, &br);
+	pixman_region32_fini(&br);
+}
+
+/**
+ * Update the out-dated bounding shape of a window.
+ *
+ * Mark the window shape as updated
+ */
+void win_update_bounding_shape(session_t *ps, struct managed_win *w) {
+	// We don't handle property updates of non-visible windows until they are
+	// mapped.
+	assert(w->state != WSTATE_UNMAPPED && w->state != WSTATE_DESTROYING &&
+	       w->state != WSTATE_UNMAPPING);
+
+	// The X server only tells us about shape changes with ShapeNotify, a size
+	// change alone doesn't need a round trip.
+	if (win_check_flags_all(w, WIN_FLAGS_SHAPE_STALE) &&
+	    win_fetch_bounding_shape(ps, w)) {
+		win_clear_flags(w, WIN_FLAGS_SHAPE_STALE);
 	}
 
+	win_clip_bounding_shape(w);
+
 	if (w->bounding_shaped && ps->o.detect_rounded_corners) {
 		w->rounded_corners = win_has_rounded_corners(w);
 	}
@@ -3039,7 +3403,7 @@ void win_update_bounding_shape(session_t *ps, struct managed_win *w) {
 	free_paint(ps, &w->paint);
 	free_paint(ps, &w->shadow_paint);
 
-	win_on_factor_change(ps, w);
+	win_mark_factor_changed(w);
 }
 
 /**
@@ -3105,8 +3469,7 @@ void win_update_shadow_color_prop(session_t *ps, struct managed_win *w) {
 void win_update_shadow_prop(session_t *ps, struct managed_win *w, xcb_atom_t atom, bool *has_prop, int *prop) {
 	if(atom == ps->atoms->a_FLY_WM_SHADOW_RADIUS && w->shadow_context)
 	{
-		if(ps->o.legacy_backends) free_conv((conv *)w->shadow_context);
-		else ps->backend_data->ops->destroy_shadow_context(ps->backend_data, w->shadow_context);
+		session_put_shadow_context(ps, w->shadow_context);
 		w->shadow_context = NULL;
 	}
 
@@ -3121,7 +3484,7 @@ void win_update_shadow_prop(session_t *ps, struct managed_win *w, xcb_atom_t ato
 void win_update_blur_prop(session_t *ps, struct managed_win *w, xcb_atom_t atom, bool *has_prop, int *prop) {
 	if(w->blur_context)
 	{
-		ps->backend_data->ops->destroy_blur_context(ps->backend_data, w->blur_context);
+		session_put_blur_context(ps, w->blur_context);
 		w->blur_context = NULL;
 	}
 
@@ -3166,7 +3529,7 @@ win_has_any_shadow_value(session_t *ps, struct managed_win *w, uint32_t shadow_v
  * Retrieve frame extents from a window.
  */
 void win_update_frame_extents(session_t *ps, struct managed_win *w, xcb_window_t client) {
-	winprop_t prop = x_get_prop(ps->c, client, ps->atoms->a_NET_FRAME_EXTENTS, 4L,
+	winprop_t prop = wid_get_prop(ps, client, ps->atoms->a_NET_FRAME_EXTENTS, 4L,
 	                            XCB_ATOM_CARDINAL, 32);
 
 	if (prop.nitems == 4) {
@@ -3263,11 +3626,12 @@ static void unmap_win_finish(session_t *ps, struct managed_win *w) {
 	win_set_flags(w, WIN_FLAGS_SIZE_STALE);
 
 	// Force animation to completed position
-	w->animation_velocity_x = 0;
-	w->animation_velocity_y = 0;
-	w->animation_velocity_w = 0;
-	w->animation_velocity_h = 0;
-	w->animation_progress = 1.0;
+	animation_table_remove(&ps->animation_table, &w->animation);
+	w->animation.velocity_x = 0;
+	w->animation.velocity_y = 0;
+	w->animation.velocity_w = 0;
+	w->animation.velocity_h = 0;
+	w->animation.progress = 1.0;
 
 	free_paint(ps, &w->paint);
 	free_paint(ps, &w->shadow_paint);
@@ -3544,20 +3908,11 @@ void unmap_win_start(session_t *ps, struct managed_win *w) {
 
 	// Kirill
 	if (win_should_animate(ps, w)) {
+		animation_table_remove(&ps->animation_table, &w->animation);
 		w->dwm_mask = ANIM_UNMAP;
 		init_animation(ps, w);
 
-		double x_dist = w->animation_dest_center_x - w->animation_center_x;
-		double y_dist = w->animation_dest_center_y - w->animation_center_y;
-		double w_dist = w->animation_dest_w - w->animation_w;
-		double h_dist = w->animation_dest_h - w->animation_h;
-		w->animation_inv_og_distance = 1.0 / sqrt(x_dist * x_dist + y_dist * y_dist +
-		                                          w_dist * w_dist + h_dist * h_dist);
-
-		if (isinf(w->animation_inv_og_distance))
-			w->animation_inv_og_distance = 0;
-
-		w->animation_progress = 0.0;
+		animation_start(&w->animation);
 	}
 
 #ifdef CONFIG_DBUS
@@ -3929,7 +4284,7 @@ win_is_maximized_xcb(xcb_connection_t *c, const struct atom *a, const xcb_window
 void win_set_flags(struct managed_win *w, uint64_t flags) {
 	log_debug("Set flags %" PRIu64 " to window %#010x (%s)", flags, w->base.id, w->name);
 	if (unlikely(w->state == WSTATE_DESTROYING)) {
-		if (w->animation_progress != 1.0) { // Kirill
+		if (w->animation.progress != 1.0) { // Kirill
 			// Return because animation will trigger some of the flags
 			return;
 		}
@@ -3945,7 +4300,7 @@ void win_clear_flags(struct managed_win *w, uint64_t flags) {
 	log_debug("Clear flags %" PRIu64 " from window %#010x (%s)", flags, w->base.id,
 	          w->name);
 	if (unlikely(w->state == WSTATE_DESTROYING)) {
-		if (w->animation_progress != 1.0) { // Kirill
+		if (w->animation.progress != 1.0) { // Kirill
 			// Return because animation will trigger some of the flags
 			return;
 		}
@@ -3992,6 +4347,14 @@ static void win_clear_all_properties_stale(struct managed_win *w) {
 	win_clear_flags(w, WIN_FLAGS_PROPERTY_STALE);
 }
 
+static bool win_property_is_stale(const struct managed_win *w, xcb_atom_t prop) {
+	const auto bits_per_element = sizeof(*w->stale_props) * 8;
+	if (prop >= w->stale_props_capacity * bits_per_element) {
+		return false;
+	}
+	return w->stale_props[prop / bits_per_element] & (1UL << (prop % bits_per_element));
+}
+
 static bool win_fetch_and_unset_property_stale(struct managed_win *w, xcb_atom_t prop) {
 	const auto bits_per_element = sizeof(*w->stale_props) * 8;
 	if (prop >= w->stale_props_capacity * bits_per_element) {
@@ -16,6 +16,7 @@
 #include <GL/gl.h>
 #endif
 
+#include "animation.h"
 #include "c2.h"
 #include "compiler.h"
 #include "list.h"
@@ -125,6 +126,9 @@ struct managed_win {
 	void *win_image;
 	void *shadow_image;
 	void *mask_image;
+	/// Pixmap named for the window while the server was grabbed, to be bound
+	/// to `win_image` after the grab is released. XCB_NONE if there is none.
+	xcb_pixmap_t named_pixmap;
 	/// Pointer to the next higher window to paint.
 	struct managed_win *prev_trans;
 	/// Number of windows above this window
@@ -165,6 +169,14 @@ struct managed_win {
 	/// Bounding shape of the window. In local coordinates.
 	/// See above about coordinate systems.
 	region_t bounding_shape;
+	/// Bounding shape as last fetched from the X server, not clipped to the
+	/// window size. In X's coordinates, i.e. relative to the top left of the
+	/// window inside its border. Only meaningful when `bounding_shaped` is set.
+	/// Refetched only when WIN_FLAGS_SHAPE_STALE is set.
+	region_t bounding_shape_x;
+	/// Content damage received since the window was last put into a layout, in
+	/// local coordinates. Only used by the new backends, see renderer/damage.h.
+	region_t damaged;
 	/// Window flags. Definitions above.
 	uint64_t flags;
 	/// The region of screen that will be obscured when windows above is painted,
@@ -221,6 +233,9 @@ struct managed_win {
 	char *class_general;
 	/// <code>WM_WINDOW_ROLE</code> value of the window.
 	char *role;
+	/// Snapshot of the properties read by the rules, taken on factor change.
+	/// NULL before the first one.
+	struct c2_window_props *c2_props;
 
 	// Opacity-related members
 	/// Current window opacity.
@@ -251,19 +266,8 @@ struct managed_win {
 	// The window state (MAP/UNMAP)
 	uint32_t dwm_mask;
 
-	/// Current position and destination, for animation
-	double animation_center_x,      animation_center_y; // animation progress coordinates
-	double animation_dest_center_x, animation_dest_center_y; // current mouse position the animation straves to
-	double animation_w,      animation_h;
-	double animation_dest_w, animation_dest_h;
-	/// Spring animation velocity
-	double animation_velocity_x, animation_velocity_y;
-	double animation_velocity_w, animation_velocity_h;
-	/// Track animation progress; goes from 0 to 1
-	double animation_progress;
-	/// Inverse of the window distance at the start of animation, for
-	/// tracking animation progress
-	double animation_inv_og_distance;
+	/// Geometry and velocity of the window animation
+	struct animation_state animation;
 	enum open_window_animation animating_rule_open, animating_rule_unmap;
 	bool has_animating_rule_open, has_animating_rule_unmap;
 	int animating_map_prop, animating_unmap_prop;
@@ -392,9 +396,22 @@ struct managed_win {
 /// Determine if a window should animate
 bool attr_pure win_should_animate(session_t *ps, const struct managed_win *w);
 
-/// Process pending updates/images flags on a window. Has to be called in X critical
+/// Request the stale properties of a window in the property batch of the session,
+/// so that processing its flags doesn't wait for each property in turn.
+void win_request_stale_properties(session_t *ps, struct managed_win *w);
+/// Request the properties the rules read for a window whose factors changed, in the
+/// property batch of the session.
+void win_request_factor_change_properties(session_t *ps, struct managed_win *w);
+/// Process pending updates flags on a window. Has to be called in X critical
 /// section
 void win_process_update_flags(session_t *ps, struct managed_win *w);
+/// Name new pixmaps for all windows whose pixmap is stale, with the requests sent
+/// all at once. Has to be called in X critical section, as the pixmap of an
+/// unmapped window can't be named.
+void win_name_stale_pixmaps(session_t *ps);
+/// Process pending factor change/images flags on a window. Rule matching and image
+/// binding don't need the X critical section, and are done after it.
+void win_process_factor_change_flags(session_t *ps, struct managed_win *w);
 void win_process_image_flags(session_t *ps, struct managed_win *w);
 bool win_bind_mask(struct backend_base *b, struct managed_win *w);
 /// Bind a shadow to the window, with color `c` and shadow kernel `kernel`
@@ -437,6 +454,7 @@ void win_on_factor_change(session_t *ps, struct managed_win *w);
  * Update cache data in struct _win that depends on window size.
  */
 void win_on_win_size_change(session_t *ps, struct managed_win *w);
+void win_on_win_animated_size_change(session_t *ps, struct managed_win *w);
 void win_unmark_client(session_t *ps, struct managed_win *w);
 void win_recheck_client(session_t *ps, struct managed_win *w);
 
@@ -461,6 +479,9 @@ void win_update_screen(int nscreens, region_t *screens, struct managed_win *w);
  */
 // XXX was win_border_size
 void win_update_bounding_shape(session_t *ps, struct managed_win *w);
+/// Recompute the bounding shape of a window for its current size from the cached
+/// X bounding shape. Doesn't talk to the X server.
+void win_clip_bounding_shape(struct managed_win *w);
 /**
  * Check if a window has BYPASS_COMPOSITOR property set
  */
@@ -501,6 +522,10 @@ struct win *add_win_top(session_t *ps, xcb_window_t id);
 /// Query the Xorg for information about window `win`
 /// `win` pointer might become invalid after this function returns
 struct win *fill_win(session_t *ps, struct win *win);
+/// Like fill_win for each of the `n` windows in `ws`, but sending the requests for
+/// all of them before waiting for the replies, so adopting many windows doesn't
+/// take a few round trips each. The windows replacing them are stored back in `ws`.
+void fill_wins(session_t *ps, struct win **ws, unsigned n);
 /// Move window `w` to be right above `below`
 void restack_above(session_t *ps, struct win *w, xcb_window_t below);
 /// Move window `w` to the bottom of the stack
@@ -628,6 +653,17 @@ static inline margin_t attr_pure attr_unused win_calc_frame_extents(const struct
 	return result;
 }
 
+/**
+ * Size of the images bound for a window, border included. They are bound at the
+ * size of the X window, and are only stretched while the window is animated.
+ */
+static inline geometry_t attr_pure attr_unused win_image_size(const struct managed_win *w) {
+	return (geometry_t){
+	    .width = w->pending_g.width + w->pending_g.border_width * 2,
+	    .height = w->pending_g.height + w->pending_g.border_width * 2,
+	};
+}
+
 /**
  * Check whether a window has WM frames.
  */
@@ -87,7 +87,6 @@ enum win_flags {
 	WIN_FLAGS_MAPPED = 64,
 	/// this window has properties which needs to be updated
 	WIN_FLAGS_PROPERTY_STALE = 128,
-	// TODO(yshui) _maybe_ split SIZE_STALE into SIZE_STALE and SHAPE_STALE
 	/// this window has an unhandled size/shape change
 	WIN_FLAGS_SIZE_STALE = 256,
 	/// this window has an unhandled position (i.e. x and y) change
@@ -98,6 +97,13 @@ enum win_flags {
 	// if the pair is set - need to skip the animation to target position
 	WIN_FLAGS_ANIMATION_BLACKLIST_OUT = 2048,
 	WIN_FLAGS_ANIMATION_BLACKLIST_IN = 4096,
+
+	/// the bounding shape set on the X server has changed, it needs to be fetched
+	/// again. The shape is only fetched while handling SIZE_STALE, so this stays
+	/// set until the next size update. For mapped windows both are set together,
+	/// for unmapped windows only this one is, the size is updated once the
+	/// window is mapped again.
+	WIN_FLAGS_SHAPE_STALE = 8192,
 };
 
 static const uint64_t WIN_FLAGS_IMAGES_STALE = WIN_FLAGS_PIXMAP_STALE | WIN_FLAGS_SHADOW_STALE;
@@ -27,6 +27,29 @@
 #include "utils.h"
 #include "x.h"
 
+/// Make a winprop_t taking ownership of `r`. Returns a blank one if the type or
+/// format doesn't match.
+static winprop_t
+winprop_from_reply(xcb_get_property_reply_t *r, xcb_atom_t rtype, int rformat) {
+	if (r && xcb_get_property_value_length(r) &&
+	    (rtype == XCB_GET_PROPERTY_TYPE_ANY || r->type == rtype) &&
+	    (!rformat || r->format == rformat) &&
+	    (r->format == 8 || r->format == 16 || r->format == 32)) {
+		auto len = xcb_get_property_value_length(r);
+		return (winprop_t){
+		    .ptr = xcb_get_property_value(r),
+		    .nitems = (ulong)(len / (r->format / 8)),
+		    .type = r->type,
+		    .format = r->format,
+		    .r = r,
+		};
+	}
+
+	free(r);
+	return (winprop_t){
+	    .ptr = NULL, .nitems = 0, .type = XCB_GET_PROPERTY_TYPE_ANY, .format = 0};
+}
+
 /**
  * Get a specific attribute of a window.
  *
@@ -49,24 +72,96 @@ winprop_t x_get_prop_with_offset(xcb_connection_t *c, xcb_window_t w, xcb_atom_t
 	    xcb_get_property(c, 0, w, atom, rtype, to_u32_checked(offset),
 	                     to_u32_checked(length)),
 	    NULL);
+	return winprop_from_reply(r, rtype, rformat);
+}
 
-	if (r && xcb_get_property_value_length(r) &&
-	    (rtype == XCB_GET_PROPERTY_TYPE_ANY || r->type == rtype) &&
-	    (!rformat || r->format == rformat) &&
-	    (r->format == 8 || r->format == 16 || r->format == 32)) {
-		auto len = xcb_get_property_value_length(r);
-		return (winprop_t){
-		    .ptr = xcb_get_property_value(r),
-		    .nitems = (ulong)(len / (r->format / 8)),
-		    .type = r->type,
-		    .format = r->format,
-		    .r = r,
-		};
+struct x_prop_batch_entry {
+	xcb_window_t window;
+	xcb_atom_t atom;
+	xcb_get_property_cookie_t cookie;
+	xcb_get_property_reply_t *reply;
+};
+
+void x_prop_batch_request(struct x_prop_batch *b, xcb_connection_t *c, xcb_window_t wid,
+                          xcb_atom_t atom) {
+	assert(!b->collected);
+	if (b->len == b->capacity) {
+		b->capacity = b->capacity ? b->capacity * 2 : 64;
+		b->entries = crealloc(b->entries, b->capacity);
+	}
+	b->entries[b->len++] = (struct x_prop_batch_entry){
+	    .window = wid,
+	    .atom = atom,
+	    .cookie = xcb_get_property(c, 0, wid, atom, XCB_GET_PROPERTY_TYPE_ANY, 0,
+	                               X_PROP_BATCH_LENGTH),
+	};
+}
+
+static int x_prop_batch_entry_cmp(const void *a, const void *b) {
+	const struct x_prop_batch_entry *ea = a, *eb = b;
+	if (ea->window != eb->window) {
+		return ea->window < eb->window ? -1 : 1;
 	}
+	if (ea->atom != eb->atom) {
+		return ea->atom < eb->atom ? -1 : 1;
+	}
+	return 0;
+}
 
-	free(r);
-	return (winprop_t){
-	    .ptr = NULL, .nitems = 0, .type = XCB_GET_PROPERTY_TYPE_ANY, .format = 0};
+void x_prop_batch_collect(struct x_prop_batch *b, xcb_connection_t *c) {
+	assert(!b->collected);
+	for (unsigned i = 0; i < b->len; i++) {
+		// Failures mean the window is gone, whoever reads the property
+		// finds that out again.
+		b->entries[i].reply = xcb_get_property_reply(c, b->entries[i].cookie, NULL);
+	}
+	qsort(b->entries, b->len, sizeof(*b->entries), x_prop_batch_entry_cmp);
+	b->collected = true;
+}
+
+const xcb_get_property_reply_t *
+x_prop_batch_find(const struct x_prop_batch *b, xcb_window_t wid, xcb_atom_t atom) {
+	if (!b->collected) {
+		return NULL;
+	}
+	struct x_prop_batch_entry key = {.window = wid, .atom = atom};
+	const struct x_prop_batch_entry *e =
+	    bsearch(&key, b->entries, b->len, sizeof(*b->entries), x_prop_batch_entry_cmp);
+	return e ? e->reply : NULL;
+}
+
+void x_prop_batch_clear(struct x_prop_batch *b) {
+	for (unsigned i = 0; i < b->len; i++) {
+		if (b->collected) {
+			free(b->entries[i].reply);
+		}
+	}
+	b->len = 0;
+	b->collected = false;
+}
+
+void x_prop_batch_deinit(struct x_prop_batch *b) {
+	x_prop_batch_clear(b);
+	free(b->entries);
+	*b = (struct x_prop_batch){0};
+}
+
+winprop_t wid_get_prop(session_t *ps, xcb_window_t wid, xcb_atom_t atom, int length,
+                       xcb_atom_t rtype, int rformat) {
+	auto r = x_prop_batch_find(&ps->prop_batch, wid, atom);
+	if (!r || (r->bytes_after && length > X_PROP_BATCH_LENGTH)) {
+		return x_get_prop(ps->c, wid, atom, length, rtype, rformat);
+	}
+	// The winprop_t owns its reply, and the batch keeps its own
+	auto size = sizeof(*r) + (size_t)r->length * 4;
+	xcb_get_property_reply_t *copy = cvalloc(size);
+	memcpy(copy, r, size);
+	auto ret = winprop_from_reply(copy, rtype, rformat);
+	if (ret.format) {
+		// Only give as much as was asked for
+		ret.nitems = min2(ret.nitems, (ulong)length * 4 / (ulong)(ret.format / 8));
+	}
+	return ret;
 }
 
 /// Get the type, format and size in bytes of a window's specific attribute.
@@ -93,10 +188,10 @@ winprop_info_t x_get_prop_info(xcb_connection_t *c, xcb_window_t w, xcb_atom_t a
  *
  * @return the value if successful, 0 otherwise
  */
-xcb_window_t wid_get_prop_window(xcb_connection_t *c, xcb_window_t wid, xcb_atom_t aprop) {
+xcb_window_t wid_get_prop_window(session_t *ps, xcb_window_t wid, xcb_atom_t aprop) {
 	// Get the attribute
 	xcb_window_t p = XCB_NONE;
-	winprop_t prop = x_get_prop(c, wid, aprop, 1L, XCB_ATOM_WINDOW, 32);
+	winprop_t prop = wid_get_prop(ps, wid, aprop, 1L, XCB_ATOM_WINDOW, 32);
 
 	// Return it
 	if (prop.nitems) {
@@ -113,8 +208,22 @@ xcb_window_t wid_get_prop_window(xcb_connection_t *c, xcb_window_t wid, xcb_atom
  */
 bool wid_get_text_prop(session_t *ps, xcb_window_t wid, xcb_atom_t prop, char ***pstrlst,
                        int *pnstr) {
-	assert(ps->server_grabbed);
-	auto prop_info = x_get_prop_info(ps->c, wid, prop);
+	// Use the batched reply if it has the whole value, otherwise get the size
+	// first and fetch the value in full
+	auto batched = x_prop_batch_find(&ps->prop_batch, wid, prop);
+	if (batched && batched->bytes_after) {
+		batched = NULL;
+	}
+	winprop_info_t prop_info;
+	if (batched) {
+		prop_info = (winprop_info_t){
+		    .type = batched->type,
+		    .format = batched->format,
+		    .length = (uint32_t)xcb_get_property_value_length(batched),
+		};
+	} else {
+		prop_info = x_get_prop_info(ps->c, wid, prop);
+	}
 	auto type = prop_info.type;
 	auto format = prop_info.format;
 	auto length = prop_info.length;
@@ -136,19 +245,21 @@ bool wid_get_text_prop(session_t *ps, xcb_window_t wid, xcb_atom_t prop, char **
 		return false;
 	}
 
-	xcb_generic_error_t *e = NULL;
-	auto word_count = (length + 4 - 1) / 4;
-	auto r = xcb_get_property_reply(
-	    ps->c, xcb_get_property(ps->c, 0, wid, prop, type, 0, word_count), &e);
-	if (!r) {
-		log_debug_x_error(e, "Failed to get window property for %#010x", wid);
-		free(e);
-		return false;
+	xcb_get_property_reply_t *r = NULL;
+	if (!batched) {
+		xcb_generic_error_t *e = NULL;
+		auto word_count = (length + 4 - 1) / 4;
+		r = xcb_get_property_reply(
+		    ps->c, xcb_get_property(ps->c, 0, wid, prop, type, 0, word_count), &e);
+		if (!r) {
+			log_debug_x_error(e, "Failed to get window property for %#010x", wid);
+			free(e);
+			return false;
+		}
+		assert(length == (uint32_t)xcb_get_property_value_length(r));
 	}
 
-	assert(length == (uint32_t)xcb_get_property_value_length(r));
-
-	void *data = xcb_get_property_value(r);
+	const char *data = xcb_get_property_value(batched ?: r);
 	unsigned int nstr = 0;
 	uint32_t current_offset = 0;
 	while (current_offset < length) {
@@ -175,7 +286,7 @@ bool wid_get_text_prop(session_t *ps, xcb_window_t wid, xcb_atom_t prop, char **
 	}
 
 	char *strlst = buf + sizeof(char *) * nstr;
-	memcpy(strlst, xcb_get_property_value(r), length);
+	memcpy(strlst, data, length);
 	strlst[length] = '\0';        // X strings aren't guaranteed to be null terminated
 
 	char **ret = buf;
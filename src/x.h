@@ -40,6 +40,25 @@ typedef struct winprop_info {
 	uint32_t length;
 } winprop_info_t;
 
+/// How much of each property a batch fetches, in 32-bit units. Longer properties
+/// are fetched again in full when they are read.
+#define X_PROP_BATCH_LENGTH 256
+
+struct x_prop_batch_entry;
+
+/// Properties of many windows requested together, so that reading them costs a
+/// single round trip instead of one per property.
+///
+/// All the requests are sent with `x_prop_batch_request` first, then
+/// `x_prop_batch_collect` waits for the replies, which can be read until the batch
+/// is cleared.
+struct x_prop_batch {
+	struct x_prop_batch_entry *entries;
+	unsigned len, capacity;
+	/// Whether the replies are collected, and the entries sorted
+	bool collected;
+};
+
 struct xvisual_info {
 	/// Bit depth of the red component
 	int red_size;
@@ -143,6 +162,31 @@ static inline winprop_t x_get_prop(xcb_connection_t *c, xcb_window_t wid, xcb_at
 /// Get the type, format and size in bytes of a window's specific attribute.
 winprop_info_t x_get_prop_info(xcb_connection_t *c, xcb_window_t w, xcb_atom_t atom);
 
+/// Send the request for property `atom` of window `wid`. Must be called before the
+/// batch is collected.
+void x_prop_batch_request(struct x_prop_batch *, xcb_connection_t *c, xcb_window_t wid,
+                          xcb_atom_t atom);
+
+/// Wait for the replies of all requests in the batch.
+void x_prop_batch_collect(struct x_prop_batch *, xcb_connection_t *c);
+
+/// Find the collected reply for property `atom` of window `wid`. Returns NULL if
+/// it wasn't requested, or the request failed. At most `X_PROP_BATCH_LENGTH` units
+/// of the value are in the reply.
+const xcb_get_property_reply_t *
+x_prop_batch_find(const struct x_prop_batch *, xcb_window_t wid, xcb_atom_t atom);
+
+/// Free all replies, so the batch can be used again.
+void x_prop_batch_clear(struct x_prop_batch *);
+void x_prop_batch_deinit(struct x_prop_batch *);
+
+/**
+ * Like x_get_prop, but the property is taken from `ps->prop_batch` if it was
+ * fetched there.
+ */
+winprop_t wid_get_prop(session_t *ps, xcb_window_t wid, xcb_atom_t atom, int length,
+                       xcb_atom_t rtype, int rformat);
+
 /// Discard all X events in queue or in flight. Should only be used when the server is
 /// grabbed
 static inline void x_discard_events(xcb_connection_t *c) {
@@ -157,7 +201,7 @@ static inline void x_discard_events(xcb_connection_t *c) {
  *
  * @return the value if successful, 0 otherwise
  */
-xcb_window_t wid_get_prop_window(xcb_connection_t *c, xcb_window_t wid, xcb_atom_t aprop);
+xcb_window_t wid_get_prop_window(session_t *ps, xcb_window_t wid, xcb_atom_t aprop);
 
 /**
  * Get the value of a text property of a window.
@@ -0,0 +1,80 @@
+#!/usr/bin/env python3
+# Deterministic benchmark of picom on the dummy backend.
+#
+# Usage: benchmark.py PICOM SCENARIO NWINDOWS FRAMES REPORT
+#
+# Sets up SCENARIO with NWINDOWS windows, then runs PICOM in benchmark mode for FRAMES
+# frames, which writes a JSON report to REPORT. Scenarios:
+#
+#   mapped   - opaque windows side by side, without shadows
+#   stacked  - overlapping translucent windows with shadows
+#   blurred  - like stacked, but every window also blurs its background
+#   animated - like stacked, but windows are mapped after picom has started, so their
+#              open animations and fade-ins run during the benchmark. Animations are
+#              time based, so this is the least reproducible scenario.
+
+import subprocess
+import sys
+import time
+import xcffib
+import xcffib.render
+import xcffib.xproto as xproto
+
+sys.path.insert(0, sys.path[0] + "/testcases")
+from common import set_window_name, set_window_class, find_picom_window, find_32bit_visual
+
+picom, scenario, nwindows, frames, report = sys.argv[1:]
+nwindows = int(nwindows)
+
+conn = xcffib.connect()
+setup = conn.get_setup()
+root = setup.roots[0].root
+visual = setup.roots[0].root_visual
+depth = setup.roots[0].root_depth
+
+translucent = scenario != "mapped"
+if translucent:
+    visual = find_32bit_visual(conn)
+    depth = 32
+    colormap = conn.generate_id()
+    conn.core.CreateColormapChecked(xproto.ColormapAlloc._None, colormap, root, visual).check()
+
+name = {"mapped": "NoShadow", "blurred": "Blurred"}.get(scenario, "Window")
+
+windows = []
+for i in range(nwindows):
+    wid = conn.generate_id()
+    # Cascade the windows, wrapping around so they stay on screen. Translucent
+    # windows overlap, opaque ones are laid out on a grid.
+    if translucent:
+        x, y, w, h = (i * 23) % 600, (i * 17) % 400, 400, 300
+    else:
+        x, y, w, h = (i % 10) * 100, (i // 10 % 10) * 100, 100, 100
+    if translucent:
+        value_mask = xproto.CW.BackPixel | xproto.CW.BorderPixel | xproto.CW.Colormap
+        value_list = [0x80808080, 0, colormap]
+    else:
+        value_mask, value_list = 0, []
+    conn.core.CreateWindowChecked(depth, wid, root, x, y, w, h, 0,
+            xproto.WindowClass.InputOutput, visual, value_mask, value_list).check()
+    set_window_name(conn, wid, name)
+    set_window_class(conn, wid, "benchmark")
+    windows.append(wid)
+
+def map_windows():
+    for wid in windows:
+        conn.core.MapWindowChecked(wid).check()
+
+if scenario != "animated":
+    map_windows()
+    conn.flush()
+
+proc = subprocess.Popen([picom, "--backend", "dummy", "--config", sys.path[0] + "/configs/benchmark.conf",
+    "--benchmark", frames, "--benchmark-report", report])
+
+if scenario == "animated":
+    while find_picom_window(conn) is None:
+        time.sleep(0.01)
+    map_windows()
+
+sys.exit(proc.wait())
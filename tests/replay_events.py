@@ -0,0 +1,156 @@
+#!/usr/bin/env python3
+# Replay a trace recorded with `picom --record-events` on the current X server.
+#
+# Usage: replay_events.py TRACE [SPEED]
+#
+# The top-level windows of the trace are recreated as override-redirect windows, and
+# their mapping, unmapping, stacking and geometry changes are performed with the
+# recorded timing, divided by SPEED (default 1). A SPEED of 0 replays as fast as
+# possible. The recorded properties, like WM_CLASS, WM_NAME or
+# _NET_WM_WINDOW_TYPE, are set on the recreated windows, so the rules match the
+# same windows. A compositor running on the same server then sees a similar
+# sequence of events as when the trace was recorded, and gets real replies to its
+# requests. When picom was reset while recording, the windows are created again.
+#
+# This is not a deterministic replay: the replies come from the server the trace
+# is replayed on, and the timing depends on it. Window contents are not part of
+# the trace, so the windows are blank. See x_stub.py for recording the replies
+# picom gets along with the trace, and replaying them without an X server.
+
+import struct
+import sys
+import time
+import xcffib
+import xcffib.xproto as xproto
+
+trace = open(sys.argv[1], "rb")
+speed = float(sys.argv[2]) if len(sys.argv) > 2 else 1.0
+
+magic, version, recorded_root = struct.unpack("=8sII", trace.read(16))
+if magic != b"picomevt" or version != 2:
+    sys.exit("Not a picom event trace, or an unsupported version")
+
+conn = xcffib.connect()
+setup = conn.get_setup()
+root = setup.roots[0].root
+visual = setup.roots[0].root_visual
+depth = setup.roots[0].root_depth
+
+atoms = {}
+def atom(name):
+    if name not in atoms:
+        atoms[name] = conn.core.InternAtom(False, len(name), name).reply().atom
+    return atoms[name]
+
+wm_state = atom(b"WM_STATE")
+
+# Recorded window id -> replayed window id
+windows = {}
+
+def create(window, x, y, width, height, border_width, override_redirect):
+    wid = conn.generate_id()
+    conn.core.CreateWindow(depth, wid, root, x, y, max(width, 1), max(height, 1),
+            border_width, xproto.WindowClass.InputOutput, visual,
+            xproto.CW.BackPixel | xproto.CW.OverrideRedirect,
+            [0x808080, 1])
+    if not override_redirect:
+        # Look like a window managed by a window manager
+        conn.core.ChangeProperty(xproto.PropMode.Replace, wid, wm_state, wm_state, 32, 2, [1, 0])
+    windows[window] = wid
+
+def configure(window, above_sibling, x, y, width, height, border_width):
+    mask = (xproto.ConfigWindow.X | xproto.ConfigWindow.Y | xproto.ConfigWindow.Width |
+            xproto.ConfigWindow.Height | xproto.ConfigWindow.BorderWidth)
+    values = [x, y, max(width, 1), max(height, 1), border_width]
+    if above_sibling in windows:
+        mask |= xproto.ConfigWindow.Sibling | xproto.ConfigWindow.StackMode
+        values += [windows[above_sibling], xproto.StackMode.Above]
+    elif above_sibling == 0:
+        mask |= xproto.ConfigWindow.StackMode
+        values += [xproto.StackMode.Below]
+    conn.core.ConfigureWindow(windows[window], mask, values)
+
+def replay(ev):
+    code = ev[0] & 0x7f
+    if code == 16:  # CreateNotify
+        parent, window, x, y, w, h, bw, override_redirect = struct.unpack_from("=IIhhHHHB", ev, 4)
+        if parent == recorded_root:
+            create(window, x, y, w, h, bw, override_redirect)
+        return
+    if code in (17, 18, 19, 21, 22, 26):
+        event, window = struct.unpack_from("=II", ev, 4)
+        if event != recorded_root or window not in windows:
+            return
+    else:
+        return
+
+    wid = windows[window]
+    if code == 17:  # DestroyNotify
+        conn.core.DestroyWindow(wid)
+        del windows[window]
+    elif code == 18:  # UnmapNotify
+        conn.core.UnmapWindow(wid)
+    elif code == 19:  # MapNotify
+        conn.core.MapWindow(wid)
+    elif code == 21:  # ReparentNotify
+        parent, = struct.unpack_from("=I", ev, 12)
+        if parent != recorded_root:
+            # Reparented away from the root, it's no longer a top-level window
+            conn.core.DestroyWindow(wid)
+            del windows[window]
+    elif code == 22:  # ConfigureNotify
+        above_sibling, x, y, w, h, bw = struct.unpack_from("=IhhHHH", ev, 12)
+        configure(window, above_sibling, x, y, w, h, bw)
+    elif code == 26:  # CirculateNotify
+        place, = struct.unpack_from("=B", ev, 16)
+        mode = xproto.StackMode.Above if place == xproto.Place.OnTop else xproto.StackMode.Below
+        conn.core.ConfigureWindow(wid, xproto.ConfigWindow.StackMode, [mode])
+
+def set_property(record):
+    window, format = struct.unpack_from("=IB", record)
+    name, type_name, value = record[8:].split(b"\0", 2)
+    if window not in windows:
+        return
+    wid = windows[window]
+    if format == 0:
+        conn.core.DeleteProperty(wid, atom(name))
+        return
+    if type_name == b"ATOM":
+        names = value.split(b"\0")[:-1]
+        value = struct.pack("=%dI" % len(names), *(atom(n) if n else 0 for n in names))
+    elif type_name == b"WINDOW" and format == 32:
+        ids = struct.unpack("=%dI" % (len(value) // 4), value)
+        value = struct.pack("=%dI" % len(ids), *(windows.get(i, 0) for i in ids))
+    conn.core.ChangeProperty(xproto.PropMode.Replace, wid, atom(name),
+            atom(type_name) if type_name else 0, format, len(value) // (format // 8), value)
+
+start = time.monotonic()
+nevents = 0
+nproperties = 0
+while True:
+    header = trace.read(16)
+    if len(header) < 16:
+        break
+    timestamp_us, kind, size = struct.unpack("=QII", header)
+    data = trace.read(size)
+    if speed > 0:
+        delay = start + timestamp_us / 1e6 / speed - time.monotonic()
+        if delay > 0:
+            conn.flush()
+            time.sleep(delay)
+    if kind == 0:
+        replay(data)
+        nevents += 1
+    elif kind == 1:
+        set_property(data)
+        nproperties += 1
+    elif kind == 2:
+        # picom was reset, the windows it found are recorded again after this
+        for wid in windows.values():
+            conn.core.DestroyWindow(wid)
+        windows.clear()
+
+conn.flush()
+conn.core.GetInputFocus().reply()
+print("Replayed %d events and %d properties in %.3fs" %
+        (nevents, nproperties, time.monotonic() - start))
@@ -0,0 +1,19 @@
+#!/bin/sh
+# Run the benchmark scenarios under Xvfb, writing one JSON report per scenario.
+#
+# Usage: run_benchmark.sh PICOM [OUTPUT_DIR] [NWINDOWS] [FRAMES]
+set -e
+if [ -z $DISPLAY ]; then
+	exec xvfb-run -s "+extension composite" -a $0 "$@"
+fi
+
+exe=$(realpath $1)
+out=$(realpath ${2:-.})
+nwindows=${3:-50}
+frames=${4:-1000}
+cd $(dirname $0)
+
+for scenario in mapped stacked blurred animated; do
+	echo "Running benchmark $scenario"
+	./benchmark.py $exe $scenario $nwindows $frames $out/benchmark-$scenario.json
+done
@@ -0,0 +1,293 @@
+#!/usr/bin/env python3
+# Record the X replies a compositor gets, and serve them back from a stubbed X server.
+#
+# Usage: x_stub.py record LOG DISPLAY
+#        x_stub.py replay LOG DISPLAY [TIMEOUT]
+#
+# In record mode, a proxy X server is started on DISPLAY (e.g. :9). It forwards the
+# connection of one client, usually picom, to the X server in $DISPLAY, and writes
+# everything the server sends to it to LOG: the connection setup, the replies, the
+# errors and the events, in the order they were sent. Each of them is recorded
+# with the number of requests the client had sent at that point. The requests are
+# recorded too, without their contents. Run picom with --record-events at the same
+# time to get the event trace next to the replies:
+#
+#     x_stub.py record trace.x :9 &
+#     DISPLAY=:9 picom --backend xrender --record-events trace
+#
+# In replay mode, a stubbed X server is started on DISPLAY instead, which serves LOG
+# to one client without a real X server behind it. Each recorded reply, error and
+# event is sent once the client has sent as many requests as when it was recorded,
+# so picom sees the same replies and the same events at the same points of its
+# request stream, regardless of timing:
+#
+#     x_stub.py replay trace.x :9 &
+#     DISPLAY=:9 picom --backend xrender --frame-stats-file stats
+#
+# The requests of the client are compared with the recorded ones. If they differ,
+# for example because a timer fired at a different point, the replay is no longer
+# exact and this is reported. If the client waits for longer than TIMEOUT seconds
+# (default 1) without sending a request while the next recorded message is held
+# back, that message is sent anyway and this is reported too. When the log is
+# exhausted, the connection is closed, which makes picom exit.
+#
+# Only the wire protocol is stubbed, so only backends that render through it can be
+# replayed, i.e. xrender and dummy. File descriptors passed along with requests are
+# not forwarded.
+#
+# LOG is a binary file in little endian byte order. It starts with:
+#
+#     char magic[8] = "picomxrp"; uint32_t version;
+#
+# followed by records:
+#
+#     uint8_t kind; uint64_t requests; uint32_t size; uint8_t data[size];
+#
+# where kind is 0 for the connection setup reply, 1 for a reply, error or event,
+# and 2 for a request, in which case data is its major and minor opcode. requests is
+# the number of requests sent before it.
+
+import os
+import selectors
+import socket
+import struct
+import sys
+import time
+
+MAGIC = b"picomxrp"
+VERSION = 1
+SETUP, SERVER, REQUEST = 0, 1, 2
+
+
+def socket_path(display):
+    number = display.split(":", 1)[1].split(".", 1)[0]
+    return "/tmp/.X11-unix/X" + number
+
+
+def listen(display):
+    path = socket_path(display)
+    os.makedirs(os.path.dirname(path), exist_ok=True)
+    if os.path.exists(path):
+        os.unlink(path)
+    sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+    sock.bind(path)
+    sock.listen(1)
+    return sock, path
+
+
+def connect(display):
+    sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+    sock.connect(socket_path(display))
+    return sock
+
+
+class ClientStream:
+    """Splits what a client sends into the setup request and requests."""
+
+    def __init__(self):
+        self.buf = b""
+        self.order = None
+        self.setup = False
+        self.requests = 0
+
+    def feed(self, data):
+        """Returns the (major, minor) opcodes of the requests completed by data"""
+        self.buf += data
+        done = []
+        if not self.setup:
+            if len(self.buf) < 12:
+                return done
+            self.order = "<" if self.buf[0:1] == b"l" else ">"
+            name_len, data_len = struct.unpack_from(self.order + "HH", self.buf, 6)
+            size = 12 + pad(name_len) + pad(data_len)
+            if len(self.buf) < size:
+                return done
+            self.buf = self.buf[size:]
+            self.setup = True
+        while len(self.buf) >= 4:
+            major, minor, length = struct.unpack_from(self.order + "BBH", self.buf)
+            if length == 0:
+                # BIG-REQUESTS
+                if len(self.buf) < 8:
+                    break
+                length, = struct.unpack_from(self.order + "I", self.buf, 4)
+            if len(self.buf) < length * 4:
+                break
+            self.buf = self.buf[length * 4:]
+            done.append((major, minor))
+            self.requests += 1
+        return done
+
+
+class ServerStream:
+    """Splits what a server sends into the setup reply, and replies, errors and
+    events."""
+
+    def __init__(self, order):
+        self.buf = b""
+        self.order = order
+        self.setup = False
+
+    def feed(self, data):
+        self.buf += data
+        done = []
+        while True:
+            if not self.setup:
+                if len(self.buf) < 8:
+                    break
+                length, = struct.unpack_from(self.order + "H", self.buf, 6)
+                size = 8 + length * 4
+            else:
+                if len(self.buf) < 32:
+                    break
+                size = 32
+                if self.buf[0] == 1 or self.buf[0] & 0x7f == 35:
+                    # Reply or GenericEvent
+                    length, = struct.unpack_from(self.order + "I", self.buf, 4)
+                    size += length * 4
+            if len(self.buf) < size:
+                break
+            done.append((SERVER if self.setup else SETUP, self.buf[:size]))
+            self.buf = self.buf[size:]
+            self.setup = True
+        return done
+
+
+def pad(n):
+    return (n + 3) & ~3
+
+
+def write_record(log, kind, requests, data):
+    log.write(struct.pack("<BQI", kind, requests, len(data)) + data)
+
+
+def read_log(path):
+    with open(path, "rb") as f:
+        magic, version = struct.unpack("<8sI", f.read(12))
+        if magic != MAGIC or version != VERSION:
+            sys.exit("Not a picom reply log, or an unsupported version")
+        records = []
+        while True:
+            header = f.read(13)
+            if len(header) < 13:
+                break
+            kind, requests, size = struct.unpack("<BQI", header)
+            records.append((kind, requests, f.read(size)))
+    return records
+
+
+def record(log_path, display):
+    server_display = os.environ["DISPLAY"]
+    listener, path = listen(display)
+    client, _ = listener.accept()
+    listener.close()
+    os.unlink(path)
+    server = connect(server_display)
+
+    log = open(log_path, "wb")
+    log.write(struct.pack("<8sI", MAGIC, VERSION))
+    from_client = ClientStream()
+    from_server = None
+    nreplies = 0
+
+    sel = selectors.DefaultSelector()
+    sel.register(client, selectors.EVENT_READ)
+    sel.register(server, selectors.EVENT_READ)
+    running = True
+    while running:
+        for key, _ in sel.select():
+            data = key.fileobj.recv(65536)
+            if not data:
+                running = False
+                break
+            if key.fileobj is client:
+                server.sendall(data)
+                requests_before = from_client.requests
+                for i, opcodes in enumerate(from_client.feed(data)):
+                    write_record(log, REQUEST, requests_before + i, bytes(opcodes))
+                if from_server is None and from_client.setup:
+                    from_server = ServerStream(from_client.order)
+            else:
+                # The setup request is always complete before the server answers it
+                for kind, message in from_server.feed(data):
+                    write_record(log, kind, from_client.requests, message)
+                    nreplies += 1
+                client.sendall(data)
+    log.close()
+    print("Recorded %d requests and %d replies, errors and events" %
+            (from_client.requests, nreplies))
+
+
+def replay(log_path, display, timeout):
+    records = read_log(log_path)
+    requests = [r[2] for r in records if r[0] == REQUEST]
+    messages = [(r[1], r[2]) for r in records if r[0] != REQUEST]
+
+    listener, path = listen(display)
+    client, _ = listener.accept()
+    listener.close()
+    os.unlink(path)
+
+    from_client = ClientStream()
+    next_message = 0
+    diverged = None
+    forced = 0
+    start = time.monotonic()
+    while next_message < len(messages):
+        # Send everything the client is due, after its setup request
+        while from_client.setup and next_message < len(messages):
+            requests_before, message = messages[next_message]
+            if requests_before > from_client.requests:
+                break
+            client.sendall(message)
+            next_message += 1
+        if next_message == len(messages):
+            break
+
+        client.settimeout(timeout)
+        try:
+            data = client.recv(65536)
+        except socket.timeout:
+            # The client is waiting for something it got before it sent more
+            # requests when the log was recorded
+            client.sendall(messages[next_message][1])
+            next_message += 1
+            forced += 1
+            continue
+        if not data:
+            break
+        requests_before = from_client.requests
+        for i, opcodes in enumerate(from_client.feed(data)):
+            n = requests_before + i
+            if diverged is None and (n >= len(requests) or bytes(opcodes) != requests[n]):
+                diverged = n
+                print("Requests differ from the recording from request %d on" % n,
+                        file=sys.stderr)
+
+    # Let the client read what it was sent before the connection goes away, i.e.
+    # until it makes a request that wasn't recorded, exits or goes idle
+    client.settimeout(timeout)
+    try:
+        while True:
+            data = client.recv(65536)
+            if not data or from_client.feed(data):
+                break
+    except (socket.timeout, ConnectionError):
+        pass
+    client.close()
+    print("Replayed %d of %d replies, errors and events for %d requests in %.3fs" %
+            (next_message, len(messages), from_client.requests, time.monotonic() - start))
+    if forced:
+        print("%d of them were sent without waiting for the client" % forced)
+    return diverged is None and forced == 0
+
+
+if __name__ == "__main__":
+    if len(sys.argv) < 4 or sys.argv[1] not in ("record", "replay"):
+        sys.exit("Usage: x_stub.py record LOG DISPLAY\n"
+                 "       x_stub.py replay LOG DISPLAY [TIMEOUT]")
+    if sys.argv[1] == "record":
+        record(sys.argv[2], sys.argv[3])
+    else:
+        timeout = float(sys.argv[4]) if len(sys.argv) > 4 else 1.0
+        sys.exit(0 if replay(sys.argv[2], sys.argv[3], timeout) else 1)